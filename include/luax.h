@@ -41,20 +41,51 @@ extern "C" {
 }
 #endif
 
+#include <atomic>
+#include <iterator>
+#include <limits.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+// Dispatch profiling, see luax_profile.h.
+// Replaces function on top of the stack with profiling closure if profiling
+// is enabled for the state.
+#include "luax_profile.h"
+#define LUAX_PROFILE_WRAP(L, type, prefix, name) \
+    luax::profile::wrap(L, type, prefix, name)
+
 
 // Helper macros to define a type.
 // TODO: add docs for the macros.
 
 #define LUAX_TYPE_NAME(cls,name)                                        \
     namespace luax {                                                    \
+        template <> struct bound_type<cls>: std::true_type {};          \
         template <> const char* type<cls>::usr_name() { return name; }  \
     }
 
+// Marks the class as bound if usr_name() is specialized without
+// LUAX_TYPE_NAME(), see is_bound.
+#define LUAX_TYPE_BOUND(cls)                                            \
+    namespace luax {                                                    \
+        template <> struct bound_type<cls>: std::true_type {};          \
+    }
+
 #define LUAX_TYPE_SUPER_NAME(cls,name)                                      \
     namespace luax {                                                        \
         template <> const char* type<cls>::usr_super_name() { return name; }\
     }
 
+#define LUAX_TYPE_INPLACE(cls)                                          \
+    namespace luax {                                                    \
+        template <> bool type<cls>::usr_inplace() { return true; }      \
+    }
+
 
 #define LUAX_FUNCTIONS_BEGIN(cls)           \
     namespace luax {                        \
@@ -71,6 +102,19 @@ extern "C" {
 
 #define LUAX_FUNCTION(name, f) {name, f},
 
+// Bind method 'int T::f(lua_State*)' as upvalue free lua_CFunction,
+// method pointer is a template parameter so the call can be inlined.
+// Can be used in LUAX_FUNCTION() and LUAX_PROPERTY():
+//
+//  LUAX_FUNCTIONS_BEGIN(Point)
+//      LUAX_FUNCTION("getX", LUAX_METHOD(&Point::getX))
+//  LUAX_FUNCTIONS_END
+//
+// LUAX_METHOD() removes self from the stack like methods[] do,
+// LUAX_METHOD_SELF() leaves self at index 1 and skips the stack shift.
+#define LUAX_METHOD(f) (&luax::trampoline<decltype(f), f, true>::call)
+#define LUAX_METHOD_SELF(f) (&luax::trampoline<decltype(f), f, false>::call)
+
 
 #define LUAX_PROPERTIES_BEGIN(cls)          \
     namespace luax {                        \
@@ -112,37 +156,282 @@ extern "C" {
     } // namespace luax
 
 
-// Registry table name where luax stores userdata, see init() and push().
+// Registry table name where luax stores identity caches, see init() and push().
 #define LUAX_UDATA "__luax_ud"
 
+// Max inheritance depth supported by type tags, see TypeTag.
+#ifndef LUAX_MAX_DEPTH
+#define LUAX_MAX_DEPTH 16
+#endif
+
+// Marks userdata created by luax, see type::cast().
+#define LUAX_MAGIC 0x6c756178
+
 namespace luax
 {
 
+/**
+ * True if T is a class bound with luax::type, set by LUAX_TYPE_NAME() or
+ * LUAX_TYPE_BOUND(). Used to select conversion of the bound classes
+ * (see luax_bind.h, luax_span.h).
+ */
+template <typename T>
+struct bound_type: std::false_type {};
+
+template <typename T>
+struct is_bound: bound_type<typename std::remove_cv<T>::type> {};
+//------------------------------------------------------------------------------
+
+// Lua 5.1 compatibility helpers.
+
+/** Same as lua_rawgetp() (lua >= 5.2), pushes t[p]. */
+static inline void rawgetp(lua_State *L, int index, const void *p)
+{
+#if LUA_VERSION_NUM >= 502
+    lua_rawgetp(L, index, p);
+#else
+    if (index < 0 && index > LUA_REGISTRYINDEX)
+        --index;
+    lua_pushlightuserdata(L, const_cast<void*>(p));
+    lua_rawget(L, index);
+#endif
+}
+//------------------------------------------------------------------------------
+
+/** Same as lua_rawlen() (lua >= 5.2). */
+static inline size_t rawlen(lua_State *L, int index)
+{
+#if LUA_VERSION_NUM >= 502
+    return lua_rawlen(L, index);
+#else
+    return lua_objlen(L, index);
+#endif
+}
+//------------------------------------------------------------------------------
+
+/** Same as lua_rawsetp() (lua >= 5.2), does t[p] = v, v is on top. */
+static inline void rawsetp(lua_State *L, int index, const void *p)
+{
+#if LUA_VERSION_NUM >= 502
+    lua_rawsetp(L, index, p);
+#else
+    if (index < 0 && index > LUA_REGISTRYINDEX)
+        --index;
+    lua_pushlightuserdata(L, const_cast<void*>(p));   // v p
+    lua_insert(L, -2);                                // p v
+    lua_rawset(L, index);
+#endif
+}
+//------------------------------------------------------------------------------
+
+/** Same as lua_pushglobaltable() (lua >= 5.2). */
+static inline void pushglobaltable(lua_State *L)
+{
+#if LUA_VERSION_NUM >= 502
+    lua_pushglobaltable(L);
+#else
+    lua_pushvalue(L, LUA_GLOBALSINDEX);
+#endif
+}
+//------------------------------------------------------------------------------
+
 // Initialization:
-// Create lightuserdata table with weak values.
-// It used to store instance pointers to reuse already pushed values.
+// Create table to hold per type identity caches (type name -> cache).
+// Caches are used to reuse already pushed values, see type::push().
 static void init(lua_State * L)
 {
-    lua_newtable(L);                            // tbl
-    lua_newtable(L);                            // tbl mt
-    lua_pushliteral(L, "__mode");               // tbl mt key
-    lua_pushliteral(L, "v");                    // tbl mt key value
-    lua_rawset(L, -3);                          // mt.__mode = 'v', tbl mt
-    lua_setmetatable(L, -2);                    // tbl.__mt = mt, tbl
+    lua_newtable(L);                                // tbl
     lua_setfield(L, LUA_REGISTRYINDEX, LUAX_UDATA); // registry[key] = tbl
 }
 //------------------------------------------------------------------------------
+
+// Return true if value at the index is luax service key of the
+// instance metatable (see type::build_dispatch()).
+static inline bool is_service_key(lua_State *L, int index)
+{
+    if (lua_type(L, index) != LUA_TSTRING)
+        return false;
+    const char *key = lua_tostring(L, index);
+    if (key[0] != '_' || key[1] != '_')
+        return false;
+    return !strcmp(key, "__attrs") || !strcmp(key, "__setters")
+        || !strcmp(key, "__extras") || !strcmp(key, "__tag");
+}
+//------------------------------------------------------------------------------
+
+// Set attrs[key] = val in the __index dispatch table (see type::index()),
+// table values are boxed as {nil, val} since {getter} box is a getter.
+// stack: key val -> (empty)
+static inline void set_dispatch_member(lua_State *L, int attrs)
+{
+    if (lua_istable(L, -1))
+    {
+        lua_createtable(L, 2, 0);               // key val box
+        lua_insert(L, -2);                      // key box val
+        lua_rawseti(L, -2, 2);                  // key box
+    }
+    lua_rawset(L, attrs);
+}
+//------------------------------------------------------------------------------
+
+// Copy all t[k] = v pairs from the table 'from' to the table 'to'
+// (except luax service keys), return number of copied pairs.
+static int copy_attrs(lua_State *L, int from, int to)
+{
+    int count = 0;
+    int top = lua_gettop(L);
+    if (from < 0)
+        from = top + from + 1;
+    if (to < 0)
+        to = top + to + 1;
+
+    lua_pushnil(L);
+    while (lua_next(L, from))                   // key val
+    {
+        if (!is_service_key(L, -2))
+        {
+            lua_pushvalue(L, -2);               // key val key
+            lua_insert(L, -2);                  // key key val
+            lua_rawset(L, to);                  // key
+            ++count;
+        }
+        else
+            lua_pop(L, 1);                      // key
+    }
+    return count;
+}
+//------------------------------------------------------------------------------
+
+// Same as luaL_newmetatable() but preallocates nrec fields.
+static bool new_metatable(lua_State *L, const char *name, int nrec)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, name);   // mt
+    if (!lua_isnil(L, -1))
+        return false;
+    lua_pop(L, 1);
+
+    lua_createtable(L, 0, nrec);                // mt
+#if LUA_VERSION_NUM >= 503
+    lua_pushstring(L, name);
+    lua_setfield(L, -2, "__name");
+#endif
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, name);   // registry[name] = mt
+    return true;
+}
+//------------------------------------------------------------------------------
+
+// Push metatable with __mode = 'v', shared by the identity caches
+// of all types in the state.
+inline void push_weak_values_mt(lua_State *L)
+{
+    static char key;
+    rawgetp(L, LUA_REGISTRYINDEX, &key);        // mt
+    if (!lua_isnil(L, -1))
+        return;
+    lua_pop(L, 1);
+
+    lua_createtable(L, 0, 1);                   // mt
+    lua_pushliteral(L, "__mode");               // mt key
+    lua_pushliteral(L, "v");                    // mt key value
+    lua_rawset(L, -3);                          // mt.__mode = 'v', mt
+    lua_pushvalue(L, -1);
+    rawsetp(L, LUA_REGISTRYINDEX, &key);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+
+
+struct TypeDesc;
+
+/**
+ * Type tag, one per bound type.
+ *
+ * ancestors[i] is the tag of the superclass at inheritance depth i
+ * (root class has depth 0) and ancestors[depth] is the tag itself,
+ * so "is a" check is a single compare, see is_a().
+ * Tag is filled on first type::register_in().
+ */
+struct TypeTag
+{
+    int depth;
+    const TypeTag *ancestors[LUAX_MAX_DEPTH];
+    int (*push)(lua_State *L, void *obj);   // type::push() without GC.
+    const TypeDesc *desc;
+    std::once_flag once;
+
+    bool is_a(const TypeTag *base) const
+    {
+        return depth >= base->depth && ancestors[base->depth] == base;
+    }
+};
+//------------------------------------------------------------------------------
+
+/** Entry of the flattened attributes list, see TypeDesc. */
+struct Attr
+{
+    enum Kind { MEMBER, GETTER, SETTER };
+
+    const char *name;
+    Kind kind;
+    lua_CFunction func;
+    void *data;         // Closure upvalue if not null.
+    const char *type;   // Name of the type defining the attribute.
+};
 //------------------------------------------------------------------------------
 
+/**
+ * Registration descriptor, one per bound type.
+ *
+ * Compiled once per process from the static attribute arrays on first
+ * type::register_in() and shared by all states: sizes are used to
+ * preallocate metatable, dispatch and type tables, and the flattened
+ * attributes list fills dispatch tables without copying superclass
+ * metatables, see type::build_dispatch().
+ */
+struct TypeDesc
+{
+    int members;        // functions[] + methods[].
+    int type_attrs;     // type_functions[] + type_enums[].
+    bool properties;    // Type has own properties.
+    std::once_flag once;
+
+    // Attributes of the type and its superclasses: superclass attributes
+    // (without overridden ones) go first, own ones start at own_attrs.
+    std::vector<Attr> attrs;
+    size_t own_attrs;
+    int flat_members;
+    int flat_getters;
+    int flat_setters;
+    std::once_flag attrs_once;
+};
+//------------------------------------------------------------------------------
 
 /** Instance wrapper. */
 struct Wrapper
 {
     void *ptr;
+    const TypeTag *tag;     // Type of the instance.
+    uint32_t magic;         // LUAX_MAGIC.
     bool use_gc;
+    bool inplace;       // Instance is constructed in the userdata block.
+    bool pooled;        // Memory is allocated with usr_alloc().
+    bool constructed;   // Pooled instance is constructed.
+    bool shared;        // std::shared_ptr is stored in the userdata block.
 };
 //------------------------------------------------------------------------------
 
+// Raise error if the instance at the index is pushed by type::push_shared(),
+// such instances are read-only.
+inline void check_writable(lua_State *L, int index)
+{
+    Wrapper *wrapper = static_cast<Wrapper*>(lua_touserdata(L, index));
+    if (wrapper && wrapper->shared)
+        luaL_error(L, "Attempt to modify read-only object");
+}
+//------------------------------------------------------------------------------
+
 /** Method wrapper. */
 template <typename T>
 struct Method
@@ -206,6 +495,10 @@ public:
     static int usr_setter(lua_State *L);
     static bool usr_gc(lua_State *L, T *obj);
     static T* usr_constructor(lua_State *L);
+    static bool usr_inplace();
+    static T* usr_inplace_constructor(lua_State *L, void *mem);
+    static void* usr_alloc(lua_State *L);
+    static void usr_free(lua_State *L, void *mem);
 
     static luaL_Reg functions[];
     static Method<T> methods[];
@@ -217,19 +510,56 @@ public:
 
     static void register_in(lua_State *L);
     static inline int push(lua_State *L, T *obj, bool useGc = true);
+    static inline int push_value(lua_State *L, const T &val, size_t extra = 0);
+    static inline int push_shared(lua_State *L,
+                                  const std::shared_ptr<const T> &obj);
+    template <typename It>
+    static int push_range(lua_State *L, It first, It last, bool useGc = true);
     static inline T* get(lua_State *L, int index);
     static inline T* check_get(lua_State *L, int index);
+    static inline T* cast(lua_State *L, int index);
+    static inline T* check_cast(lua_State *L, int index);
+    template <typename It>
+    static int invoke_all(lua_State *L, It first, It last, const char *name,
+                          int nargs = 0);
 
 private:
+    // Address of the variable is used as identity cache key in the registry.
+    static char cache_key;
+    static TypeTag tag;
+    static TypeDesc desc;
+
+    static void init_tag(lua_State *L, const TypeTag *super);
+    static const TypeDesc& compile_desc();
+    static void compile_attrs(const TypeTag *super);
+    static int push_untyped(lua_State *L, void *obj);
+
+    static inline void push_cache(lua_State *L);
+    static inline void push_cached(lua_State *L, int cache, int mt, T *obj,
+                                   bool useGc);
+    static T* element(T *obj) { return obj; }
+    static T* element(const T *obj) { return const_cast<T*>(obj); }
+    static T* element(T &obj) { return &obj; }
+    static T* element(const T &obj) { return const_cast<T*>(&obj); }
+    static inline Wrapper* new_inplace(lua_State *L, size_t extra = 0);
+    static inline void* inplace_storage(Wrapper *wrapper);
+    static inline void bind_inplace(lua_State *L, Wrapper *wrapper, T *obj);
+    static inline void cache_instance(lua_State *L, T *obj);
     static inline int create(lua_State *L);
     static inline int gc(lua_State *L);
     static inline int index(lua_State *L);
     static inline int newindex(lua_State *L);
 
-    static void register_attrs(lua_State *L, bool customIndex);
+    static void register_attrs(lua_State *L);
+    static void build_dispatch(lua_State *L);
     static inline int on_method(lua_State *L);
     static inline int on_getter(lua_State *L);
     static inline int on_setter(lua_State *L);
+    static inline int on_invoke(lua_State *L);
+    static Method<T>* find_method(const char *name);
+    static int invoke_list(lua_State *L, int list, int out);
+    static int lua_invoke_all(lua_State *L);
+    static int lua_invoke_into(lua_State *L);
     static void register_type_attrs(lua_State *L);
 };
 //------------------------------------------------------------------------------
@@ -245,6 +575,10 @@ template <typename T> int type<T>::usr_getter(lua_State*) { return 0; }
 template <typename T> int type<T>::usr_setter(lua_State*) { return 0; }
 template <typename T> bool type<T>::usr_gc(lua_State*, T*) { return false; }
 template <typename T> T* type<T>::usr_constructor(lua_State*) { return 0; }
+template <typename T> bool type<T>::usr_inplace() { return false; }
+template <typename T> T* type<T>::usr_inplace_constructor(lua_State*, void*) { return 0; }
+template <typename T> void* type<T>::usr_alloc(lua_State*) { return 0; }
+template <typename T> void type<T>::usr_free(lua_State*, void*) { }
 
 template <typename T> luaL_Reg type<T>::functions[] = {0, 0};
 template <typename T> Method<T> type<T>::methods[] = {0, 0};
@@ -252,14 +586,67 @@ template <typename T> FuncProperty type<T>::func_properties[] = {0, 0, 0};
 template <typename T> MethodProperty<T> type<T>::method_properties[] = {0, 0, 0};
 template <typename T> Enum type<T>::type_enums[] = {0, 0};
 template <typename T> luaL_Reg type<T>::type_functions[] = {0, 0};
+
+template <typename T> char type<T>::cache_key = 0;
+template <typename T> TypeTag type<T>::tag;
+template <typename T> TypeDesc type<T>::desc;
 //------------------------------------------------------------------------------
 
 template <typename T> int type<T>::create(lua_State *L)
 {
-    T *obj = usr_constructor(L);
+    if (usr_inplace())
+    {
+        // Userdata replaces type table (first __call argument) to keep
+        // constructor arguments at the same indices.
+        Wrapper *wrapper = new_inplace(L);
+        lua_replace(L, 1);
+
+        T *obj = usr_inplace_constructor(L, inplace_storage(wrapper));
+        if (!obj)
+            luaL_error(L, "Error creating %s", usr_name());
+
+        lua_pushvalue(L, 1);
+        bind_inplace(L, wrapper, obj);
+        return 1;
+    }
+
+    // Userdata is created before usr_alloc(), so pool memory is not leaked
+    // if lua_newuserdata() raises memory error, and it's returned by gc()
+    // if the constructor raises an error.
+    Wrapper *wrapper =
+        static_cast<Wrapper*>(lua_newuserdata(L, sizeof(Wrapper)));
+    wrapper->ptr = 0;
+    wrapper->tag = &tag;
+    wrapper->magic = LUAX_MAGIC;
+    wrapper->use_gc = false;
+    wrapper->inplace = false;
+    wrapper->pooled = false;
+    wrapper->constructed = false;
+    wrapper->shared = false;
+
+    luaL_getmetatable(L, usr_name());           // ud mt
+    lua_setmetatable(L, -2);                    // ud
+
+    // Keep constructor arguments at the same indices, see above.
+    lua_replace(L, 1);
+
+    T *obj;
+    if (void *mem = usr_alloc(L))
+    {
+        wrapper->ptr = mem;
+        wrapper->pooled = true;
+        obj = usr_inplace_constructor(L, mem);
+    }
+    else
+        obj = usr_constructor(L);
     if (!obj)
         luaL_error(L, "Error creating %s", usr_name());
-    push(L, obj);
+    wrapper->ptr = static_cast<void*>(obj);
+    wrapper->use_gc = true;
+    wrapper->constructed = true;
+
+    lua_pushvalue(L, 1);                        // ud
+    cache_instance(L, obj);
     return 1;
 }
 //------------------------------------------------------------------------------
@@ -299,7 +686,37 @@ template <typename T> int type<T>::gc(lua_State *L)
         return 0;
 
     T *obj = static_cast<T*>(wrapper->ptr);
-    if (wrapper->use_gc)
+    if (wrapper->shared)
+    {
+        // Drop the reference of this state only, the last owner deletes
+        // the instance.
+        typedef std::shared_ptr<const T> Ptr;
+        if (obj)
+            static_cast<Ptr*>(static_cast<void*>(wrapper + 1))->~Ptr();
+        wrapper->ptr = 0;
+    }
+    else if (wrapper->inplace)
+    {
+        // Memory is owned by lua, so only destruct the instance.
+        if (obj && !usr_gc(L, obj))
+            obj->~T();
+        wrapper->ptr = 0;
+    }
+    else if (wrapper->pooled)
+    {
+        // Not constructed instance means constructor raised an error,
+        // memory still has to be returned.
+        if (obj && wrapper->constructed && usr_gc(L, obj))
+            obj = 0;
+        if (obj)
+        {
+            if (wrapper->constructed)
+                obj->~T();
+            usr_free(L, obj);
+        }
+        wrapper->ptr = 0;
+    }
+    else if (wrapper->use_gc)
     {
         if (!usr_gc(L, obj))
             delete obj;
@@ -309,112 +726,69 @@ template <typename T> int type<T>::gc(lua_State *L)
 }
 //------------------------------------------------------------------------------
 
+// upvalues: attrs
 template <typename T> int type<T>::index(lua_State *L)
 {
     // Initial stack: obj key
 
-    if (!lua_getmetatable(L, 1))         // obj key mt
+    // Attributes are flattened by build_dispatch(), so they already
+    // contain all superclasses attributes: members are stored as is,
+    // getters as {getter} and table members as {nil, member}.
+    lua_pushvalue(L, 2);                        // obj key key
+    lua_rawget(L, lua_upvalueindex(1));         // obj key attr
+    switch (lua_type(L, -1))
+    {
+    case LUA_TNIL:
+        lua_pop(L, 1);                          // obj key
         return usr_getter(L);
 
-    while (1)
-    {
-        // No metatable, return nil
-        if (lua_isnil(L, -1))
+    case LUA_TTABLE:
+        lua_rawgeti(L, -1, 1);                  // obj key box getter
+        if (!lua_isnil(L, -1))
         {
-            lua_pop(L, 1);              // obj key
-            return usr_getter(L);
+            lua_pushvalue(L, 1);                // obj key box getter obj
+            lua_call(L, 1, 1);                  // obj key box result
+            return 1;
         }
+        lua_rawgeti(L, -2, 2);                  // obj key box nil member
+        return 1;
 
-        lua_pushstring(L, "__getters"); // obj key mt '__getters'
-        lua_rawget(L, -2);              // obj key mt getters
-        if (lua_isnil(L, -1))
-            continue;
-        lua_pushvalue(L, 2);            // obj key mt getters key
-        lua_rawget(L, -2);              // obj key mt getters getters[key]
-
-        // If no getter is found in the current mt.
-        if (lua_isnil(L, -1))
-        {
-            lua_pop(L, 2);              // obj key mt
-            lua_pushvalue(L, 2);        // obj key mt key
-            lua_rawget(L, -2);          // obj key mt mt[key]
-
-            // No attr found in the current metatable.
-            if (lua_isnil(L, -1))
-            {
-                lua_pop(L, 1);              // obj key mt
-                if (!lua_getmetatable(L, -1))    // obj key mt mt_mt
-                    lua_pushnil(L);
-                lua_remove(L, -2);          // obj key mt_mt
-                continue;
-            }
-            break;
-        }
-        // If getter is found then call it.
-        else if (lua_type(L, -1) == LUA_TFUNCTION)
-        {
-            lua_pushvalue(L, 1);        // obj key mt getters func obj
-            lua_call(L, 1, 1);          // obj key mt getters result
-            break;
-        }
+    default:
+        return 1;
     }
-
-    return 1;
 }
 //------------------------------------------------------------------------------
 
+// upvalues: setters
 template <typename T> int type<T>::newindex(lua_State *L)
 {
     // Initial stack: obj key val
 
-    if (!lua_getmetatable(L, 1))         // obj key val mt
-        return usr_setter(L);
-
-    while (1)
+    check_writable(L, 1);
+    lua_pushvalue(L, 2);                        // obj key val key
+    lua_rawget(L, lua_upvalueindex(1));         // obj key val setter
+    if (!lua_isnil(L, -1))
     {
-        if (lua_isnil(L, -1))
-        {
-            lua_pop(L, 1);              // obj key val
-            return usr_setter(L);
-        }
-
-        lua_pushstring(L, "__setters"); // obj key val mt '__setters'
-        lua_rawget(L, -2);              // obj key val mt setters
-        if (lua_isnil(L, -1))
-            continue;
-        lua_pushvalue(L, 2);            // obj key val mt setters key
-        lua_rawget(L, -2);              // obj key val mt setters setters[key]
-
-        // If no setter is found in the current mt;
-        // Try super metatable.
-        if (lua_isnil(L, -1))
-        {
-            lua_pop(L, 2);              // obj key val mt
-            if (!lua_getmetatable(L, -1))    // obj key val mt mt_mt
-                lua_pushnil(L);
-            lua_remove(L, -2);          // obj key val mt_mt
-            continue;
-        }
-        // If setter is found then call it.
-        else if (lua_type(L, -1) == LUA_TFUNCTION)
-        {
-            lua_pushvalue(L, 1);        // obj key val mt setters func obj
-            lua_pushvalue(L, 3);        // obj key val mt setters func obj val
-            lua_call(L, 2, 0);          // obj key mt getters result
-            break;
-        }
+        lua_pushvalue(L, 1);                    // obj key val setter obj
+        lua_pushvalue(L, 3);                    // obj key val setter obj val
+        lua_call(L, 2, 0);                      // obj key val
+        return 0;
     }
+    lua_pop(L, 1);                              // obj key val
 
-    return 0;
+    return usr_setter(L);
 }
 //------------------------------------------------------------------------------
 
-template <typename T> void type<T>::register_attrs(lua_State *L,
-                                                   bool customIndex)
+// Own members for types without properties, instances look up
+// superclass attributes through the metatable chain.
+// stack: mt
+template <typename T> void type<T>::register_attrs(lua_State *L)
 {
     for (luaL_Reg *m = functions; m->name; ++m)
     {
         lua_pushcfunction(L, m->func);
+        LUAX_PROFILE_WRAP(L, usr_name(), "", m->name);
         lua_setfield(L, -2, m->name);
     }
 
@@ -422,52 +796,133 @@ template <typename T> void type<T>::register_attrs(lua_State *L,
     {
         lua_pushlightuserdata(L, static_cast<void*>(m));
         lua_pushcclosure(L, type<T>::on_method, 1);
+        LUAX_PROFILE_WRAP(L, usr_name(), "", m->name);
         lua_setfield(L, -2, m->name);
     }
+}
+//------------------------------------------------------------------------------
 
-    if (customIndex)
+// Build flattened dispatch tables for __index and __newindex:
+// attrs (getters and members, see index()) and setters contain attributes
+// of the type and all its superclasses, so each access costs single raw
+// lookup.
+//
+// Tables are filled from the compiled attributes list (see compile_attrs()),
+// only state specific members (metamethods and usr_instance_mt() additions,
+// see mt.__extras) are copied from the metatables. Order of filling:
+// superclass extras and attributes, own extras, own attributes; later
+// entries hide earlier ones.
+//
+// NOTE: attributes added to the metatable after registration are not visible
+// for the instances.
+//
+// stack: mt
+template <typename T> void type<T>::build_dispatch(lua_State *L)
+{
+    int mt = lua_gettop(L);
+    // Reserve: extras (metamethods, etc).
+    lua_createtable(L, 0, desc.flat_members + desc.flat_getters + 8); // mt attrs
+    lua_createtable(L, 0, desc.flat_setters);       // mt attrs setters
+    int attrs = mt + 1;
+    int setters = mt + 2;
+
+    for (int own = 0; own < 2; ++own)
     {
-        lua_newtable(L);        // mt getters
-        lua_newtable(L);        // mt getters setters
-
-        for (FuncProperty *m = func_properties; m->name; ++m)
+        // Extras: superclass ones first, then own ones which hide
+        // superclass attributes.
+        int extras = mt;
+        if (!own)
         {
-            if (m->getter > 0)
-            {
-                lua_pushcfunction(L, m->getter);
-                lua_setfield(L, -3, m->name);
-            }
-            if (m->setter)
+            if (!lua_getmetatable(L, mt))       // ... super
+                continue;
+            lua_pushliteral(L, "__extras");
+            lua_rawget(L, -2);                  // ... super extras
+            extras = lua_gettop(L);
+        }
+        if (lua_istable(L, extras))
+        {
+            lua_pushnil(L);
+            while (lua_next(L, extras))         // ... key val
             {
-                lua_pushcfunction(L, m->setter);
-                lua_setfield(L, -2, m->name);
+                if (!is_service_key(L, -2))
+                {
+                    lua_pushvalue(L, -2);       // ... key val key
+                    lua_insert(L, -2);          // ... key key val
+                    set_dispatch_member(L, attrs); // ... key
+                }
+                else
+                    lua_pop(L, 1);              // ... key
             }
-        } // for FuncProperty
+        }
+        lua_settop(L, setters);                 // mt attrs setters
 
-        for (MethodProperty<T> *m = method_properties; m->name; ++m)
+        const std::vector<Attr> &list = desc.attrs;
+        size_t last = own ? list.size() : desc.own_attrs;
+        for (size_t i = own ? desc.own_attrs : 0; i < last; ++i)
         {
-            if (m->getter)
+            const Attr &a = list[i];
+            lua_pushstring(L, a.name);          // ... name
+            if (a.data)
             {
-                lua_pushlightuserdata(L, static_cast<void*>(m));
-                lua_pushcclosure(L, on_getter, 1);
-                lua_setfield(L, -3, m->name);
+                lua_pushlightuserdata(L, a.data);
+                lua_pushcclosure(L, a.func, 1); // ... name func
             }
-            if (m->setter)
+            else
+                lua_pushcfunction(L, a.func);   // ... name func
+            LUAX_PROFILE_WRAP(L, a.type, a.kind == Attr::GETTER ? "get:"
+                              : (a.kind == Attr::SETTER ? "set:" : ""), a.name);
+
+            // Own members are also visible in the metatable.
+            // NOTE: use raw access since mt has superclass metatable.
+            if (own && a.kind == Attr::MEMBER)
             {
-                lua_pushlightuserdata(L, static_cast<void*>(m));
-                lua_pushcclosure(L, on_setter, 1);
-                lua_setfield(L, -2, m->name);
+                lua_pushvalue(L, -2);
+                lua_pushvalue(L, -2);
+                lua_rawset(L, mt);
             }
-        } // for ClassProperty
+            if (a.kind == Attr::GETTER)
+            {
+                lua_createtable(L, 1, 0);       // ... name func box
+                lua_insert(L, -2);              // ... name box func
+                lua_rawseti(L, -2, 1);          // ... name box
+                lua_rawset(L, attrs);           // mt attrs setters
+            }
+            else
+                lua_rawset(L, a.kind == Attr::SETTER ? setters : attrs);
+        }
+    }
 
-        lua_pushliteral(L, "__setters");    // mt getters setters key
-        lua_insert(L, -2);                  // mt getters key setters
-        lua_rawset(L, -4);                  // mt getters
+    // Keep __index and __newindex if they are set by usr_instance_mt().
+    lua_pushliteral(L, "__index");
+    lua_rawget(L, mt);
+    if (lua_isnil(L, -1))
+    {
+        lua_pushvalue(L, attrs);
+        lua_pushcclosure(L, index, 1);
+        lua_pushliteral(L, "__index");
+        lua_insert(L, -2);
+        lua_rawset(L, mt);
+    }
+    lua_pop(L, 1);
 
-        lua_pushliteral(L, "__getters");    // mt getters key
-        lua_insert(L, -2);                  // mt key getters
-        lua_rawset(L, -3);                  // mt
-    } // if (func_properties || method_properties)
+    lua_pushliteral(L, "__newindex");
+    lua_rawget(L, mt);
+    if (lua_isnil(L, -1))
+    {
+        lua_pushvalue(L, setters);
+        lua_pushcclosure(L, newindex, 1);
+        lua_pushliteral(L, "__newindex");
+        lua_insert(L, -2);
+        lua_rawset(L, mt);
+    }
+    lua_pop(L, 1);
+
+    lua_pushliteral(L, "__setters");
+    lua_insert(L, -2);
+    lua_rawset(L, mt);                          // mt attrs
+    lua_pushliteral(L, "__attrs");
+    lua_insert(L, -2);
+    lua_rawset(L, mt);                          // mt
 }
 //------------------------------------------------------------------------------
 
@@ -502,14 +957,175 @@ template <typename T> int type<T>::on_setter(lua_State * L)
     T *obj = type<T>::get(L, 1);
     if (!obj)
         return luaL_error(L, "Malformed %s instance", usr_name());
+    check_writable(L, 1);
     lua_remove(L, 1);
     return (obj->*(m->setter))(L);
 }
 //------------------------------------------------------------------------------
 
+// Call method of the object passed as light userdata,
+// used by invoke_all() to skip instance lookup and checks.
+// stack: obj args...
+template <typename T> int type<T>::on_invoke(lua_State * L)
+{
+    typedef Method<T> Meth;
+    Meth *m = static_cast<Meth*>(lua_touserdata(L, lua_upvalueindex(1)));
+    T *obj = static_cast<T*>(lua_touserdata(L, 1));
+    lua_remove(L, 1);
+    return (obj->*(m->method))(L);
+}
+//------------------------------------------------------------------------------
+
+template <typename T> Method<T>* type<T>::find_method(const char *name)
+{
+    for (Method<T> *m = methods; m->name; ++m)
+    {
+        if (strcmp(m->name, name) == 0)
+            return m;
+    }
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Call method for each object of the list, store first results in the out
+// table if out is not 0.
+// Method is resolved once; objects of the exact type are called with
+// on_invoke(), others (derived types, inherited and free function methods)
+// with the function found by the regular lookup.
+// stack: ... list name args...
+template <typename T> int type<T>::invoke_list(lua_State *L, int list, int out)
+{
+    luaL_checktype(L, list, LUA_TTABLE);
+    const char *name = luaL_checkstring(L, list + 1);
+    int args = list + 2;
+    int nargs = lua_gettop(L) - args + 1;
+    int nres = out ? 1 : 0;
+
+    Method<T> *m = find_method(name);
+    if (m)
+    {
+        lua_pushlightuserdata(L, static_cast<void*>(m));
+        lua_pushcclosure(L, on_invoke, 1);
+        LUAX_PROFILE_WRAP(L, usr_name(), "", m->name);
+    }
+    else
+        lua_pushnil(L);
+    int fast = lua_gettop(L);
+
+    int n = static_cast<int>(rawlen(L, list));
+    for (int i = 1; i <= n; ++i)
+    {
+        lua_rawgeti(L, list, i);                        // obj
+        T *obj = cast(L, -1);
+        if (!obj)
+        {
+            return luaL_error(L, "Invalid [%s] object at list index %d.",
+                              usr_name(), i);
+        }
+
+        Wrapper *wrapper = static_cast<Wrapper*>(lua_touserdata(L, -1));
+        if (m && wrapper->tag == &tag)
+        {
+            lua_pop(L, 1);                              // object is in the list
+            lua_pushvalue(L, fast);
+            lua_pushlightuserdata(L, static_cast<void*>(obj));
+        }
+        else
+        {
+            lua_getfield(L, -1, name);                  // obj func
+            if (lua_isnil(L, -1))
+            {
+                return luaL_error(L, "[%s] object at list index %d has no "
+                                  "method '%s'.", usr_name(), i, name);
+            }
+            lua_insert(L, -2);                          // func obj
+        }
+        for (int k = 0; k < nargs; ++k)
+            lua_pushvalue(L, args + k);
+        lua_call(L, nargs + 1, nres);
+        if (out)
+            lua_rawseti(L, out, i);
+    }
+
+    lua_settop(L, fast - 1);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Type.invoke_all(list, name, ...)
+// Call list[i]:name(...) for each object of the list.
+template <typename T> int type<T>::lua_invoke_all(lua_State *L)
+{
+    invoke_list(L, 1, 0);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Type.invoke_into(out, list, name, ...)
+// Same as invoke_all() but stores first result of each call in out[i],
+// returns out. If out is nil then new table of the list size is created.
+template <typename T> int type<T>::lua_invoke_into(lua_State *L)
+{
+    if (lua_isnil(L, 1))
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_createtable(L, static_cast<int>(rawlen(L, 2)), 0);
+        lua_replace(L, 1);
+    }
+    luaL_checktype(L, 1, LUA_TTABLE);
+    invoke_list(L, 2, 1);
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Call method (from methods[]) for each object of the [first, last) range
+ * with nargs arguments from the top of the stack; objects are not pushed
+ * to lua. Results are discarded, arguments are left on the stack.
+ * Returns number of called objects.
+ */
+template <typename T>
+template <typename It>
+int type<T>::invoke_all(lua_State *L, It first, It last, const char *name,
+                        int nargs)
+{
+    Method<T> *m = find_method(name);
+    if (!m)
+        return luaL_error(L, "[%s] has no method '%s'.", usr_name(), name);
+
+    int args = lua_gettop(L) - nargs + 1;
+    lua_pushlightuserdata(L, static_cast<void*>(m));
+    lua_pushcclosure(L, on_invoke, 1);                  // args func
+    LUAX_PROFILE_WRAP(L, usr_name(), "", m->name);
+    int func = lua_gettop(L);
+
+    int count = 0;
+    for (; first != last; ++first)
+    {
+        T *obj = element(*first);
+        if (!obj)
+            continue;
+        lua_pushvalue(L, func);
+        lua_pushlightuserdata(L, static_cast<void*>(obj));
+        for (int k = 0; k < nargs; ++k)
+            lua_pushvalue(L, args + k);
+        lua_call(L, nargs + 1, 0);
+        ++count;
+    }
+    lua_pop(L, 1);                                      // args
+    return count;
+}
+//------------------------------------------------------------------------------
+
 // stack: tbl mt
 template <typename T> void type<T>::register_type_attrs(lua_State *L)
 {
+    lua_pushcfunction(L, lua_invoke_all);
+    lua_setfield(L, -3, "invoke_all");
+    lua_pushcfunction(L, lua_invoke_into);
+    lua_setfield(L, -3, "invoke_into");
+
     for (luaL_Reg *m = type_functions; m->name; ++m)
     {
         lua_pushcfunction(L, m->func);
@@ -528,38 +1144,52 @@ template <typename T> void type<T>::register_in(lua_State *L)
 {
     // Instance specific.
 
-    // Already registered.
-    if (!luaL_newmetatable(L, usr_name()))  // stack: mt
-    {
-        lua_pop(L, 1);
-        return;
-    }
-
-    bool custom_index = false;
+    const TypeDesc &d = compile_desc();
 
-    // If super class is set then check it's metatable for properties.
-    // If it has props then we have to control __index and __newindex.
-    // This allows to correctly handle parent properties and function calls.
+    // If the type or its superclass has properties then we have to
+    // control __index and __newindex, see build_dispatch().
+    // Inheritance is compiled once per process (see compile_attrs()),
+    // so superclass must be registered first.
+    bool custom_index = d.properties;
+    const TypeTag *super_tag = 0;
     if (usr_super_name())
     {
         luaL_getmetatable(L, usr_super_name());
-        lua_pushstring(L, "__getters");
+        if (!lua_istable(L, -1))
+        {
+            luaL_error(L, "Superclass %s of %s is not registered",
+                       usr_super_name(), usr_name());
+        }
+
+        lua_pushliteral(L, "__attrs");
+        lua_rawget(L, -2);
+        custom_index = custom_index || !lua_isnil(L, -1);
+        lua_pop(L, 1);
+
+        lua_pushliteral(L, "__tag");
         lua_rawget(L, -2);
-        custom_index = !lua_isnil(L, -1);
+        super_tag = static_cast<const TypeTag*>(lua_touserdata(L, -1));
         lua_pop(L, 2);
     }
-    else
-        custom_index = func_properties[0].name || method_properties[0].name;
 
+    // Tag may raise an error (too deep inheritance), so build it before
+    // the metatable is stored in the registry.
+    init_tag(L, super_tag);
+    compile_attrs(super_tag);
 
-    if (custom_index)
+    // Already registered.
+    // Reserve: __name, __tag, __index, __newindex, __gc and service keys.
+    if (!new_metatable(L, usr_name(), d.members + 8))  // stack: mt
     {
-        lua_pushcfunction(L, index);
-        lua_setfield(L, -2, "__index");
-        lua_pushcfunction(L, newindex);
-        lua_setfield(L, -2, "__newindex");
+        lua_pop(L, 1);
+        return;
     }
-    else
+
+    lua_pushliteral(L, "__tag");            // stack: mt key
+    lua_pushlightuserdata(L, &tag);         // stack: mt key tag
+    lua_rawset(L, -3);                      // mt.__tag = tag, stack: mt
+
+    if (!custom_index)
     {
         // Lookup missing object attrs in the metatable by default.
         lua_pushvalue(L, -1);                   // stack: mt mt
@@ -567,8 +1197,13 @@ template <typename T> void type<T>::register_in(lua_State *L)
     }
 
     lua_pushcfunction(L, gc);
+    LUAX_PROFILE_WRAP(L, usr_name(), "", "__gc");
     lua_setfield(L, -2, "__gc");
 
+    // Create identity cache upfront.
+    push_cache(L);
+    lua_pop(L, 1);
+
     int top = lua_gettop(L);
 
     // stack: mt.
@@ -577,7 +1212,25 @@ template <typename T> void type<T>::register_in(lua_State *L)
     // Cleanup stack from usr_instance_mt() garbage if present.
     lua_settop(L, top);
 
-    register_attrs(L, custom_index);
+    // State specific members (metamethods and usr_instance_mt() additions)
+    // with superclass ones, inherited by derived types via build_dispatch().
+    lua_createtable(L, 0, 8);                   // mt extras
+    if (usr_super_name())
+    {
+        luaL_getmetatable(L, usr_super_name()); // mt extras super
+        lua_pushliteral(L, "__extras");
+        lua_rawget(L, -2);                      // mt extras super super_extras
+        if (lua_istable(L, -1))
+            copy_attrs(L, -1, -3);
+        lua_pop(L, 2);                          // mt extras
+    }
+    copy_attrs(L, -2, -1);
+    lua_pushliteral(L, "__extras");
+    lua_insert(L, -2);
+    lua_rawset(L, -3);                          // mt.__extras = extras, mt
+
+    if (!custom_index)
+        register_attrs(L);
 
     if (usr_super_name())
     {
@@ -586,6 +1239,9 @@ template <typename T> void type<T>::register_in(lua_State *L)
         lua_setmetatable(L, -2);
     }
 
+    if (custom_index)
+        build_dispatch(L);
+
     // Cleanup stack.
     lua_settop(L, top - 1);
 
@@ -593,13 +1249,14 @@ template <typename T> void type<T>::register_in(lua_State *L)
 
     top = lua_gettop(L);
 
-    lua_newtable(L);                // tbl
-    lua_newtable(L);                // tbl mt
+    lua_createtable(L, 0, d.type_attrs + 2);    // tbl
+    lua_createtable(L, 0, 1);       // tbl mt
     lua_pushvalue(L, -1);           // tbl mt mt(copy)
     lua_setmetatable(L, -3);        // tbl.__mt = mt, stack: tbl mt
 
     lua_pushstring(L, "__call");    // tbl mt '__call'
     lua_pushcfunction(L, create);   // tbl mt '__call' func
+    LUAX_PROFILE_WRAP(L, usr_name(), "", "__call");
     lua_rawset(L, -3);              // tbl mt.__call = func, stack: tbl mt
 
     lua_pushvalue(L, -2);           // tbl mt tbl(copy)
@@ -616,12 +1273,40 @@ template <typename T> void type<T>::register_in(lua_State *L)
 }
 //------------------------------------------------------------------------------
 
-// NOTE: why we use lua_pushfstring() as a key to associate instance with
-// the userdata. We might use something like:
+// Push identity cache of the type: weak valued table which maps instance
+// pointer (lightuserdata) to the userdata.
+// Cache is created on first use and stored in the registry with
+// &cache_key as a key, it's also available as LUAX_UDATA[usr_name()].
+template <typename T> void type<T>::push_cache(lua_State *L)
+{
+    rawgetp(L, LUA_REGISTRYINDEX, &cache_key);  // cache
+    if (!lua_isnil(L, -1))
+        return;
+    lua_pop(L, 1);
+
+    lua_newtable(L);                            // cache
+    push_weak_values_mt(L);                     // cache mt
+    lua_setmetatable(L, -2);                    // cache.__mt = mt, cache
+
+    lua_pushvalue(L, -1);                       // cache cache
+    rawsetp(L, LUA_REGISTRYINDEX, &cache_key);  // registry[key] = cache, cache
+
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_UDATA); // cache udata
+    if (lua_istable(L, -1))
+    {
+        lua_pushvalue(L, -2);                   // cache udata cache
+        lua_setfield(L, -2, usr_name());        // udata[name] = cache
+    }
+    lua_pop(L, 1);                              // cache
+}
+//------------------------------------------------------------------------------
+
+// NOTE: why we use per type caches. We might use single table
+// with pointers as keys:
 //
 //  lua_getfield(L, LUA_REGISTRYINDEX, LUAX_UDATA);     // udata
-//  lua_pushnumber(L, reinterpret_cast<LUA_INTEGER>(obj)); // udata ptr
-//  lua_gettable(L, -2);                                // udata udata[ptr]
+//  lua_pushlightuserdata(L, obj);                      // udata ptr
+//  lua_rawget(L, -2);                                  // udata udata[ptr]
 //
 // But if obj is struct or class:
 //
@@ -629,6 +1314,7 @@ template <typename T> void type<T>::register_in(lua_State *L)
 //
 // then address of the obj and obj->attr may be the same; as a result if we do
 // push(obj); push(obj->attr); second call will extract userdata for obj.
+// With per type cache obj and obj->attr are stored in different tables.
 template <typename T> int type<T>::push(lua_State *L, T *obj, bool useGc)
 {
     if (!obj)
@@ -637,36 +1323,220 @@ template <typename T> int type<T>::push(lua_State *L, T *obj, bool useGc)
         return 1;
     }
 
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_UDATA);     // udata
-    lua_pushfstring(L, "%s_%p", usr_name(), obj);       // udata name
-    lua_gettable(L, -2);                                // udata udata[name]
+    push_cache(L);                                      // cache
+    push_cached(L, lua_gettop(L), 0, obj, useGc);       // cache ud
+    lua_remove(L, -2);                                  // ud
 
-    // If no object is associated then we create full userdata
-    // and attach type metatable. Also we associate val with full userdata.
-    if (lua_isnil(L, -1))
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Push userdata associated with obj in the identity cache at the given
+// index. If no userdata is associated then we create full userdata,
+// attach type metatable (at index mt or from the registry if mt is 0) and
+// associate obj with the userdata.
+template <typename T> void type<T>::push_cached(lua_State *L, int cache,
+                                                int mt, T *obj, bool useGc)
+{
+    rawgetp(L, cache, obj);                             // cache[obj]
+    if (!lua_isnil(L, -1))
+        return;
+
+    // Remove nil from the stack.
+    lua_pop(L, 1);
+
+    // Create userdata, stack: ud
+    Wrapper *wrapper =
+        static_cast<Wrapper*>(lua_newuserdata(L, sizeof(Wrapper)));
+    wrapper->ptr = static_cast<void*>(obj);
+    wrapper->tag = &tag;
+    wrapper->magic = LUAX_MAGIC;
+    wrapper->use_gc = useGc;
+    wrapper->inplace = false;
+    wrapper->pooled = false;
+    wrapper->constructed = true;
+    wrapper->shared = false;
+
+    // Set type metatable to the userdata.
+    if (mt)
+        lua_pushvalue(L, mt);                           // ud mt
+    else
+        luaL_getmetatable(L, usr_name());               // ud mt
+    lua_setmetatable(L, -2);                            // ud
+
+    // Link userdata to the pointer for later use. This allows to reuse
+    // the same userdata if obj pushed multiple times.
+    // NOTE: use the same useGc for the multiple pushes.
+    lua_pushvalue(L, -1);                               // ud ud
+    rawsetp(L, cache, obj);                             // cache[obj] = ud, ud
+}
+//------------------------------------------------------------------------------
+
+// Push array of objects: first and last are forward iterators over T* or
+// T values. Table is preallocated, identity cache and metatable are fetched
+// once. Values are owned by the container, so useGc applies to pointers
+// only. Null pointers are skipped and the table is compacted, so it's
+// always a sequence (#t and ipairs() see all the pushed objects).
+template <typename T> template <typename It>
+int type<T>::push_range(lua_State *L, It first, It last, bool useGc)
+{
+    typedef typename std::iterator_traits<It>::value_type Elem;
+    static_assert(std::is_base_of<std::forward_iterator_tag,
+                  typename std::iterator_traits<It>::iterator_category>::value,
+                  "push_range() requires forward iterators");
+    useGc = useGc && std::is_pointer<Elem>::value;
+
+    typename std::iterator_traits<It>::difference_type n =
+        std::distance(first, last);
+    if (n > INT_MAX)
+        luaL_error(L, "Too many %s instances to push", usr_name());
+    lua_createtable(L, static_cast<int>(n), 0);         // tbl
+    int tbl = lua_gettop(L);
+    push_cache(L);                                      // tbl cache
+    luaL_getmetatable(L, usr_name());                   // tbl cache mt
+
+    int i = 0;
+    for (; first != last; ++first)
     {
-        // Remove nil from the stack.
-        lua_pop(L, 1);
+        T *obj = element(*first);
+        if (!obj)
+            continue;
+        push_cached(L, tbl + 1, tbl + 2, obj, useGc);   // tbl cache mt ud
+        lua_rawseti(L, tbl, ++i);                       // tbl cache mt
+    }
+    lua_pop(L, 2);                                      // tbl
+    return 1;
+}
+//------------------------------------------------------------------------------
 
-        // Create userdata, stack: udata ud
-        Wrapper *wrapper =
-            static_cast<Wrapper*>(lua_newuserdata(L, sizeof(Wrapper)));
-        wrapper->ptr = static_cast<void*>(obj);
-        wrapper->use_gc = useGc;
+// Create userdata with a room for the T instance after the wrapper,
+// see inplace_storage().
+template <typename T> Wrapper* type<T>::new_inplace(lua_State *L, size_t extra)
+{
+    // Lua aligns userdata block at least as a pointer, so extra space is
+    // required only for overaligned types.
+    const size_t pad = alignof(T) > alignof(Wrapper) ? alignof(T) - 1 : 0;
+    Wrapper *wrapper = static_cast<Wrapper*>(
+        lua_newuserdata(L, sizeof(Wrapper) + pad + sizeof(T) + extra));
+    wrapper->ptr = 0;
+    wrapper->tag = &tag;
+    wrapper->magic = LUAX_MAGIC;
+    wrapper->use_gc = true;
+    wrapper->inplace = true;
+    wrapper->pooled = false;
+    wrapper->constructed = true;
+    wrapper->shared = false;
+    return wrapper;
+}
+//------------------------------------------------------------------------------
 
-        // Set type metatable to the userdata.
-        luaL_getmetatable(L,  usr_name());              // udata ud mt
-        lua_setmetatable(L, -2);                        // udata ud
+// Return first address after the wrapper aligned for T.
+template <typename T> void* type<T>::inplace_storage(Wrapper *wrapper)
+{
+    uintptr_t mem = reinterpret_cast<uintptr_t>(wrapper + 1);
+    uintptr_t align = alignof(T);
+    return reinterpret_cast<void*>((mem + align - 1) & ~(align - 1));
+}
+//------------------------------------------------------------------------------
+
+// Set metatable to the inplace userdata and put it to the identity cache,
+// so pushing obj later returns the same userdata.
+// stack: ud
+template <typename T> void type<T>::bind_inplace(lua_State *L,
+                                                 Wrapper *wrapper, T *obj)
+{
+    wrapper->ptr = static_cast<void*>(obj);
+
+    luaL_getmetatable(L, usr_name());           // ud mt
+    lua_setmetatable(L, -2);                    // ud
+
+    cache_instance(L, obj);
+}
+//------------------------------------------------------------------------------
+
+// Put userdata to the identity cache.
+// stack: ud
+template <typename T> void type<T>::cache_instance(lua_State *L, T *obj)
+{
+    push_cache(L);                              // ud cache
+    lua_pushvalue(L, -2);                       // ud cache ud
+    rawsetp(L, -2, obj);                        // cache[obj] = ud, ud cache
+    lua_pop(L, 1);                              // ud
+}
+//------------------------------------------------------------------------------
+
+// Push copy of the val constructed inside the userdata.
+// The copy is destructed on GC. Extra bytes are reserved right after
+// the instance (aligned as T), e.g. for variable size data.
+template <typename T> int type<T>::push_value(lua_State *L, const T &val,
+                                              size_t extra)
+{
+    Wrapper *wrapper = new_inplace(L, extra);   // ud
+    T *obj = new (inplace_storage(wrapper)) T(val);
+    bind_inplace(L, wrapper, obj);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Push instance owned by the shared pointer. Copy of the pointer is stored
+// in the userdata block and released on GC, so the same instance may be
+// pushed to many states (and threads), each state holds one reference.
+// Atomic counter is touched only here and in gc(), get() and method calls
+// use the raw pointer.
+//
+// The instance is read-only: property setters, __newindex and non-const
+// LUAX_BIND() methods and data members raise an error. Methods bound with
+// methods[] and LUAX_METHOD() take non-const self and are not checked,
+// they must not modify a shared instance.
+template <typename T> int type<T>::push_shared(lua_State *L,
+                                        const std::shared_ptr<const T> &obj)
+{
+    typedef std::shared_ptr<const T> Ptr;
+    static_assert(alignof(Ptr) <= alignof(Wrapper)
+                  && sizeof(Wrapper) % alignof(Ptr) == 0,
+                  "shared_ptr must fit after the wrapper");
 
-        // Link userdata to name for later use. This allows to reuse the same
-        // userdata if obj pushed multiple times.
-        // NOTE: use the same useGc for the multiple pushes.
-        lua_pushfstring(L, "%s_%p", usr_name(), obj);   // udata ud name
-        lua_pushvalue(L, -2);                           // udata ud name ud
-        lua_settable(L, -4); // udata[name] = ud,          udata ud
+    if (!obj)
+    {
+        lua_pushnil(L);
+        return 1;
     }
-    lua_remove(L, -2);                                  // ud
 
+    T *ptr = const_cast<T*>(obj.get());
+    push_cache(L);                              // cache
+    rawgetp(L, -1, ptr);                        // cache ud
+    if (!lua_isnil(L, -1))
+    {
+        // Instance pushed without the reference (e.g. by push() or decoded
+        // from a channel message) is replaced in the cache by the owning
+        // userdata, the old one stays valid while it's referenced.
+        Wrapper *cached = static_cast<Wrapper*>(lua_touserdata(L, -1));
+        if (cached->shared)
+        {
+            lua_remove(L, -2);                  // ud
+            return 1;
+        }
+    }
+    lua_pop(L, 1);                              // cache
+
+    Wrapper *wrapper = static_cast<Wrapper*>(
+        lua_newuserdata(L, sizeof(Wrapper) + sizeof(Ptr)));  // cache ud
+    new (wrapper + 1) Ptr(obj);
+    wrapper->ptr = static_cast<void*>(ptr);
+    wrapper->tag = &tag;
+    wrapper->magic = LUAX_MAGIC;
+    wrapper->use_gc = false;
+    wrapper->inplace = false;
+    wrapper->pooled = false;
+    wrapper->constructed = true;
+    wrapper->shared = true;
+
+    luaL_getmetatable(L, usr_name());           // cache ud mt
+    lua_setmetatable(L, -2);                    // cache ud
+
+    lua_pushvalue(L, -1);                       // cache ud ud
+    rawsetp(L, -3, ptr);                        // cache[ptr] = ud, cache ud
+    lua_remove(L, -2);                          // ud
     return 1;
 }
 //------------------------------------------------------------------------------
@@ -689,6 +1559,183 @@ template <typename T> T* type<T>::check_get(lua_State *L, int index)
 }
 //------------------------------------------------------------------------------
 
+// Fill the tag ancestry from the superclass tag.
+// Tags are shared between lua states, so it's done only once.
+template <typename T> void type<T>::init_tag(lua_State *L,
+                                             const TypeTag *super)
+{
+    int depth = super ? super->depth + 1 : 0;
+    if (depth >= LUAX_MAX_DEPTH)
+        luaL_error(L, "Inheritance of %s is too deep", usr_name());
+
+    std::call_once(tag.once, [&]() {
+        for (int i = 0; i < depth; ++i)
+            tag.ancestors[i] = super->ancestors[i];
+        tag.ancestors[depth] = &tag;
+        tag.depth = depth;
+        tag.push = &push_untyped;
+        tag.desc = &desc;
+    });
+}
+//------------------------------------------------------------------------------
+
+// Push by the type tag, e.g. for pointers decoded from luax_channel.h
+// messages. The state doesn't own the instance.
+// Returns 0 and pushes nothing if the type is not registered in the state.
+template <typename T> int type<T>::push_untyped(lua_State *L, void *obj)
+{
+    luaL_getmetatable(L, usr_name());
+    bool registered = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (!registered)
+        return 0;
+    return push(L, static_cast<T*>(obj), false);
+}
+//------------------------------------------------------------------------------
+
+// Count attributes of the static arrays, once per process.
+template <typename T> const TypeDesc& type<T>::compile_desc()
+{
+    std::call_once(desc.once, []() {
+        int n = 0;
+        for (luaL_Reg *m = functions; m->name; ++m)
+            ++n;
+        for (Method<T> *m = methods; m->name; ++m)
+            ++n;
+        desc.members = n;
+        desc.properties = func_properties[0].name || method_properties[0].name;
+
+        n = 2;                  // invoke_all, invoke_into
+        for (luaL_Reg *m = type_functions; m->name; ++m)
+            ++n;
+        for (Enum *m = type_enums; m->name; ++m)
+            ++n;
+        desc.type_attrs = n;
+    });
+    return desc;
+}
+//------------------------------------------------------------------------------
+
+// Return true if the attribute is hidden by the one from the list:
+// member and getter hide each other, setter hides setter.
+static inline bool is_overridden(const Attr &a, const std::vector<Attr> &list)
+{
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        if ((a.kind == Attr::SETTER) == (list[i].kind == Attr::SETTER)
+            && !strcmp(a.name, list[i].name))
+            return true;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------
+
+// Flatten attributes of the type and its superclasses, once per process.
+// Superclass list is already compiled since it's registered first.
+template <typename T> void type<T>::compile_attrs(const TypeTag *super)
+{
+    std::call_once(desc.attrs_once, [super]() {
+        std::vector<Attr> own;
+        for (luaL_Reg *m = functions; m->name; ++m)
+        {
+            Attr a = {m->name, Attr::MEMBER, m->func, 0, usr_name()};
+            own.push_back(a);
+        }
+        for (Method<T> *m = methods; m->name; ++m)
+        {
+            Attr a = {m->name, Attr::MEMBER, on_method, m, usr_name()};
+            own.push_back(a);
+        }
+        for (FuncProperty *m = func_properties; m->name; ++m)
+        {
+            Attr a = {m->name, Attr::GETTER, m->getter, 0, usr_name()};
+            if (m->getter)
+                own.push_back(a);
+            a.kind = Attr::SETTER;
+            a.func = m->setter;
+            if (m->setter)
+                own.push_back(a);
+        }
+        for (MethodProperty<T> *m = method_properties; m->name; ++m)
+        {
+            Attr a = {m->name, Attr::GETTER, on_getter, m, usr_name()};
+            if (m->getter)
+                own.push_back(a);
+            a.kind = Attr::SETTER;
+            a.func = on_setter;
+            if (m->setter)
+                own.push_back(a);
+        }
+
+        std::vector<Attr> &attrs = desc.attrs;
+        if (super && super->desc)
+        {
+            const std::vector<Attr> &base = super->desc->attrs;
+            for (size_t i = 0; i < base.size(); ++i)
+            {
+                if (!is_overridden(base[i], own))
+                    attrs.push_back(base[i]);
+            }
+        }
+        desc.own_attrs = attrs.size();
+        attrs.insert(attrs.end(), own.begin(), own.end());
+
+        int counts[3] = {0, 0, 0};
+        for (size_t i = 0; i < attrs.size(); ++i)
+            ++counts[attrs[i].kind];
+        desc.flat_members = counts[Attr::MEMBER];
+        desc.flat_getters = counts[Attr::GETTER];
+        desc.flat_setters = counts[Attr::SETTER];
+    });
+}
+//------------------------------------------------------------------------------
+
+// Same as check_get() but uses type tag instead of the metatable lookup,
+// also accepts instances of the derived types.
+template <typename T> T* type<T>::cast(lua_State *L, int index)
+{
+    Wrapper *wrapper = static_cast<Wrapper*>(lua_touserdata(L, index));
+    if (!wrapper || rawlen(L, index) < sizeof(Wrapper)
+        || wrapper->magic != LUAX_MAGIC)
+        return 0;
+    if (wrapper->tag != &tag && !wrapper->tag->is_a(&tag))
+        return 0;
+    return static_cast<T*>(wrapper->ptr);
+}
+//------------------------------------------------------------------------------
+
+template <typename T> T* type<T>::check_cast(lua_State *L, int index)
+{
+    T *ptr = cast(L, index);
+    if (!ptr)
+        luaL_error(L, "Invalid [%s] object at index %d.", usr_name(), index);
+    return ptr;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Compile time method trampoline, see LUAX_METHOD() and LUAX_METHOD_SELF().
+ *
+ * If removeSelf is true then self is removed from the stack before the call
+ * and arguments start at index 1, otherwise self stays at index 1.
+ */
+template <typename F, F f, bool removeSelf> struct trampoline;
+
+template <typename T, int (T::*f)(lua_State*), bool removeSelf>
+struct trampoline<int (T::*)(lua_State*), f, removeSelf>
+{
+    static int call(lua_State *L)
+    {
+        T *obj = type<T>::get(L, 1);
+        if (!obj)
+            return luaL_error(L, "Invalid method call - self is not passed");
+        if (removeSelf)
+            lua_remove(L, 1);
+        return (obj->*f)(L);
+    }
+};
+//------------------------------------------------------------------------------
+
 } // namespace luax
 
 #endif // LUAX_H
@@ -0,0 +1,1225 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_ARRAY_H
+#define LUAX_ARRAY_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <type_traits>
+
+#include "luax.h"
+
+// Typed numeric arrays: Float32Array, Float64Array, Int32Array, Int64Array
+// and Uint8Array. Array wraps C++ memory (push_array()) or owns elements
+// stored inside the userdata (new_array(), or Float32Array(n) on lua side).
+// Bulk methods (sum, dot, add, ...) run in C++, with SSE2 for float types
+// and for sum/add (plus min/max/clamp of Int32Array) of integer types on x86
+// unless LUAX_NO_SIMD is defined.
+
+#if !defined(LUAX_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LUAX_ARRAY_SSE2
+#include <emmintrin.h>
+#endif
+
+#define LUAX_ARRAY_TYPE(E, name)                                            \
+    namespace luax {                                                        \
+        template <> inline const char* type<Array<E> >::usr_name()          \
+        {                                                                   \
+            return name;                                                    \
+        }                                                                   \
+        template <> inline void type<Array<E> >::usr_instance_mt(lua_State *L) \
+        {                                                                   \
+            array_mt<E>(L);                                                 \
+        }                                                                   \
+        template <> inline void type<Array<E> >::usr_type_mt(lua_State *L)  \
+        {                                                                   \
+            array_type_mt<E>(L);                                            \
+        }                                                                   \
+    }
+
+namespace luax
+{
+
+/** Non owning view of the contiguous elements. */
+template <typename E>
+class Array
+{
+public:
+    Array(E *data, size_t size): m_data(data), m_size(size) {}
+
+    E* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    E *m_data;
+    size_t m_size;
+};
+//------------------------------------------------------------------------------
+
+namespace simd
+{
+
+// Accumulator type of sum and dot. Integers are accumulated in unsigned
+// math (work) and wrap around instead of overflowing the signed result.
+template <typename E>
+struct acc
+{
+    typedef typename std::conditional<std::is_floating_point<E>::value,
+                                      E, int64_t>::type type;
+    typedef typename std::conditional<std::is_floating_point<E>::value,
+                                      E, uint64_t>::type work;
+};
+//------------------------------------------------------------------------------
+
+// Element arithmetic. Integers wrap around (computed in unsigned math, so
+// there is no signed overflow), double results are saturated to the
+// integer range (NaN gives 0).
+template <typename E, bool = std::is_integral<E>::value>
+struct arith
+{
+    static E add(E a, E b) { return a + b; }
+    static E sub(E a, E b) { return a - b; }
+    static E mul(E a, E b) { return a * b; }
+    static E from(double v) { return E(v); }
+};
+
+template <typename E>
+struct arith<E, true>
+{
+    typedef typename std::make_unsigned<E>::type U;
+    typedef std::numeric_limits<E> limits;
+
+    static E add(E a, E b) { return E(U(U(a) + U(b))); }
+    static E sub(E a, E b) { return E(U(U(a) - U(b))); }
+    static E mul(E a, E b) { return E(U(U(a) * U(b))); }
+
+    static E from(double v)
+    {
+        if (!(v == v))
+            return E(0);
+        if (v <= static_cast<double>(limits::min()))
+            return limits::min();
+        if (v >= static_cast<double>(limits::max()))
+            return limits::max();
+        return E(v);
+    }
+};
+//------------------------------------------------------------------------------
+
+// Portable kernels. Reductions use independent accumulators to break
+// dependency chains, element wise loops are left to the compiler
+// vectorizer.
+template <typename E>
+struct scalar_kernels
+{
+    typedef typename acc<E>::type A;
+    typedef typename acc<E>::work W;
+
+    static A sum(const E *a, size_t n)
+    {
+        W s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            s0 += W(a[i]);
+            s1 += W(a[i + 1]);
+            s2 += W(a[i + 2]);
+            s3 += W(a[i + 3]);
+        }
+        for (; i < n; ++i)
+            s0 += W(a[i]);
+        return A((s0 + s1) + (s2 + s3));
+    }
+
+    static A dot(const E *a, const E *b, size_t n)
+    {
+        W s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            s0 += W(a[i]) * W(b[i]);
+            s1 += W(a[i + 1]) * W(b[i + 1]);
+            s2 += W(a[i + 2]) * W(b[i + 2]);
+            s3 += W(a[i + 3]) * W(b[i + 3]);
+        }
+        for (; i < n; ++i)
+            s0 += W(a[i]) * W(b[i]);
+        return A((s0 + s1) + (s2 + s3));
+    }
+
+    // n must be > 0.
+    static E min(const E *a, size_t n)
+    {
+        E r = a[0];
+        for (size_t i = 1; i < n; ++i)
+            r = a[i] < r ? a[i] : r;
+        return r;
+    }
+
+    static E max(const E *a, size_t n)
+    {
+        E r = a[0];
+        for (size_t i = 1; i < n; ++i)
+            r = a[i] > r ? a[i] : r;
+        return r;
+    }
+
+    static void add(E *a, const E *b, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            a[i] = arith<E>::add(a[i], b[i]);
+    }
+
+    static void add(E *a, E v, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            a[i] = arith<E>::add(a[i], v);
+    }
+
+    static void scale(E *a, double s, size_t n)
+    {
+        if (std::is_floating_point<E>::value)
+        {
+            E k = E(s);
+            for (size_t i = 0; i < n; ++i)
+                a[i] *= k;
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i)
+                a[i] = arith<E>::from(a[i] * s);
+        }
+    }
+
+    static void clamp(E *a, E lo, E hi, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            a[i] = a[i] < lo ? lo : (a[i] > hi ? hi : a[i]);
+    }
+};
+//------------------------------------------------------------------------------
+
+#ifdef LUAX_ARRAY_SSE2
+
+struct sse_f32
+{
+    typedef float E;
+    typedef __m128 V;
+    enum { N = 4 };
+
+    static V load(const E *p) { return _mm_loadu_ps(p); }
+    static void store(E *p, V v) { _mm_storeu_ps(p, v); }
+    static V set1(E v) { return _mm_set1_ps(v); }
+    static V zero() { return _mm_setzero_ps(); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    static V max(V a, V b) { return _mm_max_ps(a, b); }
+};
+//------------------------------------------------------------------------------
+
+struct sse_f64
+{
+    typedef double E;
+    typedef __m128d V;
+    enum { N = 2 };
+
+    static V load(const E *p) { return _mm_loadu_pd(p); }
+    static void store(E *p, V v) { _mm_storeu_pd(p, v); }
+    static V set1(E v) { return _mm_set1_pd(v); }
+    static V zero() { return _mm_setzero_pd(); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V min(V a, V b) { return _mm_min_pd(a, b); }
+    static V max(V a, V b) { return _mm_max_pd(a, b); }
+};
+//------------------------------------------------------------------------------
+
+// Integer vectors, arithmetic wraps around as in arith<E>.
+struct sse_i32
+{
+    typedef int32_t E;
+    typedef __m128i V;
+    enum { N = 4 };
+
+    static V load(const E *p) { return _mm_loadu_si128(reinterpret_cast<const V*>(p)); }
+    static void store(E *p, V v) { _mm_storeu_si128(reinterpret_cast<V*>(p), v); }
+    static V set1(E v) { return _mm_set1_epi32(v); }
+    static V add(V a, V b) { return _mm_add_epi32(a, b); }
+
+    // SSE2 has no epi32 min/max, use compare and select.
+    static V min(V a, V b) { return select(_mm_cmplt_epi32(a, b), a, b); }
+    static V max(V a, V b) { return select(_mm_cmpgt_epi32(a, b), a, b); }
+
+    // Add sign extended elements to the two 64 bit lanes of s.
+    static V add_wide(V s, V v)
+    {
+        V sign = _mm_srai_epi32(v, 31);
+        s = _mm_add_epi64(s, _mm_unpacklo_epi32(v, sign));
+        return _mm_add_epi64(s, _mm_unpackhi_epi32(v, sign));
+    }
+
+private:
+    static V select(V mask, V a, V b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+};
+//------------------------------------------------------------------------------
+
+struct sse_i64
+{
+    typedef int64_t E;
+    typedef __m128i V;
+    enum { N = 2 };
+
+    static V load(const E *p) { return _mm_loadu_si128(reinterpret_cast<const V*>(p)); }
+    static void store(E *p, V v) { _mm_storeu_si128(reinterpret_cast<V*>(p), v); }
+    static V set1(E v) { return _mm_set_epi32(int(v >> 32), int(v), int(v >> 32), int(v)); }
+    static V add(V a, V b) { return _mm_add_epi64(a, b); }
+    static V add_wide(V s, V v) { return _mm_add_epi64(s, v); }
+};
+//------------------------------------------------------------------------------
+
+// Kernels for the vector type S, tails are processed by scalar code.
+template <typename S>
+struct simd_kernels
+{
+    typedef typename S::E E;
+    typedef typename S::V V;
+    enum { N = S::N };
+
+    static E sum(const E *a, size_t n)
+    {
+        V s0 = S::zero(), s1 = S::zero();
+        size_t i = 0;
+        for (; i + 2 * N <= n; i += 2 * N)
+        {
+            s0 = S::add(s0, S::load(a + i));
+            s1 = S::add(s1, S::load(a + i + N));
+        }
+        E r = reduce_add(S::add(s0, s1));
+        for (; i < n; ++i)
+            r += a[i];
+        return r;
+    }
+
+    static E dot(const E *a, const E *b, size_t n)
+    {
+        V s0 = S::zero(), s1 = S::zero();
+        size_t i = 0;
+        for (; i + 2 * N <= n; i += 2 * N)
+        {
+            s0 = S::add(s0, S::mul(S::load(a + i), S::load(b + i)));
+            s1 = S::add(s1, S::mul(S::load(a + i + N), S::load(b + i + N)));
+        }
+        E r = reduce_add(S::add(s0, s1));
+        for (; i < n; ++i)
+            r += a[i] * b[i];
+        return r;
+    }
+
+    static E min(const E *a, size_t n)
+    {
+        if (n < N)
+            return scalar_kernels<E>::min(a, n);
+        V m = S::load(a);
+        size_t i = N;
+        for (; i + N <= n; i += N)
+            m = S::min(m, S::load(a + i));
+        E t[N];
+        S::store(t, m);
+        E r = scalar_kernels<E>::min(t, N);
+        for (; i < n; ++i)
+            r = a[i] < r ? a[i] : r;
+        return r;
+    }
+
+    static E max(const E *a, size_t n)
+    {
+        if (n < N)
+            return scalar_kernels<E>::max(a, n);
+        V m = S::load(a);
+        size_t i = N;
+        for (; i + N <= n; i += N)
+            m = S::max(m, S::load(a + i));
+        E t[N];
+        S::store(t, m);
+        E r = scalar_kernels<E>::max(t, N);
+        for (; i < n; ++i)
+            r = a[i] > r ? a[i] : r;
+        return r;
+    }
+
+    static void add(E *a, const E *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::add(S::load(a + i), S::load(b + i)));
+        for (; i < n; ++i)
+            a[i] += b[i];
+    }
+
+    static void add(E *a, E v, size_t n)
+    {
+        V k = S::set1(v);
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::add(S::load(a + i), k));
+        for (; i < n; ++i)
+            a[i] += v;
+    }
+
+    static void scale(E *a, double s, size_t n)
+    {
+        V k = S::set1(E(s));
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::mul(S::load(a + i), k));
+        for (; i < n; ++i)
+            a[i] *= E(s);
+    }
+
+    static void clamp(E *a, E lo, E hi, size_t n)
+    {
+        V vlo = S::set1(lo), vhi = S::set1(hi);
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::max(S::min(S::load(a + i), vhi), vlo));
+        scalar_kernels<E>::clamp(a + i, lo, hi, n - i);
+    }
+
+private:
+    static E reduce_add(V v)
+    {
+        E t[N];
+        S::store(t, v);
+        E r = 0;
+        for (int k = 0; k < N; ++k)
+            r += t[k];
+        return r;
+    }
+};
+//------------------------------------------------------------------------------
+
+// Sum and add for the integer vector type S, the rest is scalar. Results
+// are the same as of scalar_kernels: sum wraps around in 64 bits.
+template <typename S>
+struct simd_int_kernels: scalar_kernels<typename S::E>
+{
+    typedef typename S::E E;
+    typedef typename S::V V;
+    typedef typename acc<E>::type A;
+    typedef typename acc<E>::work W;
+    enum { N = S::N };
+
+    static A sum(const E *a, size_t n)
+    {
+        V s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 2 * N <= n; i += 2 * N)
+        {
+            s0 = S::add_wide(s0, S::load(a + i));
+            s1 = S::add_wide(s1, S::load(a + i + N));
+        }
+        W t[2];
+        _mm_storeu_si128(reinterpret_cast<V*>(t), _mm_add_epi64(s0, s1));
+        W r = t[0] + t[1];
+        for (; i < n; ++i)
+            r += W(a[i]);
+        return A(r);
+    }
+
+    static void add(E *a, const E *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::add(S::load(a + i), S::load(b + i)));
+        scalar_kernels<E>::add(a + i, b + i, n - i);
+    }
+
+    static void add(E *a, E v, size_t n)
+    {
+        V k = S::set1(v);
+        size_t i = 0;
+        for (; i + N <= n; i += N)
+            S::store(a + i, S::add(S::load(a + i), k));
+        scalar_kernels<E>::add(a + i, v, n - i);
+    }
+};
+//------------------------------------------------------------------------------
+
+#endif // LUAX_ARRAY_SSE2
+
+/** Bulk kernels used by the array methods. */
+template <typename E>
+struct kernels: scalar_kernels<E> {};
+
+#ifdef LUAX_ARRAY_SSE2
+template <> struct kernels<float>: simd_kernels<sse_f32> {};
+template <> struct kernels<double>: simd_kernels<sse_f64> {};
+template <> struct kernels<int64_t>: simd_int_kernels<sse_i64> {};
+
+template <> struct kernels<int32_t>: simd_int_kernels<sse_i32>
+{
+    typedef simd_kernels<sse_i32> K;
+
+    static int32_t min(const int32_t *a, size_t n) { return K::min(a, n); }
+    static int32_t max(const int32_t *a, size_t n) { return K::max(a, n); }
+    static void clamp(int32_t *a, int32_t lo, int32_t hi, size_t n)
+    {
+        K::clamp(a, lo, hi, n);
+    }
+};
+#endif
+//------------------------------------------------------------------------------
+
+} // namespace simd
+
+
+// Element conversion: integer types use lua integers, other - numbers.
+template <typename V>
+inline typename std::enable_if<std::is_integral<V>::value>::type
+array_push(lua_State *L, V v)
+{
+    lua_pushinteger(L, static_cast<lua_Integer>(v));
+}
+
+template <typename V>
+inline typename std::enable_if<std::is_floating_point<V>::value>::type
+array_push(lua_State *L, V v)
+{
+    lua_pushnumber(L, static_cast<lua_Number>(v));
+}
+
+template <typename E>
+inline typename std::enable_if<std::is_integral<E>::value, E>::type
+array_check(lua_State *L, int index)
+{
+    return static_cast<E>(luaL_checkinteger(L, index));
+}
+
+template <typename E>
+inline typename std::enable_if<std::is_floating_point<E>::value, E>::type
+array_check(lua_State *L, int index)
+{
+    return static_cast<E>(luaL_checknumber(L, index));
+}
+//------------------------------------------------------------------------------
+
+// Registry key of the table which keeps parents of the slices alive.
+inline void* array_refs_key()
+{
+    static char key;
+    return &key;
+}
+//------------------------------------------------------------------------------
+
+/** Push array view of the C++ memory, the memory must outlive the array. */
+template <typename E>
+inline int push_array(lua_State *L, E *data, size_t size)
+{
+    return type<Array<E> >::push_value(L, Array<E>(data, size));
+}
+//------------------------------------------------------------------------------
+
+/** Max size of the array which stores elements inside the userdata. */
+template <typename E>
+inline size_t array_max_size()
+{
+    // Wrapper, alignment pad and Array instance precede the elements.
+    return (SIZE_MAX - sizeof(Wrapper) - alignof(Array<E>) - sizeof(Array<E>))
+        / sizeof(E);
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Push zero filled array which stores elements inside the userdata.
+ * Raises error if the size is above array_max_size().
+ */
+template <typename E>
+inline E* new_array(lua_State *L, size_t size)
+{
+    if (size > array_max_size<E>())
+        luaL_error(L, "%s size is too large", type<Array<E> >::usr_name());
+    type<Array<E> >::push_value(L, Array<E>(0, size), size * sizeof(E));
+    Array<E> *a = type<Array<E> >::get(L, -1);
+    // Storage of the instance is aligned as Array, elements follow it.
+    E *data = reinterpret_cast<E*>(a + 1);
+    memset(data, 0, size * sizeof(E));
+    *a = Array<E>(data, size);
+    return data;
+}
+//------------------------------------------------------------------------------
+
+// Return element at the lua index or null if index is out of range.
+template <typename E>
+inline E* array_at(lua_State *L, Array<E> *a, int index)
+{
+    if (lua_type(L, index) != LUA_TNUMBER)
+        return 0;
+    lua_Number n = lua_tonumber(L, index);
+    if (n < 1 || n > static_cast<lua_Number>(a->size()))
+        return 0;
+    size_t i = static_cast<size_t>(n) - 1;
+    if (static_cast<lua_Number>(i + 1) != n)
+        return 0;
+    return a->data() + i;
+}
+//------------------------------------------------------------------------------
+
+// Array of the type M and the same size as self.
+template <typename M, typename E>
+inline Array<M>* array_check_sized(lua_State *L, Array<E> *self, int index)
+{
+    Array<M> *other = type<Array<M> >::check_cast(L, index);
+    if (other->size() != self->size())
+    {
+        luaL_error(L, "%s size mismatch: %d and %d", type<Array<M> >::usr_name(),
+                   static_cast<int>(self->size()), static_cast<int>(other->size()));
+    }
+    return other;
+}
+//------------------------------------------------------------------------------
+
+// Array argument of the same type and size as self.
+template <typename E>
+inline Array<E>* array_check_other(lua_State *L, Array<E> *self, int index)
+{
+    return array_check_sized<E>(L, self, index);
+}
+//------------------------------------------------------------------------------
+
+// stack: array key
+template <typename E>
+inline int array_index(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    if (E *v = array_at(L, a, 2))
+    {
+        array_push(L, *v);
+        return 1;
+    }
+
+    // Methods.
+    if (lua_type(L, 2) == LUA_TSTRING)
+    {
+        lua_getmetatable(L, 1);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return 1;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// stack: array key value
+template <typename E>
+inline int array_newindex(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    E *v = array_at(L, a, 2);
+    if (!v)
+        return luaL_error(L, "%s index is out of range", type<Array<E> >::usr_name());
+    *v = array_check<E>(L, 3);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_len(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(a->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Push the keep table (weak keys), see array_keep().
+// stack: -> refs
+inline void push_array_refs(lua_State *L)
+{
+    rawgetp(L, LUA_REGISTRYINDEX, array_refs_key());    // refs
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        rawsetp(L, LUA_REGISTRYINDEX, array_refs_key());
+    }
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Keep value at the owner index alive while the array at the view index
+ * is alive, e.g. for views of the memory owned by other userdata.
+ */
+inline void array_keep(lua_State *L, int view, int owner)
+{
+    if (view < 0 && view > LUA_REGISTRYINDEX)
+        view = lua_gettop(L) + view + 1;
+    if (owner < 0 && owner > LUA_REGISTRYINDEX)
+        owner = lua_gettop(L) + owner + 1;
+
+    push_array_refs(L);                                 // refs
+    lua_pushvalue(L, view);
+    lua_pushvalue(L, owner);
+    lua_rawset(L, -3);                                  // refs[view] = owner
+    lua_pop(L, 1);
+}
+//------------------------------------------------------------------------------
+
+// a:slice(i [, j]) - view of elements i..j (inclusive), j defaults to #a.
+// The view keeps a alive.
+template <typename E>
+inline int array_slice(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    lua_Integer j = luaL_optinteger(L, 3, static_cast<lua_Integer>(a->size()));
+    if (i < 1 || j > static_cast<lua_Integer>(a->size()) || j < i - 1)
+        return luaL_error(L, "%s slice is out of range", type<Array<E> >::usr_name());
+
+    push_array(L, a->data() + (i - 1), static_cast<size_t>(j - i + 1));
+    array_keep(L, -1, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:copy() - new array which owns copy of the elements.
+template <typename E>
+inline int array_copy(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    E *data = new_array<E>(L, a->size());
+    if (a->size())
+        memcpy(data, a->data(), a->size() * sizeof(E));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_fill(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    E v = array_check<E>(L, 2);
+    for (size_t i = 0; i < a->size(); ++i)
+        a->data()[i] = v;
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:add(b) or a:add(number), in place.
+template <typename E>
+inline int array_add(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    if (lua_type(L, 2) == LUA_TNUMBER)
+        simd::kernels<E>::add(a->data(), array_check<E>(L, 2), a->size());
+    else
+        simd::kernels<E>::add(a->data(), array_check_other(L, a, 2)->data(), a->size());
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_scale(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    simd::kernels<E>::scale(a->data(), luaL_checknumber(L, 2), a->size());
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_clamp(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    E lo = array_check<E>(L, 2);
+    E hi = array_check<E>(L, 3);
+    simd::kernels<E>::clamp(a->data(), lo, hi, a->size());
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_dot(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    Array<E> *b = array_check_other(L, a, 2);
+    array_push(L, simd::kernels<E>::dot(a->data(), b->data(), a->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_sum(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    array_push(L, simd::kernels<E>::sum(a->data(), a->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Return nil for empty array.
+template <typename E>
+inline int array_min(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    if (!a->size())
+        return 0;
+    array_push(L, simd::kernels<E>::min(a->data(), a->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_max(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    if (!a->size())
+        return 0;
+    array_push(L, simd::kernels<E>::max(a->data(), a->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename E>
+inline int array_totable(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    if (a->size() > INT_MAX)
+        return luaL_error(L, "%s is too large for table", type<Array<E> >::usr_name());
+    lua_createtable(L, static_cast<int>(a->size()), 0);
+    for (size_t i = 0; i < a->size(); ++i)
+    {
+        array_push(L, a->data()[i]);
+        lua_rawseti(L, -2, static_cast<int>(i + 1));
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Apply d[i] = f(d[i], x[i]) where x at the index is number or array.
+template <typename E, typename F>
+inline void array_apply(lua_State *L, Array<E> *a, int index, F f)
+{
+    E *d = a->data();
+    size_t n = a->size();
+    if (lua_type(L, index) == LUA_TNUMBER)
+    {
+        E v = array_check<E>(L, index);
+        for (size_t i = 0; i < n; ++i)
+            d[i] = f(d[i], v);
+    }
+    else
+    {
+        const E *x = array_check_other(L, a, index)->data();
+        for (size_t i = 0; i < n; ++i)
+            d[i] = f(d[i], x[i]);
+    }
+}
+//------------------------------------------------------------------------------
+
+// Integer division by zero gives zero, min / -1 wraps around.
+template <typename E>
+inline E array_div(E a, E b, std::true_type /*integral*/)
+{
+    if (b == 0)
+        return E(0);
+    if (std::is_signed<E>::value && b == E(-1))
+        return simd::arith<E>::sub(E(0), a);
+    return E(a / b);
+}
+
+template <typename E>
+inline E array_div(E a, E b, std::false_type)
+{
+    return a / b;
+}
+//------------------------------------------------------------------------------
+
+// a:map(op, x) - a[i] = a[i] op x[i] in place, x is number or array,
+// op is one of 'add', 'sub', 'mul', 'div', 'min', 'max', 'set'.
+template <typename E>
+inline int array_map(lua_State *L)
+{
+    static const char *const ops[] = {"add", "sub", "mul", "div", "min", "max",
+                                      "set", 0};
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    switch (luaL_checkoption(L, 2, 0, ops))
+    {
+    case 0: array_apply(L, a, 3, simd::arith<E>::add); break;
+    case 1: array_apply(L, a, 3, simd::arith<E>::sub); break;
+    case 2: array_apply(L, a, 3, simd::arith<E>::mul); break;
+    case 3:
+        array_apply(L, a, 3, [](E v, E x)
+        {
+            return array_div(v, x, std::is_integral<E>());
+        });
+        break;
+    case 4: array_apply(L, a, 3, [](E v, E x) { return x < v ? x : v; }); break;
+    case 5: array_apply(L, a, 3, [](E v, E x) { return x > v ? x : v; }); break;
+    default: array_apply(L, a, 3, [](E, E x) { return x; }); break;
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:axpy(k, x) - a[i] = a[i] + k * x[i] in place.
+template <typename E>
+inline int array_axpy(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    lua_Number k = luaL_checknumber(L, 2);
+    const E *x = array_check_other(L, a, 3)->data();
+    E *d = a->data();
+    if (std::is_floating_point<E>::value)
+    {
+        E ke = E(k);
+        for (size_t i = 0; i < a->size(); ++i)
+            d[i] += ke * x[i];
+    }
+    else
+    {
+        for (size_t i = 0; i < a->size(); ++i)
+            d[i] = simd::arith<E>::from(d[i] + k * x[i]);
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Number at the index as the element value, returns false if it can't be
+// represented exactly (e.g. 2.5 or 2^40 for Int32Array).
+template <typename E>
+inline bool array_exact(lua_State *L, int index, E &v)
+{
+    if (std::is_floating_point<E>::value)
+    {
+        v = static_cast<E>(lua_tonumber(L, index));
+        return true;
+    }
+#if LUA_VERSION_NUM >= 503
+    if (lua_isinteger(L, index))
+    {
+        lua_Integer i = lua_tointeger(L, index);
+        v = static_cast<E>(i);
+        return static_cast<lua_Integer>(v) == i;
+    }
+#endif
+    typedef std::numeric_limits<E> limits;
+    lua_Number n = lua_tonumber(L, index);
+    // NOTE: max + 1 is exact power of 2, unlike max of 64 bit types.
+    if (!(n >= static_cast<lua_Number>(limits::min())
+          && n < static_cast<lua_Number>(limits::max()) + 1))
+        return false;
+    v = static_cast<E>(n);
+    return static_cast<lua_Number>(v) == n;
+}
+//------------------------------------------------------------------------------
+
+template <typename X, typename Y>
+inline bool array_compare(int op, X x, Y y)
+{
+    switch (op)
+    {
+    case 0: return x < y;
+    case 1: return x <= y;
+    case 2: return x > y;
+    case 3: return x >= y;
+    case 4: return x == y;
+    default: return x != y;
+    }
+}
+//------------------------------------------------------------------------------
+
+// a:cmp(op, x) - Uint8Array mask with 1 where a[i] op x[i] is true,
+// x is number or array, op is one of '<', '<=', '>', '>=', '==', '~='.
+// Integer elements are compared with not representable numbers (e.g. 2.5)
+// as lua numbers.
+template <typename E>
+inline int array_cmp(lua_State *L)
+{
+    static const char *const ops[] = {"<", "<=", ">", ">=", "==", "~=", 0};
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    int op = luaL_checkoption(L, 2, 0, ops);
+    bool scalar = lua_type(L, 3) == LUA_TNUMBER;
+    E v = E(0);
+    bool exact = scalar && array_exact(L, 3, v);
+    lua_Number vn = scalar ? lua_tonumber(L, 3) : 0;
+    const E *x = scalar ? 0 : array_check_other(L, a, 3)->data();
+
+    size_t n = a->size();
+    const E *d = a->data();
+    uint8_t *mask = new_array<uint8_t>(L, n);
+    if (!scalar)
+    {
+        for (size_t i = 0; i < n; ++i)
+            mask[i] = array_compare(op, d[i], x[i]);
+    }
+    else if (exact)
+    {
+        for (size_t i = 0; i < n; ++i)
+            mask[i] = array_compare(op, d[i], v);
+    }
+    else
+    {
+        for (size_t i = 0; i < n; ++i)
+            mask[i] = array_compare(op, static_cast<lua_Number>(d[i]), vn);
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:where(mask, x) - a[i] = x[i] where mask[i] is not zero, in place.
+template <typename E>
+inline int array_where(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    const uint8_t *mask = array_check_sized<uint8_t>(L, a, 2)->data();
+    bool scalar = lua_type(L, 3) == LUA_TNUMBER;
+    E v = scalar ? array_check<E>(L, 3) : E(0);
+    const E *x = scalar ? 0 : array_check_other(L, a, 3)->data();
+
+    E *d = a->data();
+    for (size_t i = 0; i < a->size(); ++i)
+    {
+        if (mask[i])
+            d[i] = scalar ? v : x[i];
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:filter(mask) - new array with elements where mask[i] is not zero.
+template <typename E>
+inline int array_filter(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    const uint8_t *mask = array_check_sized<uint8_t>(L, a, 2)->data();
+    size_t count = 0;
+    for (size_t i = 0; i < a->size(); ++i)
+        count += mask[i] != 0;
+
+    E *res = new_array<E>(L, count);
+    const E *d = a->data();
+    for (size_t i = 0; i < a->size(); ++i)
+    {
+        if (mask[i])
+            *res++ = d[i];
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:indices() - Int32Array of 1-based indices of non zero elements.
+template <typename E>
+inline int array_indices(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    const E *d = a->data();
+    size_t count = 0;
+    for (size_t i = 0; i < a->size(); ++i)
+        count += d[i] != 0;
+
+    int32_t *res = new_array<int32_t>(L, count);
+    for (size_t i = 0; i < a->size(); ++i)
+    {
+        if (d[i] != 0)
+            *res++ = static_cast<int32_t>(i + 1);
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Check 1-based indices of the Int32Array at the index.
+template <typename E>
+inline Array<int32_t>* array_check_indices(lua_State *L, Array<E> *a, int index)
+{
+    Array<int32_t> *idx = type<Array<int32_t> >::check_cast(L, index);
+    for (size_t i = 0; i < idx->size(); ++i)
+    {
+        int32_t k = idx->data()[i];
+        if (k < 1 || static_cast<size_t>(k) > a->size())
+            luaL_error(L, "%s index %d is out of range", type<Array<E> >::usr_name(), k);
+    }
+    return idx;
+}
+//------------------------------------------------------------------------------
+
+// a:gather(idx) - new array with a[idx[i]].
+template <typename E>
+inline int array_gather(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    Array<int32_t> *idx = array_check_indices(L, a, 2);
+    E *res = new_array<E>(L, idx->size());
+    for (size_t i = 0; i < idx->size(); ++i)
+        res[i] = a->data()[idx->data()[i] - 1];
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// a:scatter(idx, x) - a[idx[i]] = x[i] in place, x is number or array
+// of #idx elements.
+template <typename E>
+inline int array_scatter(lua_State *L)
+{
+    Array<E> *a = type<Array<E> >::check_cast(L, 1);
+    Array<int32_t> *idx = array_check_indices(L, a, 2);
+    E *d = a->data();
+    if (lua_type(L, 3) == LUA_TNUMBER)
+    {
+        E v = array_check<E>(L, 3);
+        for (size_t i = 0; i < idx->size(); ++i)
+            d[idx->data()[i] - 1] = v;
+    }
+    else
+    {
+        const E *x = array_check_sized<E>(L, idx, 3)->data();
+        for (size_t i = 0; i < idx->size(); ++i)
+            d[idx->data()[i] - 1] = x[i];
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Float32Array(n) or Float32Array{1, 2, 3}.
+// stack: type_table arg
+template <typename E>
+inline int array_new(lua_State *L)
+{
+    if (lua_istable(L, 2))
+    {
+        size_t size = rawlen(L, 2);
+        E *data = new_array<E>(L, size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            lua_rawgeti(L, 2, static_cast<int>(i + 1));
+            data[i] = array_check<E>(L, -1);
+            lua_pop(L, 1);
+        }
+        return 1;
+    }
+
+    lua_Integer size = luaL_optinteger(L, 2, 0);
+    if (size < 0)
+        return luaL_error(L, "%s size is negative", type<Array<E> >::usr_name());
+    if (static_cast<uint64_t>(size) > array_max_size<E>())
+        return luaL_error(L, "%s size is too large", type<Array<E> >::usr_name());
+    new_array<E>(L, static_cast<size_t>(size));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Setup array instance metatable.
+// stack: mt
+template <typename E>
+inline void array_mt(lua_State *L)
+{
+    static const luaL_Reg funcs[] = {
+        {"__index", array_index<E>},
+        {"__newindex", array_newindex<E>},
+        {"__len", array_len<E>},
+        {"slice", array_slice<E>},
+        {"copy", array_copy<E>},
+        {"fill", array_fill<E>},
+        {"add", array_add<E>},
+        {"scale", array_scale<E>},
+        {"clamp", array_clamp<E>},
+        {"dot", array_dot<E>},
+        {"sum", array_sum<E>},
+        {"min", array_min<E>},
+        {"max", array_max<E>},
+        {"totable", array_totable<E>},
+        {"map", array_map<E>},
+        {"axpy", array_axpy<E>},
+        {"cmp", array_cmp<E>},
+        {"where", array_where<E>},
+        {"filter", array_filter<E>},
+        {"indices", array_indices<E>},
+        {"gather", array_gather<E>},
+        {"scatter", array_scatter<E>},
+        {0, 0}
+    };
+    for (const luaL_Reg *f = funcs; f->name; ++f)
+    {
+        lua_pushcfunction(L, f->func);
+        lua_setfield(L, -2, f->name);
+    }
+}
+//------------------------------------------------------------------------------
+
+// Replace constructor of the type.
+// stack: tbl mt
+template <typename E>
+inline void array_type_mt(lua_State *L)
+{
+    lua_pushcfunction(L, array_new<E>);
+    lua_setfield(L, -2, "__call");
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+LUAX_ARRAY_TYPE(float, "Float32Array")
+LUAX_ARRAY_TYPE(double, "Float64Array")
+LUAX_ARRAY_TYPE(int32_t, "Int32Array")
+LUAX_ARRAY_TYPE(int64_t, "Int64Array")
+LUAX_ARRAY_TYPE(uint8_t, "Uint8Array")
+
+namespace luax
+{
+
+/** Register all array types. */
+inline void register_arrays(lua_State *L)
+{
+    type<Array<float> >::register_in(L);
+    type<Array<double> >::register_in(L);
+    type<Array<int32_t> >::register_in(L);
+    type<Array<int64_t> >::register_in(L);
+    type<Array<uint8_t> >::register_in(L);
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_ARRAY_H
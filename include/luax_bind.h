@@ -0,0 +1,400 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_BIND_H
+#define LUAX_BIND_H
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "luax.h"
+#include "luax_struct.h"
+#include "luax_utils.h"
+
+// Helper macro to bind typed free function, method or data member as
+// lua_CFunction. Can be used in LUAX_FUNCTION() and LUAX_PROPERTY():
+//
+//  LUAX_FUNCTIONS_BEGIN(Point)
+//      LUAX_FUNCTION("move", LUAX_BIND(&Point::move))
+//  LUAX_FUNCTIONS_END
+//
+//  LUAX_PROPERTIES_BEGIN(Point)
+//      LUAX_PROPERTY("x", LUAX_BIND(&Point::x), LUAX_BIND(&Point::x))
+//  LUAX_PROPERTIES_END
+#define LUAX_BIND(f) (&luax::bind<decltype(f), f>::call)
+
+namespace luax
+{
+
+/**
+ * Stack conversion used by the bind layer.
+ *
+ * check() raises lua error if the argument is invalid, it's called for all
+ * the arguments before any get(), so get() must not raise errors (values
+ * like std::string built by get() would leak on longjmp).
+ *
+ * Default implementation uses luax::checkget() and luax::push().
+ * Specialize it to support custom types, check() is optional.
+ */
+template <typename T, typename Enable = void>
+struct marshal
+{
+    static void check(lua_State *L, int index)
+    {
+        checkget<T>(L, index);
+    }
+
+    static T get(lua_State *L, int index)
+    {
+        return luax::get<T>(L, index);
+    }
+
+    static void push(lua_State *L, const T &v)
+    {
+        luax::push(L, v);
+    }
+};
+//------------------------------------------------------------------------------
+
+template <>
+struct marshal<std::string>
+{
+    static void check(lua_State *L, int index)
+    {
+        luaL_checkstring(L, index);
+    }
+
+    static std::string get(lua_State *L, int index)
+    {
+        size_t len;
+        const char *str = lua_tolstring(L, index, &len);
+        return std::string(str, len);
+    }
+
+    static void push(lua_State *L, const std::string &v)
+    {
+        luax::push(L, v);
+    }
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Integers use lua integer conversion: no float round trip, and on lua 5.3+
+ * arguments without integer representation are rejected.
+ */
+template <typename T>
+struct marshal<T, typename std::enable_if<std::is_integral<T>::value
+                                          && !std::is_same<T, bool>::value>::type>
+{
+    static void check(lua_State *L, int index)
+    {
+        luaL_checkinteger(L, index);
+    }
+
+    static T get(lua_State *L, int index)
+    {
+        return static_cast<T>(lua_tointeger(L, index));
+    }
+
+    static void push(lua_State *L, T v)
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(v));
+    }
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Other classes (LUAX_STRUCT() types, std::vector, std::map, types with
+ * luax::get()/push() specializations): converted with luax_struct.h.
+ */
+template <typename T>
+struct marshal<T, typename std::enable_if<std::is_class<T>::value
+                                          && !is_bound<T>::value>::type>
+{
+    static void check(lua_State *L, int index)
+    {
+        if (struct_table<T>::value)
+            luaL_checktype(L, index, LUA_TTABLE);
+    }
+
+    static T get(lua_State *L, int index)
+    {
+        T v;
+        struct_value<T>::get(L, index, v);
+        return v;
+    }
+
+    static void push(lua_State *L, const T &v)
+    {
+        struct_value<T>::push(L, v);
+    }
+};
+//------------------------------------------------------------------------------
+
+/** Bound class value: reference to the instance, copy on push. */
+template <typename T>
+struct marshal<T, typename std::enable_if<is_bound<T>::value>::type>
+{
+    static void check(lua_State *L, int index)
+    {
+        type<T>::check_cast(L, index);
+    }
+
+    static T& get(lua_State *L, int index)
+    {
+        return *type<T>::cast(L, index);
+    }
+
+    static void push(lua_State *L, const T &v)
+    {
+        type<T>::push_value(L, v);
+    }
+};
+//------------------------------------------------------------------------------
+
+/** Bound class pointer: pushed without GC. */
+template <typename T>
+struct marshal<T*, typename std::enable_if<is_bound<T>::value>::type>
+{
+    typedef typename std::remove_cv<T>::type U;
+
+    static void check(lua_State *L, int index)
+    {
+        type<U>::check_cast(L, index);
+    }
+
+    static T* get(lua_State *L, int index)
+    {
+        return type<U>::cast(L, index);
+    }
+
+    static void push(lua_State *L, T *v)
+    {
+        type<U>::push(L, const_cast<U*>(v), false);
+    }
+};
+//------------------------------------------------------------------------------
+
+
+// Compile time indices for arguments unpacking.
+template <int... I> struct indices {};
+template <int N, int... I> struct make_indices: make_indices<N - 1, N - 1, I...> {};
+template <int... I> struct make_indices<0, I...> { typedef indices<I...> type; };
+
+// Call marshal<T>::check() if it's defined.
+template <typename T>
+inline auto marshal_check(lua_State *L, int index, int)
+    -> decltype(marshal<T>::check(L, index), void())
+{
+    marshal<T>::check(L, index);
+}
+
+template <typename T>
+inline void marshal_check(lua_State*, int, long) {}
+
+// Validate all the arguments starting at index first.
+template <typename... Args, int... I>
+inline void check_args(lua_State *L, int first, indices<I...>)
+{
+    int order[] = {0, (marshal_check<typename std::decay<Args>::type>(
+        L, first + I, 0), 0)...};
+    (void)order;
+    (void)L;
+    (void)first;
+}
+
+// Return value of the bound function.
+// References to bound classes are pushed without GC, values are copied.
+template <typename R, typename Enable = void>
+struct result
+{
+    static int push(lua_State *L, const R &r)
+    {
+        marshal<typename std::decay<R>::type>::push(L, r);
+        return 1;
+    }
+};
+
+template <typename R>
+struct result<R&, typename std::enable_if<is_bound<R>::value>::type>
+{
+    static int push(lua_State *L, R &r)
+    {
+        marshal<R*>::push(L, &r);
+        return 1;
+    }
+};
+
+// Calls function and pushes its result.
+template <typename R>
+struct invoke
+{
+    template <typename F, typename... A>
+    static int call(lua_State *L, F f, A&&... args)
+    {
+        return result<R>::push(L, f(std::forward<A>(args)...));
+    }
+
+    template <typename T, typename F, typename... A>
+    static int call_method(lua_State *L, T *obj, F f, A&&... args)
+    {
+        return result<R>::push(L, (obj->*f)(std::forward<A>(args)...));
+    }
+};
+
+template <>
+struct invoke<void>
+{
+    template <typename F, typename... A>
+    static int call(lua_State*, F f, A&&... args)
+    {
+        f(std::forward<A>(args)...);
+        return 0;
+    }
+
+    template <typename T, typename F, typename... A>
+    static int call_method(lua_State*, T *obj, F f, A&&... args)
+    {
+        (obj->*f)(std::forward<A>(args)...);
+        return 0;
+    }
+};
+
+// Return self for the bound method.
+template <typename T>
+inline T* bind_self(lua_State *L)
+{
+    T *obj = type<T>::cast(L, 1);
+    if (!obj)
+        luaL_error(L, "Invalid method call - self is not passed");
+    return obj;
+}
+
+// Return self for the method that modifies the instance,
+// shared instances are read-only.
+template <typename T>
+inline T* bind_mutable_self(lua_State *L)
+{
+    T *obj = bind_self<T>(L);
+    check_writable(L, 1);
+    return obj;
+}
+//------------------------------------------------------------------------------
+
+
+/**
+ * Typed function binding, generates lua_CFunction which converts arguments
+ * and return value with luax::marshal.
+ *
+ * Supported:
+ *
+ * - Free functions R (*)(Args...), arguments start at index 1.
+ * - Methods R (T::*)(Args...) [const], self is at index 1,
+ *   arguments start at index 2.
+ *   Non-const methods can't be called on shared instances
+ *   (see type::push_shared()).
+ * - Data members V T::*, getter if called with self only and setter
+ *   if called with (self, value) - so it can be used for both getter
+ *   and setter of a property.
+ *
+ * Use LUAX_BIND() macro to get the function.
+ */
+template <typename F, F f> struct bind;
+
+template <typename R, typename... Args, R (*f)(Args...)>
+struct bind<R (*)(Args...), f>
+{
+    static int call(lua_State *L)
+    {
+        return call(L, typename make_indices<sizeof...(Args)>::type());
+    }
+
+    template <int... I>
+    static int call(lua_State *L, indices<I...> idx)
+    {
+        check_args<Args...>(L, 1, idx);
+        return invoke<R>::call(L, f,
+            marshal<typename std::decay<Args>::type>::get(L, I + 1)...);
+    }
+};
+//------------------------------------------------------------------------------
+
+template <typename R, typename T, typename... Args, R (T::*f)(Args...)>
+struct bind<R (T::*)(Args...), f>
+{
+    static int call(lua_State *L)
+    {
+        return call(L, typename make_indices<sizeof...(Args)>::type());
+    }
+
+    template <int... I>
+    static int call(lua_State *L, indices<I...> idx)
+    {
+        T *obj = bind_mutable_self<T>(L);
+        check_args<Args...>(L, 2, idx);
+        return invoke<R>::call_method(L, obj, f,
+            marshal<typename std::decay<Args>::type>::get(L, I + 2)...);
+    }
+};
+//------------------------------------------------------------------------------
+
+template <typename R, typename T, typename... Args, R (T::*f)(Args...) const>
+struct bind<R (T::*)(Args...) const, f>
+{
+    static int call(lua_State *L)
+    {
+        return call(L, typename make_indices<sizeof...(Args)>::type());
+    }
+
+    template <int... I>
+    static int call(lua_State *L, indices<I...> idx)
+    {
+        const T *obj = bind_self<T>(L);
+        check_args<Args...>(L, 2, idx);
+        return invoke<R>::call_method(L, obj, f,
+            marshal<typename std::decay<Args>::type>::get(L, I + 2)...);
+    }
+};
+//------------------------------------------------------------------------------
+
+template <typename V, typename T, V T::*m>
+struct bind<V T::*, m>
+{
+    static int call(lua_State *L)
+    {
+        T *obj = bind_self<T>(L);
+        if (lua_gettop(L) > 1)
+        {
+            check_writable(L, 1);
+            marshal_check<V>(L, 2, 0);
+            obj->*m = marshal<V>::get(L, 2);
+            return 0;
+        }
+        return result<V&>::push(L, obj->*m);
+    }
+};
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_BIND_H
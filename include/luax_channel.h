@@ -0,0 +1,639 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_CHANNEL_H
+#define LUAX_CHANNEL_H
+
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "luax.h"
+
+// Max nesting of the encoded tables, also stops on cyclic tables.
+#ifndef LUAX_CHANNEL_MAX_DEPTH
+#define LUAX_CHANNEL_MAX_DEPTH 32
+#endif
+
+// Passing lua values between states.
+//
+// Values are encoded right from the stack to a compact binary message:
+//
+//  std::string msg;
+//  luax::encode(L, 1, 3, msg);             // values at 1..3
+//  int n = luax::decode(L2, msg.data(), msg.size());
+//
+// Supported values: nil, booleans, numbers, strings, light userdata,
+// tables of them (metatables are not copied) and luax objects.
+// Objects are not copied: message stores the pointer and the type tag,
+// decoding pushes the pointer with type<T>::push() without GC. Type must be
+// registered in the receiving state, otherwise decoding fails.
+//
+// Ownership rule: only objects pushed without GC (type<T>::push(L, obj,
+// false)) may be sent, C++ side keeps them alive while any state uses them.
+// Objects owned by the sender state are rejected: pushed with GC, created
+// by lua side constructors, constructed in the userdata block or pool
+// memory and pushed with push_shared(), since the sender GC would destroy
+// them (or drop the reference) under the receiver.
+//
+// Messages contain raw pointers and are meant for the same process only.
+
+namespace luax
+{
+
+// Value tags of the message.
+enum
+{
+    CODEC_NIL,
+    CODEC_FALSE,
+    CODEC_TRUE,
+    CODEC_INT,          // Zigzag varint.
+    CODEC_NUM,          // lua_Number bytes.
+    CODEC_STR,          // Varint length, bytes.
+    CODEC_TABLE,        // Varint array size, uint32 hash size, items.
+    CODEC_LIGHT,        // Pointer.
+    CODEC_OBJECT        // TypeTag pointer, instance pointer.
+};
+
+struct codec_writer
+{
+    lua_State *L;
+    std::string &buf;
+    const char *error;
+
+    void byte(int b) { buf.push_back(static_cast<char>(b)); }
+    void raw(const void *p, size_t n) { buf.append(static_cast<const char*>(p), n); }
+
+    void varint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            byte(static_cast<int>(v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        byte(static_cast<int>(v));
+    }
+
+    void integer(int64_t v)
+    {
+        byte(CODEC_INT);
+        varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    void number(int idx)
+    {
+#if LUA_VERSION_NUM >= 503
+        // Keep integer/float subtype.
+        if (lua_isinteger(L, idx))
+        {
+            integer(lua_tointeger(L, idx));
+            return;
+        }
+        lua_Number d = lua_tonumber(L, idx);
+#else
+        // All numbers are floats, integral ones are stored as varints.
+        lua_Number d = lua_tonumber(L, idx);
+        if (d >= -9007199254740992.0 && d <= 9007199254740992.0
+            && d == std::floor(d) && !(d == 0 && std::signbit(d)))
+        {
+            integer(static_cast<int64_t>(d));
+            return;
+        }
+#endif
+        byte(CODEC_NUM);
+        raw(&d, sizeof(d));
+    }
+
+    bool object(int idx)
+    {
+        Wrapper *wrapper = static_cast<Wrapper*>(lua_touserdata(L, idx));
+        if (rawlen(L, idx) < sizeof(Wrapper) || wrapper->magic != LUAX_MAGIC
+            || !wrapper->ptr || !wrapper->tag->push)
+        {
+            error = "userdata is not a luax object";
+            return false;
+        }
+        // Sender state GC destroys the instance, see ownership rule.
+        if (wrapper->use_gc || wrapper->inplace || wrapper->pooled
+            || wrapper->shared)
+        {
+            error = "luax object is owned by the state";
+            return false;
+        }
+        byte(CODEC_OBJECT);
+        raw(&wrapper->tag, sizeof(wrapper->tag));
+        raw(&wrapper->ptr, sizeof(wrapper->ptr));
+        return true;
+    }
+
+    bool value(int idx, int depth)
+    {
+        switch (lua_type(L, idx))
+        {
+        case LUA_TNIL:
+            byte(CODEC_NIL);
+            return true;
+        case LUA_TBOOLEAN:
+            byte(lua_toboolean(L, idx) ? CODEC_TRUE : CODEC_FALSE);
+            return true;
+        case LUA_TNUMBER:
+            number(idx);
+            return true;
+        case LUA_TSTRING:
+        {
+            size_t len;
+            const char *str = lua_tolstring(L, idx, &len);
+            byte(CODEC_STR);
+            varint(len);
+            raw(str, len);
+            return true;
+        }
+        case LUA_TLIGHTUSERDATA:
+        {
+            void *p = lua_touserdata(L, idx);
+            byte(CODEC_LIGHT);
+            raw(&p, sizeof(p));
+            return true;
+        }
+        case LUA_TUSERDATA:
+            return object(idx);
+        case LUA_TTABLE:
+            return table(idx, depth);
+        default:
+            error = "unsupported value type";
+            return false;
+        }
+    }
+
+    // Array part 1..n is stored without keys, then the rest of the pairs.
+    bool table(int idx, int depth)
+    {
+        if (depth >= LUAX_CHANNEL_MAX_DEPTH)
+        {
+            error = "table is too deep or cyclic";
+            return false;
+        }
+        if (!lua_checkstack(L, 4))
+        {
+            error = "stack overflow";
+            return false;
+        }
+        if (idx < 0)
+            idx = lua_gettop(L) + idx + 1;
+
+        size_t n = rawlen(L, idx);
+        byte(CODEC_TABLE);
+        varint(n);
+        size_t count_pos = buf.size();
+        uint32_t count = 0;
+        raw(&count, sizeof(count));
+
+        for (size_t i = 1; i <= n; ++i)
+        {
+            lua_rawgeti(L, idx, static_cast<int>(i));
+            bool ok = value(-1, depth + 1);
+            lua_pop(L, 1);
+            if (!ok)
+                return false;
+        }
+
+        lua_pushnil(L);
+        while (lua_next(L, idx))                        // key val
+        {
+            if (lua_type(L, -2) == LUA_TNUMBER)
+            {
+                lua_Number k = lua_tonumber(L, -2);
+                if (k >= 1 && k <= static_cast<lua_Number>(n)
+                    && k == std::floor(k))
+                {
+                    lua_pop(L, 1);
+                    continue;
+                }
+            }
+            if (!value(-2, depth + 1) || !value(-1, depth + 1))
+            {
+                lua_pop(L, 2);
+                return false;
+            }
+            lua_pop(L, 1);                              // key
+            ++count;
+        }
+        memcpy(&buf[count_pos], &count, sizeof(count));
+        return true;
+    }
+};
+//------------------------------------------------------------------------------
+
+struct codec_reader
+{
+    lua_State *L;
+    const char *p;
+    const char *end;
+    const char *error;
+
+    bool raw(void *out, size_t n)
+    {
+        if (static_cast<size_t>(end - p) < n)
+            return false;
+        memcpy(out, p, n);
+        p += n;
+        return true;
+    }
+
+    bool varint(uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; p != end && shift < 64; shift += 7)
+        {
+            unsigned char b = static_cast<unsigned char>(*p++);
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // stack: -> val
+    bool value(int depth)
+    {
+        if (p == end || !lua_checkstack(L, 3))
+            return false;
+
+        switch (*p++)
+        {
+        case CODEC_NIL:
+            lua_pushnil(L);
+            return true;
+        case CODEC_FALSE:
+            lua_pushboolean(L, 0);
+            return true;
+        case CODEC_TRUE:
+            lua_pushboolean(L, 1);
+            return true;
+        case CODEC_INT:
+        {
+            uint64_t u;
+            if (!varint(u))
+                return false;
+            int64_t v = static_cast<int64_t>((u >> 1) ^ (~(u & 1) + 1));
+#if LUA_VERSION_NUM >= 503
+            lua_pushinteger(L, static_cast<lua_Integer>(v));
+#else
+            lua_pushnumber(L, static_cast<lua_Number>(v));
+#endif
+            return true;
+        }
+        case CODEC_NUM:
+        {
+            lua_Number d;
+            if (!raw(&d, sizeof(d)))
+                return false;
+            lua_pushnumber(L, d);
+            return true;
+        }
+        case CODEC_STR:
+        {
+            uint64_t len;
+            if (!varint(len) || static_cast<uint64_t>(end - p) < len)
+                return false;
+            lua_pushlstring(L, p, static_cast<size_t>(len));
+            p += len;
+            return true;
+        }
+        case CODEC_LIGHT:
+        {
+            void *ptr;
+            if (!raw(&ptr, sizeof(ptr)))
+                return false;
+            lua_pushlightuserdata(L, ptr);
+            return true;
+        }
+        case CODEC_OBJECT:
+        {
+            const TypeTag *tag;
+            void *ptr;
+            if (!raw(&tag, sizeof(tag)) || !raw(&ptr, sizeof(ptr)) || !tag)
+                return false;
+            if (!tag->push(L, ptr))
+            {
+                error = "luax type is not registered in the receiver";
+                return false;
+            }
+            return true;
+        }
+        case CODEC_TABLE:
+            return table(depth);
+        default:
+            return false;
+        }
+    }
+
+    // stack: -> tbl
+    bool table(int depth)
+    {
+        uint64_t n;
+        uint32_t count;
+        if (depth >= LUAX_CHANNEL_MAX_DEPTH || !varint(n)
+            || !raw(&count, sizeof(count))
+            || n + count > static_cast<uint64_t>(end - p))
+            return false;
+
+        lua_createtable(L, static_cast<int>(n), static_cast<int>(count));
+        for (uint64_t i = 1; i <= n; ++i)
+        {
+            if (!value(depth + 1))
+                return false;
+            lua_rawseti(L, -2, static_cast<int>(i));
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!value(depth + 1))
+                return false;
+            // nil and NaN keys would raise an error in lua_rawset().
+            if (lua_isnil(L, -1) || (lua_type(L, -1) == LUA_TNUMBER
+                && lua_tonumber(L, -1) != lua_tonumber(L, -1)))
+                return false;
+            if (!value(depth + 1))
+                return false;
+            lua_rawset(L, -3);
+        }
+        return true;
+    }
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Encode values at the indices first..last and append them to buf.
+ *
+ * Returns false if a value can't be encoded (functions, threads, foreign
+ * userdata, too deep or cyclic tables), error is set to the reason if
+ * passed. Content of buf is undefined in this case.
+ */
+inline bool encode(lua_State *L, int first, int last, std::string &buf,
+                   const char **error = 0)
+{
+    if (first < 0)
+        first = lua_gettop(L) + first + 1;
+    if (last < 0)
+        last = lua_gettop(L) + last + 1;
+
+    codec_writer w = {L, buf, 0};
+    for (int i = first; i <= last; ++i)
+    {
+        if (!w.value(i, 0))
+        {
+            if (error)
+                *error = w.error;
+            return false;
+        }
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Push values of the message.
+ *
+ * Returns number of pushed values or -1 if the message is malformed or
+ * contains object of the type not registered in the state, stack is not
+ * changed in this case and error is set to the reason if passed.
+ */
+inline int decode(lua_State *L, const char *data, size_t size,
+                  const char **error = 0)
+{
+    int top = lua_gettop(L);
+    codec_reader r = {L, data, data + size, "malformed message"};
+    while (r.p != r.end)
+    {
+        if (!r.value(0))
+        {
+            lua_settop(L, top);
+            if (error)
+                *error = r.error;
+            return -1;
+        }
+    }
+    return lua_gettop(L) - top;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Bounded lock-free multi-producer single-consumer queue of messages.
+ *
+ * Usually one channel per receiving state: any thread may send, only the
+ * thread which currently runs the receiving state reads.
+ *
+ *  luax::Channel inbox(1024);
+ *
+ *  // Producer (any thread, any state).
+ *  if (!inbox.send(L, 1, lua_gettop(L)))
+ *      ... channel is full or values can't be encoded
+ *
+ *  // Consumer.
+ *  int n;
+ *  while ((n = inbox.receive(L2)) >= 0)
+ *      ... n values are pushed
+ *
+ * Slots keep their buffers: a sent message swaps its buffer with the one
+ * left in the slot, so steady traffic doesn't allocate.
+ *
+ * Lua side functions are available with push_send() and push_receive().
+ */
+class Channel
+{
+public:
+    /** Capacity is rounded up to the power of two. */
+    explicit Channel(size_t capacity): m_tail(0), m_head(0),
+        m_mask(round_up(capacity) - 1), m_slots(m_mask + 1)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i)
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /** Approximate number of queued messages. */
+    size_t size() const
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    /**
+     * Queue the message, false if the channel is full.
+     * On success msg gets a recycled buffer with undefined content.
+     */
+    bool send(std::string &msg)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;)
+        {
+            slot = &m_slots[pos & m_mask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
+        slot->data.swap(msg);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Encode values first..last and queue them, false on failure. */
+    bool send(lua_State *L, int first, int last)
+    {
+        std::string &buf = scratch();
+        buf.clear();
+        return encode(L, first, last, buf) && send(buf);
+    }
+
+    /** Take the next message, false if the channel is empty. */
+    bool receive(std::string &msg)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[pos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        msg.swap(slot.data);
+        slot.seq.store(pos + m_mask + 1, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Push values of the next message.
+     * Returns number of pushed values, -1 if the channel is empty or
+     * -2 if the message can't be decoded (it's dropped, stack is not
+     * changed), error is set to the reason if passed, see decode().
+     */
+    int receive(lua_State *L, const char **error = 0)
+    {
+        std::string &buf = scratch();
+        if (!receive(buf))
+            return -1;
+        int n = decode(L, buf.data(), buf.size(), error);
+        return n < 0 ? -2 : n;
+    }
+
+    /**
+     * Push lua function send(...) bound to the channel, it returns false if
+     * the channel is full and raises error if values can't be encoded.
+     */
+    void push_send(lua_State *L)
+    {
+        lua_pushlightuserdata(L, this);
+        lua_pushcclosure(L, lua_send, 1);
+    }
+
+    /**
+     * Push lua function receive() bound to the channel, it returns true
+     * and values of the next message or false if the channel is empty,
+     * raises error if the message can't be decoded.
+     */
+    void push_receive(lua_State *L)
+    {
+        lua_pushlightuserdata(L, this);
+        lua_pushcclosure(L, lua_receive, 1);
+    }
+
+private:
+    Channel(const Channel&);
+    Channel& operator=(const Channel&);
+
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        std::string data;
+
+        Slot(): seq(0) {}
+    };
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity)
+            n <<= 1;
+        return n;
+    }
+
+    // Per thread encoding buffer, swapped with the slot buffers.
+    static std::string& scratch()
+    {
+        static thread_local std::string buf;
+        return buf;
+    }
+
+    static int lua_send(lua_State *L)
+    {
+        Channel *self = static_cast<Channel*>(lua_touserdata(L, lua_upvalueindex(1)));
+        std::string &buf = scratch();
+        buf.clear();
+        const char *error = 0;
+        if (!encode(L, 1, lua_gettop(L), buf, &error))
+            return luaL_error(L, "Can't send value: %s", error);
+        lua_pushboolean(L, self->send(buf));
+        return 1;
+    }
+
+    static int lua_receive(lua_State *L)
+    {
+        Channel *self = static_cast<Channel*>(lua_touserdata(L, lua_upvalueindex(1)));
+        lua_settop(L, 0);
+        lua_pushboolean(L, 1);
+        const char *error = 0;
+        int n = self->receive(L, &error);
+        if (n == -2)
+            return luaL_error(L, "Can't receive value: %s", error);
+        if (n < 0)
+        {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        return n + 1;
+    }
+
+    // Producers and consumer positions are kept on separate cache lines.
+    std::atomic<size_t> m_tail;
+    char m_pad1[64];
+    std::atomic<size_t> m_head;
+    char m_pad2[64];
+    size_t m_mask;
+    std::vector<Slot> m_slots;
+};
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_CHANNEL_H
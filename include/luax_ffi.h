@@ -0,0 +1,329 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_FFI_H
+#define LUAX_FFI_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "luax.h"
+
+// LuaJIT FFI binding of plain data fields.
+//
+// Fields listed with LUAX_FFI_FIELD() are described with ffi.cdef(),
+// so ffi<T>::push() gives a cdata pointer and field access compiles into
+// JIT traces without C calls. Other attributes (methods, properties) are
+// forwarded to the regular luax userdata of the same instance.
+// If FFI is not available (PUC Lua) ffi<T>::push() falls back to
+// type<T>::push().
+
+#define LUAX_FFI_FIELDS_BEGIN(cls)          \
+    namespace luax {                        \
+        template <> FfiField ffi<cls>::fields[] = {
+
+#define LUAX_FFI_FIELDS_END                 \
+            {0, 0, 0, 0, 0}                 \
+        };                                  \
+    } // namespace luax
+
+#define LUAX_FFI_FIELD(cls, field)                                      \
+    {#field, luax::ffi_ctype<decltype(cls::field)>(),                   \
+     offsetof(cls, field), sizeof(cls::field),                          \
+     luax::ffi_count<decltype(cls::field)>()},
+
+namespace luax
+{
+
+/** FFI field description. */
+struct FfiField
+{
+    const char *name;
+    const char *ctype;  // C type of the element.
+    size_t offset;
+    size_t size;
+    size_t count;       // Array size or 0 for scalars.
+};
+//------------------------------------------------------------------------------
+
+/** C type name of the arithmetic (or array of arithmetic) field. */
+template <typename V>
+inline const char* ffi_ctype()
+{
+    typedef typename std::remove_cv<
+        typename std::remove_all_extents<V>::type>::type E;
+    static_assert(std::is_arithmetic<E>::value,
+                  "Only arithmetic fields are supported by FFI binding");
+
+    if (std::is_same<E, bool>::value)
+        return "bool";
+    if (std::is_floating_point<E>::value)
+        return sizeof(E) == sizeof(float) ? "float" : "double";
+
+    static const char *sig[] = {"int8_t", "int16_t", "int32_t", "int64_t"};
+    static const char *uns[] = {"uint8_t", "uint16_t", "uint32_t", "uint64_t"};
+    int i = sizeof(E) == 1 ? 0 : sizeof(E) == 2 ? 1 : sizeof(E) == 4 ? 2 : 3;
+    return std::is_signed<E>::value ? sig[i] : uns[i];
+}
+//------------------------------------------------------------------------------
+
+template <typename V>
+inline size_t ffi_count()
+{
+    typedef typename std::remove_all_extents<V>::type E;
+    return std::is_array<V>::value ? sizeof(V) / sizeof(E) : 0;
+}
+//------------------------------------------------------------------------------
+
+
+/**
+ * FFI binding for standard layout type T.
+ *
+ * Usage:
+ *
+ *  LUAX_FFI_FIELDS_BEGIN(Point)
+ *      LUAX_FFI_FIELD(Point, x)
+ *      LUAX_FFI_FIELD(Point, y)
+ *  LUAX_FFI_FIELDS_END
+ *
+ *  luax::type<Point>::register_in(L);
+ *  luax::ffi<Point>::register_in(L);
+ *  luax::ffi<Point>::push(L, &pt);
+ *
+ * Pushed instances are not owned by lua (same as type::push(L, obj, false)).
+ */
+template <typename T>
+class ffi
+{
+public:
+    static FfiField fields[];
+
+    static bool register_in(lua_State *L);
+    static bool available(lua_State *L);
+    static inline int push(lua_State *L, T *obj);
+    static std::string cdef();
+    static std::string ctype_name();
+
+private:
+    // Address of the variable is used as registry key of the cast function.
+    static char key;
+
+    static int push_userdata(lua_State *L);
+};
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+
+// Implementation.
+
+template <typename T> FfiField ffi<T>::fields[] = {0, 0, 0, 0, 0};
+template <typename T> char ffi<T>::key = 0;
+
+// args: ffi name size push_userdata
+// Defines metatype and returns function to cast address to the pointer.
+// Pointers are cached per address (weak values), so the same instance is
+// pushed as the same cdata. Address is passed to push_userdata() as two
+// 32 bit halves, so it's exact for any pointer value.
+static const char ffi_metatype_script[] =
+    "local ffi, name, size, push = ...\n"
+    "assert(ffi.sizeof(name) == size, 'FFI layout mismatch for ' .. name)\n"
+    "local cast, tonumber, type = ffi.cast, tonumber, type\n"
+    "local ptr = ffi.typeof(name .. '*')\n"
+    "local uptr, u64 = ffi.typeof('uintptr_t'), ffi.typeof('uint64_t')\n"
+    "local function ud(p)\n"
+    "  local a = cast(u64, cast(uptr, p))\n"
+    "  return push(tonumber(a / 0x100000000ULL), tonumber(a % 0x100000000ULL))\n"
+    "end\n"
+    "local methods = {}\n"
+    "ffi.metatype(name, {\n"
+    "  __index = function(p, k)\n"
+    "    local v = ud(p)[k]\n"
+    "    if type(v) ~= 'function' then return v end\n"
+    "    local m = methods[k]\n"
+    "    if not m then\n"
+    "      m = function(self, ...) return v(ud(self), ...) end\n"
+    "      methods[k] = m\n"
+    "    end\n"
+    "    return m\n"
+    "  end,\n"
+    "  __newindex = function(p, k, v) ud(p)[k] = v end,\n"
+    "})\n"
+    "local cache = setmetatable({}, {__mode = 'v'})\n"
+    "return function(addr)\n"
+    "  local p = cache[addr]\n"
+    "  if not p then\n"
+    "    p = cast(ptr, addr)\n"
+    "    cache[addr] = p\n"
+    "  end\n"
+    "  return p\n"
+    "end\n";
+//------------------------------------------------------------------------------
+
+template <typename T> std::string ffi<T>::ctype_name()
+{
+    std::string name = std::string("luax_") + type<T>::usr_name();
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+              || (c >= '0' && c <= '9')))
+            name[i] = '_';
+    }
+    return name;
+}
+//------------------------------------------------------------------------------
+
+// Struct declaration with the same layout as T: fields are placed at their
+// offsets with explicit padding.
+template <typename T> std::string ffi<T>::cdef()
+{
+    static_assert(std::is_standard_layout<T>::value,
+                  "FFI binding requires standard layout type");
+
+    std::vector<const FfiField*> list;
+    for (const FfiField *f = fields; f->name; ++f)
+        list.push_back(f);
+    std::sort(list.begin(), list.end(),
+              [](const FfiField *a, const FfiField *b)
+              { return a->offset < b->offset; });
+
+    std::string res = "typedef struct {\n";
+    size_t pos = 0;
+    int pad = 0;
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        const FfiField *f = list[i];
+        if (f->offset > pos)
+        {
+            res += "  uint8_t luax_pad" + std::to_string(pad++) + "["
+                + std::to_string(f->offset - pos) + "];\n";
+        }
+        res += std::string("  ") + f->ctype + " " + f->name;
+        if (f->count)
+            res += "[" + std::to_string(f->count) + "]";
+        res += ";\n";
+        pos = f->offset + f->size;
+    }
+    if (sizeof(T) > pos)
+    {
+        res += "  uint8_t luax_pad" + std::to_string(pad++) + "["
+            + std::to_string(sizeof(T) - pos) + "];\n";
+    }
+    res += "} " + ctype_name() + ";\n";
+    return res;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Define FFI type and metatype for T.
+ *
+ * Returns false if FFI is not available, in such case push() uses
+ * type<T>::push(). type<T> must be registered before the call.
+ */
+template <typename T> bool ffi<T>::register_in(lua_State *L)
+{
+    if (available(L))
+        return true;
+
+    int top = lua_gettop(L);
+
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "ffi");
+    if (lua_pcall(L, 1, 1, 0) || !lua_istable(L, -1))
+    {
+        lua_settop(L, top);
+        return false;
+    }                                               // ffi
+
+    std::string def = cdef();
+    lua_getfield(L, -1, "cdef");                    // ffi cdef
+    lua_pushstring(L, def.c_str());                 // ffi cdef str
+    lua_call(L, 1, 0);                              // ffi
+
+    if (luaL_loadbuffer(L, ffi_metatype_script, sizeof(ffi_metatype_script) - 1,
+                        "luax_ffi"))
+        lua_error(L);                               // ffi script
+    lua_insert(L, -2);                              // script ffi
+    std::string name = ctype_name();
+    lua_pushstring(L, name.c_str());
+    lua_pushinteger(L, static_cast<lua_Integer>(sizeof(T)));
+    lua_pushcfunction(L, push_userdata);            // script ffi name size push
+    lua_call(L, 4, 1);                              // cast
+
+    rawsetp(L, LUA_REGISTRYINDEX, &key);
+    lua_settop(L, top);
+    return true;
+}
+//------------------------------------------------------------------------------
+
+/** Return true if FFI binding is registered in the lua state. */
+template <typename T> bool ffi<T>::available(lua_State *L)
+{
+    rawgetp(L, LUA_REGISTRYINDEX, &key);
+    bool res = lua_isfunction(L, -1);
+    lua_pop(L, 1);
+    return res;
+}
+//------------------------------------------------------------------------------
+
+/** Push instance as cdata pointer or as luax userdata if FFI is not used. */
+template <typename T> int ffi<T>::push(lua_State *L, T *obj)
+{
+    if (!obj)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    rawgetp(L, LUA_REGISTRYINDEX, &key);            // cast
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        return type<T>::push(L, obj, false);
+    }
+    lua_pushlightuserdata(L, static_cast<void*>(obj));
+    lua_call(L, 1, 1);                              // ptr
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Push luax userdata of the instance by its address, used to forward
+// non FFI attributes.
+// args: high and low 32 bits of the address (see ffi_metatype_script).
+template <typename T> int ffi<T>::push_userdata(lua_State *L)
+{
+    uint64_t hi = static_cast<uint64_t>(luaL_checknumber(L, 1));
+    uint64_t lo = static_cast<uint64_t>(luaL_checknumber(L, 2));
+    uintptr_t addr = static_cast<uintptr_t>((hi << 32) | lo);
+    if (!addr)
+        return luaL_argerror(L, 1, "FFI pointer expected");
+    return type<T>::push(L, reinterpret_cast<T*>(addr), false);
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_FFI_H
@@ -0,0 +1,376 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_FUNCTION_H
+#define LUAX_FUNCTION_H
+
+#include <stddef.h>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "luax_utils.h"
+
+namespace luax
+{
+
+// Message handler of the protected calls: adds traceback to the message.
+inline int function_msgh(lua_State *L)
+{
+    if (!lua_isstring(L, 1))
+        return 1;
+#if LUA_VERSION_NUM >= 502
+    luaL_traceback(L, L, lua_tostring(L, 1), 1);
+#else
+    lua_getglobal(L, "debug");
+    if (!lua_istable(L, -1))
+    {
+        lua_settop(L, 1);
+        return 1;
+    }
+    lua_getfield(L, -1, "traceback");
+    if (!lua_isfunction(L, -1))
+    {
+        lua_settop(L, 1);
+        return 1;
+    }
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 2);
+    lua_call(L, 2, 1);
+#endif
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Compile time index list to expand tuples.
+template <size_t... I>
+struct index_list {};
+
+template <size_t N, size_t... I>
+struct make_index_list: make_index_list<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct make_index_list<0, I...>
+{
+    typedef index_list<I...> type;
+};
+//------------------------------------------------------------------------------
+
+inline void push_args(lua_State*) {}
+
+template <typename A, typename... Rest>
+inline void push_args(lua_State *L, const A &a, const Rest&... rest)
+{
+    push(L, a);
+    push_args(L, rest...);
+}
+//------------------------------------------------------------------------------
+
+// Push batch element: single argument or tuple of arguments.
+template <typename V>
+inline void push_batch_args(lua_State *L, const V &v)
+{
+    push(L, v);
+}
+
+template <typename... A, size_t... I>
+inline void push_tuple(lua_State *L, const std::tuple<A...> &t, index_list<I...>)
+{
+    push_args(L, std::get<I>(t)...);
+}
+
+template <typename... A>
+inline void push_batch_args(lua_State *L, const std::tuple<A...> &t)
+{
+    push_tuple(L, t, typename make_index_list<sizeof...(A)>::type());
+}
+//------------------------------------------------------------------------------
+
+// Store result from the top of the stack.
+template <typename R>
+struct function_result
+{
+    enum { count = 1 };
+
+    template <typename Out>
+    static void store_next(lua_State *L, Out &out)
+    {
+        *out = get<R>(L, -1);
+        ++out;
+    }
+
+    static void store(lua_State *L, R *out)
+    {
+        if (out)
+            *out = get<R>(L, -1);
+    }
+};
+
+template <>
+struct function_result<void>
+{
+    enum { count = 0 };
+
+    template <typename Out>
+    static void store_next(lua_State*, Out&) {}
+    static void store(lua_State*, void*) {}
+};
+//------------------------------------------------------------------------------
+
+template <typename Sig> class Function;
+
+/**
+ * Typed reference to the lua function.
+ *
+ * Function is pinned in the registry, so calls don't do any string lookups:
+ *
+ *  luax::Function<int(int, const std::string&)> f(L, "on_event");
+ *  int res = f(1, "x");
+ *  if (!f.ok())
+ *      log(f.error());
+ *
+ * Arguments are pushed with luax::push(), result is converted with
+ * luax::get(). Calls are protected, error message (with traceback) is
+ * available with error(). Function must be destroyed before the lua state.
+ */
+template <typename R, typename... Args>
+class Function<R(Args...)>
+{
+    static_assert(!std::is_same<R, const char*>::value,
+                  "Use std::string result, const char* is not valid after call");
+
+public:
+    Function(): L(0), m_ref(LUA_NOREF), m_msgh(LUA_NOREF), m_ok(true) {}
+
+    /** Reference the value at the index. */
+    Function(lua_State *L, int index): L(0), m_ref(LUA_NOREF),
+        m_msgh(LUA_NOREF), m_ok(true)
+    {
+        lua_pushvalue(L, index);
+        pin(L);
+    }
+
+    /** Reference the global value, name is resolved once. */
+    Function(lua_State *L, const char *global): L(0), m_ref(LUA_NOREF),
+        m_msgh(LUA_NOREF), m_ok(true)
+    {
+        lua_getglobal(L, global);
+        pin(L);
+    }
+
+    Function(Function &&other): L(other.L), m_ref(other.m_ref),
+        m_msgh(other.m_msgh), m_ok(other.m_ok), m_error(std::move(other.m_error))
+    {
+        other.L = 0;
+        other.m_ref = LUA_NOREF;
+        other.m_msgh = LUA_NOREF;
+    }
+
+    Function& operator=(Function &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            L = other.L;
+            m_ref = other.m_ref;
+            m_msgh = other.m_msgh;
+            m_ok = other.m_ok;
+            m_error = std::move(other.m_error);
+            other.L = 0;
+            other.m_ref = LUA_NOREF;
+            other.m_msgh = LUA_NOREF;
+        }
+        return *this;
+    }
+
+    ~Function() { reset(); }
+
+    /** Release the reference. */
+    void reset()
+    {
+        if (L)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, m_ref);
+            luaL_unref(L, LUA_REGISTRYINDEX, m_msgh);
+            L = 0;
+        }
+        m_ref = LUA_NOREF;
+        m_msgh = LUA_NOREF;
+    }
+
+    /** Return true if function is referenced (nil values are not). */
+    bool valid() const { return L != 0; }
+
+    /** Return false if last call failed. */
+    bool ok() const { return m_ok; }
+    const std::string& error() const { return m_error; }
+
+    /**
+     * Call the function, return false on error.
+     * res may be null to ignore the result.
+     */
+    bool call(typename std::conditional<std::is_void<R>::value, void, R>::type *res,
+              const Args&... args)
+    {
+        int top;
+        if (!begin(top))
+            return false;
+        push_args(L, args...);
+        if (!end(lua_pcall(L, sizeof...(Args), function_result<R>::count, top + 1),
+                 top))
+            return false;
+        function_result<R>::store(L, res);
+        lua_settop(L, top);
+        return true;
+    }
+
+    /** Call the function, return default value on error (see ok()). */
+    R operator()(const Args&... args)
+    {
+        return invoke(std::is_void<R>(), args...);
+    }
+
+    /**
+     * Call the function for each element of the range in one protected
+     * call. Element is the argument (single argument functions) or
+     * std::tuple of the arguments; results are written to out.
+     * On error stops and returns false, results of the processed
+     * elements are already written.
+     */
+    template <typename It, typename Out>
+    bool call_all(It first, It last, Out out)
+    {
+        int top;
+        if (!begin(top))
+            return false;
+        Batch<It, Out> batch = {m_ref, first, last, out};
+        lua_pushcfunction(L, (run_batch<It, Out>));
+        lua_pushlightuserdata(L, &batch);
+        if (!end(lua_pcall(L, 1, 0, top + 1), top))
+            return false;
+        lua_settop(L, top);
+        return true;
+    }
+
+    template <typename It>
+    bool call_all(It first, It last)
+    {
+        static_assert(std::is_void<R>::value, "Output iterator is required");
+        return call_all(first, last, static_cast<void*>(0));
+    }
+
+private:
+    Function(const Function&);
+    Function& operator=(const Function&);
+
+    template <typename It, typename Out>
+    struct Batch
+    {
+        int ref;
+        It first;
+        It last;
+        Out out;
+    };
+
+    // Calls inside single protected call.
+    // stack: batch
+    template <typename It, typename Out>
+    static int run_batch(lua_State *L)
+    {
+        Batch<It, Out> *b = static_cast<Batch<It, Out>*>(lua_touserdata(L, 1));
+        for (; b->first != b->last; ++b->first)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, b->ref);
+            push_batch_args(L, *b->first);
+            lua_call(L, sizeof...(Args), function_result<R>::count);
+            function_result<R>::store_next(L, b->out);
+            lua_settop(L, 1);
+        }
+        return 0;
+    }
+
+    // stack: value
+    void pin(lua_State *state)
+    {
+        if (lua_isnil(state, -1))
+        {
+            lua_pop(state, 1);
+            return;
+        }
+        L = state;
+        m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_pushcfunction(L, function_msgh);
+        m_msgh = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    // Push message handler and function, top is set to the stack top
+    // before the call. It's kept by the caller (not in a member), so the
+    // function may be called again from the lua code it runs.
+    bool begin(int &top)
+    {
+        if (!L)
+        {
+            m_ok = false;
+            m_error = "Function is not set";
+            return false;
+        }
+        top = lua_gettop(L);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, m_msgh);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, m_ref);
+        return true;
+    }
+
+    bool end(int status, int top)
+    {
+        m_ok = status == 0;
+        if (!m_ok)
+        {
+            const char *msg = lua_tostring(L, -1);
+            m_error = msg ? msg : "Unknown error";
+            lua_settop(L, top);
+        }
+        return m_ok;
+    }
+
+    R invoke(std::false_type /*void*/, const Args&... args)
+    {
+        R res = R();
+        call(&res, args...);
+        return res;
+    }
+
+    void invoke(std::true_type, const Args&... args)
+    {
+        call(0, args...);
+    }
+
+    lua_State *L;
+    int m_ref;
+    int m_msgh;
+    bool m_ok;
+    std::string m_error;
+};
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_FUNCTION_H
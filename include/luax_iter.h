@@ -0,0 +1,259 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_ITER_H
+#define LUAX_ITER_H
+
+#include <iterator>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "luax.h"
+#include "luax_span.h"
+
+// Lazy iterators: C++ range or generator is pushed as lua iterator function,
+// elements are pushed on each step so scripts may stop early without
+// building a table:
+//
+//  int Inventory::items(lua_State *L)
+//  {
+//      return luax::push_iter(L, m_items.begin(), m_items.end(), 1);
+//  }
+//
+//  for item in inventory:items() do ... end
+//
+// Iterator state lives in a single userdata (upvalue of the function),
+// step doesn't allocate.
+
+namespace luax
+{
+
+// Push element by reference: bound classes and pointers to them without GC,
+// other types (including other pointers, e.g. const char*) with luax::push().
+template <typename U, typename Enable = void>
+struct iter_element
+{
+    static void push(lua_State *L, U &v)
+    {
+        span_element<U>::push(L, v);
+    }
+};
+
+template <typename U>
+struct iter_element<U*, typename std::enable_if<is_bound<U>::value>::type>
+{
+    static void push(lua_State *L, U *v)
+    {
+        typedef typename std::remove_const<U>::type V;
+        type<V>::push(L, const_cast<V*>(v), false);
+    }
+};
+
+template <typename U>
+inline void iter_push(lua_State *L, U &v)
+{
+    typedef typename std::remove_const<U>::type V;
+    iter_element<V>::push(L, const_cast<V&>(v));
+}
+//------------------------------------------------------------------------------
+
+// Push element by value: bound classes are copied into the userdata.
+template <typename U>
+inline void iter_push_value(lua_State *L, U &v, std::true_type /*bound*/)
+{
+    type<U>::push_value(L, v);
+}
+
+template <typename U>
+inline void iter_push_value(lua_State *L, U &v, std::false_type)
+{
+    iter_push(L, v);
+}
+
+template <typename U>
+inline void iter_push_value(lua_State *L, U &v)
+{
+    iter_push_value(L, v, std::integral_constant<bool, is_bound<U>::value>());
+}
+//------------------------------------------------------------------------------
+
+// Dereferenced value is pushed by reference if iterator returns reference,
+// otherwise (proxy iterators) by value.
+template <typename It>
+inline void iter_push_deref(lua_State *L, It &it, std::true_type /*ref*/)
+{
+    iter_push(L, *it);
+}
+
+template <typename It>
+inline void iter_push_deref(lua_State *L, It &it, std::false_type)
+{
+    typename std::decay<decltype(*it)>::type v = *it;
+    iter_push_value(L, v);
+}
+//------------------------------------------------------------------------------
+
+template <typename S>
+inline int iter_gc(lua_State *L)
+{
+    S *s = static_cast<S*>(lua_touserdata(L, 1));
+    if (s->alive)
+    {
+        s->alive = false;
+        s->~S();
+    }
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Create userdata for the state, set __gc if S needs destruction.
+// Memory is zeroed before anything that can raise, so if the metatable
+// creation or S construction fails iter_gc() sees alive == false.
+// stack: -> ud
+template <typename S>
+inline S* iter_new_state(lua_State *L)
+{
+    void *mem = lua_newuserdata(L, sizeof(S));
+    memset(mem, 0, sizeof(S));
+    if (!std::is_trivially_destructible<S>::value)
+    {
+        // Address of the variable is used as registry key of the metatable.
+        static char key;
+        rawgetp(L, LUA_REGISTRYINDEX, &key);
+        if (lua_isnil(L, -1))
+        {
+            lua_pop(L, 1);
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, iter_gc<S>);
+            lua_setfield(L, -2, "__gc");
+            lua_pushvalue(L, -1);
+            rawsetp(L, LUA_REGISTRYINDEX, &key);
+        }
+        lua_setmetatable(L, -2);
+    }
+    return static_cast<S*>(mem);
+}
+//------------------------------------------------------------------------------
+
+template <typename It>
+struct IterState
+{
+    It cur;
+    It end;
+    bool alive;
+
+    IterState(It first, It last): cur(first), end(last), alive(true) {}
+};
+//------------------------------------------------------------------------------
+
+template <typename It>
+inline int iter_step(lua_State *L)
+{
+    IterState<It> *s = static_cast<IterState<It>*>(
+        lua_touserdata(L, lua_upvalueindex(1)));
+    if (!s->alive || s->cur == s->end)
+        return 0;
+    iter_push_deref(L, s->cur, std::integral_constant<bool,
+                    std::is_reference<decltype(*s->cur)>::value>());
+    ++s->cur;
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Push iterator function for the [first, last) range.
+ *
+ * Elements returned by reference are pushed with type<U>::push(L, &e, false)
+ * for bound classes, pointers to bound classes - with type<U>::push(L, p,
+ * false), other values with luax::push().
+ * Range must stay valid while the function is used; if owner index is set
+ * then the value at the index (e.g. self) is kept alive by the function.
+ */
+template <typename It>
+inline int push_iter(lua_State *L, It first, It last, int owner = 0)
+{
+    if (owner < 0 && owner > LUA_REGISTRYINDEX)
+        owner = lua_gettop(L) + owner + 1;
+    new (iter_new_state<IterState<It> >(L)) IterState<It>(first, last);
+    if (owner)
+        lua_pushvalue(L, owner);
+    lua_pushcclosure(L, iter_step<It>, owner ? 2 : 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+template <typename C>
+inline int push_iter(lua_State *L, C &container, int owner = 0)
+{
+    return push_iter(L, std::begin(container), std::end(container), owner);
+}
+//------------------------------------------------------------------------------
+
+template <typename U, typename F>
+struct GenState
+{
+    F gen;
+    bool alive;
+
+    GenState(F gen): gen(std::move(gen)), alive(true) {}
+};
+//------------------------------------------------------------------------------
+
+template <typename U, typename F>
+inline int gen_step(lua_State *L)
+{
+    GenState<U, F> *s = static_cast<GenState<U, F>*>(
+        lua_touserdata(L, lua_upvalueindex(1)));
+    if (!s->alive)
+        return 0;
+    U v;
+    if (!s->gen(v))
+        return 0;
+    iter_push_value(L, v);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Push iterator function for the generator.
+ *
+ * Generator is a callable bool(U &out), it returns false when done.
+ * Values are pushed by value (bound classes with type<U>::push_value()).
+ */
+template <typename U, typename F>
+inline int push_generator(lua_State *L, F gen, int owner = 0)
+{
+    if (owner < 0 && owner > LUA_REGISTRYINDEX)
+        owner = lua_gettop(L) + owner + 1;
+    new (iter_new_state<GenState<U, F> >(L)) GenState<U, F>(std::move(gen));
+    if (owner)
+        lua_pushvalue(L, owner);
+    lua_pushcclosure(L, gen_step<U, F>, owner ? 2 : 1);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_ITER_H
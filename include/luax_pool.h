@@ -0,0 +1,213 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_POOL_H
+#define LUAX_POOL_H
+
+#include <atomic>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+#include "luax.h"
+
+// Use thread local luax::Pool<cls> for instances created from lua,
+// see type::usr_alloc(). Type must define usr_inplace_constructor().
+#define LUAX_TYPE_POOL(cls)                                             \
+    namespace luax {                                                    \
+        template <> void* type<cls>::usr_alloc(lua_State*)              \
+        {                                                               \
+            return Pool<cls>::local().alloc();                          \
+        }                                                               \
+        template <> void type<cls>::usr_free(lua_State*, void *mem)     \
+        {                                                               \
+            Pool<cls>::local().free(mem);                               \
+        }                                                               \
+    }
+
+namespace luax
+{
+
+/**
+ * Fixed size slab allocator for T instances.
+ *
+ * Memory is allocated in blocks of BlockSize slots and is never returned
+ * to the system while any slot is in use; free slots are reused in LIFO
+ * order. alloc() and free() don't construct or destruct anything.
+ *
+ * Pool is not thread safe, use local() to get thread local instance.
+ * Each slot remembers the pool memory (arena) it belongs to, so memory may
+ * be freed on any thread (e.g. lua state moved to another thread): slots
+ * of another pool are returned to it with a lock-free list and reused by
+ * its owner on the next alloc(). Blocks outlive the pool object until all
+ * their slots are freed, so a thread may exit while its instances are
+ * still alive.
+ */
+template <typename T, size_t BlockSize = 256>
+class Pool
+{
+public:
+    Pool(): m_arena(new Arena()), m_high_water(0) {}
+    ~Pool();
+
+    /** Thread local pool instance. */
+    static Pool& local();
+
+    void* alloc();
+    void free(void *mem);
+
+    /**
+     * Number of slots in use. A slot freed on another thread stops
+     * counting when that free() returns, before the owner takes it back
+     * from the remote list on the next alloc().
+     */
+    size_t occupancy() const
+    {
+        return m_arena->refs.load(std::memory_order_relaxed) - 1;
+    }
+
+    /** Max occupancy since creation. */
+    size_t high_water() const { return m_high_water; }
+
+    /** Number of slots in all blocks. */
+    size_t capacity() const { return m_arena->blocks.size() * BlockSize; }
+
+    size_t blocks() const { return m_arena->blocks.size(); }
+
+private:
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+    struct Arena;
+
+    struct Slot
+    {
+        Arena *owner;
+        union
+        {
+            Slot *next;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        } data;
+    };
+
+    // Memory of the pool, deleted when both the pool and all the
+    // allocated slots are gone.
+    struct Arena
+    {
+        Arena(): free(0), remote(0), refs(1) {}
+
+        ~Arena()
+        {
+            for (size_t i = 0; i < blocks.size(); ++i)
+                delete [] blocks[i];
+        }
+
+        void release()
+        {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+
+        Slot *free;                     // Owner thread only.
+        std::vector<Slot*> blocks;      // Owner thread only.
+        std::atomic<Slot*> remote;      // Freed on other threads.
+        std::atomic<size_t> refs;       // Allocated slots + pool itself.
+    };
+
+    Arena *m_arena;
+    size_t m_high_water;
+};
+//------------------------------------------------------------------------------
+
+template <typename T, size_t BlockSize> Pool<T, BlockSize>::~Pool()
+{
+    // Instances may be still alive (e.g. lua state is not closed yet),
+    // then the last free() deletes the memory.
+    m_arena->release();
+}
+//------------------------------------------------------------------------------
+
+template <typename T, size_t BlockSize>
+Pool<T, BlockSize>& Pool<T, BlockSize>::local()
+{
+    static thread_local Pool pool;
+    return pool;
+}
+//------------------------------------------------------------------------------
+
+template <typename T, size_t BlockSize> void* Pool<T, BlockSize>::alloc()
+{
+    Arena *arena = m_arena;
+    if (!arena->free)
+        arena->free = arena->remote.exchange(0, std::memory_order_acquire);
+    if (!arena->free)
+    {
+        Slot *block = new Slot[BlockSize];
+        arena->blocks.push_back(block);
+
+        // Link slots so the first one is allocated first.
+        for (size_t i = 0; i < BlockSize; ++i)
+        {
+            block[i].owner = arena;
+            block[i].data.next = i + 1 < BlockSize ? &block[i + 1] : 0;
+        }
+        arena->free = block;
+    }
+
+    Slot *slot = arena->free;
+    arena->free = slot->data.next;
+    size_t n = arena->refs.fetch_add(1, std::memory_order_relaxed);
+    if (n > m_high_water)
+        m_high_water = n;
+    return &slot->data.storage;
+}
+//------------------------------------------------------------------------------
+
+template <typename T, size_t BlockSize> void Pool<T, BlockSize>::free(void *mem)
+{
+    if (!mem)
+        return;
+    Slot *slot = reinterpret_cast<Slot*>(
+        static_cast<char*>(mem) - offsetof(Slot, data));
+    Arena *arena = slot->owner;
+    if (arena == m_arena)
+    {
+        slot->data.next = arena->free;
+        arena->free = slot;
+    }
+    else
+    {
+        // Slot of another thread pool.
+        Slot *head = arena->remote.load(std::memory_order_relaxed);
+        do
+            slot->data.next = head;
+        while (!arena->remote.compare_exchange_weak(head, slot,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+    }
+    arena->release();
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_POOL_H
@@ -0,0 +1,326 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_PROFILE_H
+#define LUAX_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Dispatch layer profiling.
+//
+// Profiling is a runtime option, it's enabled per lua state with
+// luax::profile::enable() which must be called before type::register_in().
+// Every bound function of the types registered after that (methods,
+// getters, setters, __call and __gc) is wrapped with a closure which
+// measures the call and updates per state statistics, so states on
+// different threads don't share any data. States without profiling pay
+// one registry lookup per bound function at registration only.
+
+// Registry key of the per state profile table:
+// registry[LUAX_PROFILE_KEY] = {type name = {entry name = stats userdata}}.
+#define LUAX_PROFILE_KEY "__luax_profile"
+
+// Number of log2 histogram buckets, bucket i counts calls which took
+// [2^i, 2^(i+1)) ns, the last one counts all longer calls.
+#define LUAX_PROFILE_BUCKETS 32
+
+namespace luax
+{
+namespace profile
+{
+
+/** Call statistics of a single method/property/metamethod. */
+struct Stats
+{
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t hist[LUAX_PROFILE_BUCKETS];
+};
+//------------------------------------------------------------------------------
+
+/** Snapshot entry, see snapshot(). */
+struct Entry
+{
+    std::string type;   // Type name.
+    std::string name;   // Method name, "get:prop", "set:prop", "__call", "__gc".
+    Stats stats;
+};
+//------------------------------------------------------------------------------
+
+inline uint64_t now_ns()
+{
+    typedef std::chrono::steady_clock Clock;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count());
+}
+//------------------------------------------------------------------------------
+
+inline int bucket(uint64_t ns)
+{
+    int b = 0;
+    while (ns >>= 1)
+        ++b;
+    return b < LUAX_PROFILE_BUCKETS ? b : LUAX_PROFILE_BUCKETS - 1;
+}
+//------------------------------------------------------------------------------
+
+inline void record(Stats *s, uint64_t ns)
+{
+    if (!s->calls || ns < s->min_ns)
+        s->min_ns = ns;
+    if (ns > s->max_ns)
+        s->max_ns = ns;
+    ++s->calls;
+    s->total_ns += ns;
+    ++s->hist[bucket(ns)];
+}
+//------------------------------------------------------------------------------
+
+// upvalues: func stats
+// Calls that raise an error are not recorded.
+inline int call(lua_State *L)
+{
+    Stats *s = static_cast<Stats*>(lua_touserdata(L, lua_upvalueindex(2)));
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+
+    uint64_t start = now_ns();
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    record(s, now_ns() - start);
+    return lua_gettop(L);
+}
+//------------------------------------------------------------------------------
+
+/** Enable profiling for the lua state, call it before type registration. */
+inline void enable(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);
+    bool exists = lua_istable(L, -1);
+    lua_pop(L, 1);
+    if (exists)
+        return;
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);
+}
+//------------------------------------------------------------------------------
+
+/** Return true if profiling is enabled for the lua state. */
+inline bool enabled(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);
+    bool res = lua_istable(L, -1);
+    lua_pop(L, 1);
+    return res;
+}
+//------------------------------------------------------------------------------
+
+// Push stats userdata for the entry, create it if not exists.
+// stack: profile
+inline void push_stats(lua_State *L, const char *type, const char *name)
+{
+    lua_getfield(L, -1, type);                  // profile types
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);                        // profile types
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, type);
+    }
+
+    lua_getfield(L, -1, name);                  // profile types stats
+    if (!lua_isuserdata(L, -1))
+    {
+        lua_pop(L, 1);
+        void *s = lua_newuserdata(L, sizeof(Stats));
+        memset(s, 0, sizeof(Stats));
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, name);
+    }
+    lua_remove(L, -2);                          // profile stats
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Replace function on top of the stack with profiling closure if profiling
+ * is enabled for the state. Entry name is prefix + name.
+ */
+inline void wrap(lua_State *L, const char *type, const char *prefix,
+                 const char *name)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);  // func profile
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return;
+    }
+
+    std::string key = std::string(prefix) + name;
+    push_stats(L, type, key.c_str());           // func profile stats
+    lua_remove(L, -2);                          // func stats
+    lua_pushcclosure(L, call, 2);               // closure
+}
+//------------------------------------------------------------------------------
+
+/** Return copy of all statistics of the state. */
+inline std::vector<Entry> snapshot(lua_State *L)
+{
+    std::vector<Entry> res;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);  // profile
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return res;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2))                     // profile type entries
+    {
+        lua_pushnil(L);
+        while (lua_next(L, -2))                 // profile type entries name ud
+        {
+            Entry e;
+            e.type = lua_tostring(L, -4);
+            e.name = lua_tostring(L, -2);
+            e.stats = *static_cast<Stats*>(lua_touserdata(L, -1));
+            res.push_back(e);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return res;
+}
+//------------------------------------------------------------------------------
+
+/** Reset all statistics of the state. */
+inline void reset(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_PROFILE_KEY);
+    if (lua_istable(L, -1))
+    {
+        lua_pushnil(L);
+        while (lua_next(L, -2))
+        {
+            lua_pushnil(L);
+            while (lua_next(L, -2))
+            {
+                memset(lua_touserdata(L, -1), 0, sizeof(Stats));
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Push snapshot as lua table:
+ *
+ *  {Point = {move = {calls = 1, total_ns = 10, min_ns = 10, max_ns = 10,
+ *                    hist = {[4] = 1}}}}
+ *
+ * hist contains only non empty buckets, bucket i is [2^i, 2^(i+1)) ns.
+ */
+inline void push_snapshot(lua_State *L)
+{
+    std::vector<Entry> entries = snapshot(L);
+
+    lua_newtable(L);                                    // res
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const Entry &e = entries[i];
+        const Stats &s = e.stats;
+
+        lua_getfield(L, -1, e.type.c_str());            // res type
+        if (!lua_istable(L, -1))
+        {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -3, e.type.c_str());
+        }
+
+        lua_newtable(L);                                // res type entry
+        lua_pushnumber(L, static_cast<lua_Number>(s.calls));
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, static_cast<lua_Number>(s.total_ns));
+        lua_setfield(L, -2, "total_ns");
+        lua_pushnumber(L, static_cast<lua_Number>(s.min_ns));
+        lua_setfield(L, -2, "min_ns");
+        lua_pushnumber(L, static_cast<lua_Number>(s.max_ns));
+        lua_setfield(L, -2, "max_ns");
+
+        lua_newtable(L);                                // res type entry hist
+        for (int b = 0; b < LUAX_PROFILE_BUCKETS; ++b)
+        {
+            if (!s.hist[b])
+                continue;
+            lua_pushnumber(L, static_cast<lua_Number>(s.hist[b]));
+            lua_rawseti(L, -2, b);
+        }
+        lua_setfield(L, -2, "hist");                    // res type entry
+
+        lua_setfield(L, -2, e.name.c_str());            // res type
+        lua_pop(L, 1);                                  // res
+    }
+}
+//------------------------------------------------------------------------------
+
+/** lua_CFunction version of push_snapshot() to be used from lua. */
+inline int lua_snapshot(lua_State *L)
+{
+    push_snapshot(L);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+/** lua_CFunction version of reset() to be used from lua. */
+inline int lua_reset(lua_State *L)
+{
+    reset(L);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+} // namespace profile
+} // namespace luax
+
+#endif // LUAX_PROFILE_H
@@ -0,0 +1,507 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_SCHEDULER_H
+#define LUAX_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "luax_function.h"
+
+namespace luax
+{
+
+// Stored type of the (decayed) call argument: strings are copied.
+template <typename T>
+struct job_arg
+{
+    typedef T type;
+};
+
+template <>
+struct job_arg<const char*>
+{
+    typedef std::string type;
+};
+
+template <>
+struct job_arg<char*>
+{
+    typedef std::string type;
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Runs jobs on a set of worker threads, each worker owns a lua state.
+ *
+ *  luax::Scheduler sched(4, [](lua_State *L) {
+ *      luaL_openlibs(L);
+ *      luax::init(L);
+ *      luax::type<Event>::register_in(L);
+ *      luaL_dofile(L, "handlers.lua");
+ *  });
+ *
+ *  sched.call("on_event", id, "payload");  // on_event(id, "payload")
+ *  sched.call_on(0, "flush");              // always on worker 0
+ *  sched.submit([](lua_State *L) { ... });
+ *  sched.wait();
+ *
+ * Each worker has a deque of jobs: owner takes the newest job, idle workers
+ * steal the oldest ones from the others. Jobs with affinity are queued to
+ * the given worker only and are never stolen, so they may rely on the
+ * state content (e.g. accumulate data in globals).
+ *
+ * Jobs are protected, lua errors and C++ exceptions are counted in stats()
+ * and last error message is available with last_error().
+ *
+ * wait() may be called from a job: the worker runs other jobs (on the same
+ * state, in a new stack frame) until all pending jobs except the waiting
+ * ones are finished.
+ */
+class Scheduler
+{
+public:
+    typedef std::function<void(lua_State*)> Setup;
+    typedef std::function<void(lua_State*)> Job;
+
+    struct Stats
+    {
+        uint64_t executed;      // Finished jobs.
+        uint64_t stolen;        // Jobs taken from other workers.
+        uint64_t errors;        // Failed calls.
+    };
+
+    /** Start workers, states are prepared with setup on the worker threads. */
+    Scheduler(size_t workers, Setup setup): m_setup(setup), m_stop(false),
+        m_next(0), m_queued(0), m_pending(0), m_waiting(0), m_executed(0),
+        m_stolen(0), m_errors(0)
+    {
+        if (workers == 0)
+            workers = 1;
+        for (size_t i = 0; i < workers; ++i)
+            m_workers.push_back(new Worker());
+        for (size_t i = 0; i < workers; ++i)
+            m_workers[i]->thread = std::thread(&Scheduler::run, this, i);
+    }
+
+    /** Finish queued jobs, stop workers and close their states. */
+    ~Scheduler()
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        // Workers may still steal from each other until all are stopped.
+        for (size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i]->thread.join();
+        for (size_t i = 0; i < m_workers.size(); ++i)
+            delete m_workers[i];
+    }
+
+    size_t size() const { return m_workers.size(); }
+
+    /**
+     * Index of the worker which runs the calling thread,
+     * size() if called outside of the scheduler workers.
+     */
+    size_t current_worker() const
+    {
+        const Current &cur = current();
+        return cur.sched == this ? cur.index : m_workers.size();
+    }
+
+    /**
+     * Queue the job to any worker. Jobs submitted from the worker thread are
+     * queued to the same worker.
+     */
+    void submit(Job job)
+    {
+        size_t w = current_worker();
+        if (w == m_workers.size())
+            w = m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+        push(w, job, false);
+    }
+
+    /** Queue the job to the given worker, it's never stolen. */
+    void submit_to(size_t worker, Job job)
+    {
+        push(worker % m_workers.size(), job, true);
+    }
+
+    /** Queue call of the global function func(args...). */
+    template <typename... Args>
+    void call(const char *func, const Args&... args)
+    {
+        submit(make_call(func, args...));
+    }
+
+    /** Queue call of the global function func(args...) to the given worker. */
+    template <typename... Args>
+    void call_on(size_t worker, const char *func, const Args&... args)
+    {
+        submit_to(worker, make_call(func, args...));
+    }
+
+    /**
+     * Wait until all queued jobs are finished.
+     * If called from a job then runs the jobs until only waiting ones left.
+     */
+    void wait()
+    {
+        size_t w = current_worker();
+        if (w != m_workers.size())
+        {
+            help(w);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]() {
+            return m_pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.executed = m_executed.load(std::memory_order_relaxed);
+        s.stolen = m_stolen.load(std::memory_order_relaxed);
+        s.errors = m_errors.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    std::string last_error() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_last_error;
+    }
+
+private:
+    Scheduler(const Scheduler&);
+    Scheduler& operator=(const Scheduler&);
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;       // Own jobs, may be stolen.
+        std::deque<Job> pinned;     // Jobs with affinity.
+        std::atomic<size_t> npinned;
+        std::thread thread;
+        lua_State *L;
+
+        Worker(): npinned(0), L(0) {}
+    };
+
+    struct JobCall
+    {
+        Job *job;
+        std::string error;          // C++ exception message.
+    };
+
+    struct Current
+    {
+        const Scheduler *sched;
+        size_t index;
+    };
+
+    static Current& current()
+    {
+        static thread_local Current cur = {0, 0};
+        return cur;
+    }
+
+    template <typename... Args>
+    Job make_call(const char *func, const Args&... args)
+    {
+        typedef std::tuple<
+            typename job_arg<typename std::decay<Args>::type>::type...> Tuple;
+        std::string name(func);
+        Tuple t(args...);
+        return [this, name, t](lua_State *L) { call_job(L, name, t); };
+    }
+
+    template <typename Tuple>
+    void call_job(lua_State *L, const std::string &name, const Tuple &args)
+    {
+        lua_pushcfunction(L, function_msgh);            // msgh
+        lua_getglobal(L, name.c_str());                 // msgh func
+        push_batch_args(L, args);
+        if (lua_pcall(L, std::tuple_size<Tuple>::value, 0, 1) != 0)
+        {
+            const char *msg = lua_tostring(L, -1);
+            error(msg ? msg : "Unknown error");
+        }
+        lua_settop(L, 0);
+    }
+
+    void error(const std::string &msg)
+    {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_last_error = msg;
+    }
+
+    void push(size_t w, const Job &job, bool pinned)
+    {
+        m_pending.fetch_add(1, std::memory_order_acq_rel);
+        Worker *worker = m_workers[w];
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            if (pinned)
+            {
+                worker->pinned.push_back(job);
+                worker->npinned.fetch_add(1, std::memory_order_release);
+            }
+            else
+            {
+                worker->jobs.push_back(job);
+                m_queued.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        // Lock to not miss the worker which is going to sleep.
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        if (pinned)
+            m_cv.notify_all();
+        else
+            m_cv.notify_one();
+    }
+
+    // Own jobs: pinned first, then the newest one.
+    bool pop(size_t w, Job &job)
+    {
+        Worker *worker = m_workers[w];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->pinned.empty())
+        {
+            job.swap(worker->pinned.front());
+            worker->pinned.pop_front();
+            worker->npinned.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (!worker->jobs.empty())
+        {
+            job.swap(worker->jobs.back());
+            worker->jobs.pop_back();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // The oldest job of other workers, busy ones (locked) are skipped.
+    bool steal(size_t w, Job &job, bool &busy)
+    {
+        size_t n = m_workers.size();
+        for (size_t i = 1; i < n; ++i)
+        {
+            Worker *victim = m_workers[(w + i) % n];
+            std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+            if (!lock.owns_lock())
+            {
+                busy = true;
+                continue;
+            }
+            if (victim->jobs.empty())
+                continue;
+            job.swap(victim->jobs.front());
+            victim->jobs.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            m_stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Own or stolen job. If there are queued jobs but their workers are
+    // busy then back off (yield, then sleep) instead of spinning.
+    bool next(size_t w, Job &job)
+    {
+        for (int spins = 0;; ++spins)
+        {
+            bool busy = false;
+            if (pop(w, job) || steal(w, job, busy))
+                return true;
+            if (!busy || m_queued.load(std::memory_order_acquire) == 0)
+                return false;
+            if (spins < 16)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    void run(size_t w)
+    {
+        current().sched = this;
+        current().index = w;
+
+        lua_State *L = luaL_newstate();
+        m_setup(L);
+        lua_settop(L, 0);
+
+        Worker *worker = m_workers[w];
+        worker->L = L;
+        Job job;
+        for (;;)
+        {
+            if (next(w, job))
+            {
+                execute(L, job);
+                job = Job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_stop)
+                break;
+            m_cv.wait(lock, [this, worker]() {
+                return m_stop
+                    || m_queued.load(std::memory_order_acquire) > 0
+                    || worker->npinned.load(std::memory_order_acquire) > 0;
+            });
+        }
+
+        lua_close(L);
+    }
+
+    // Run jobs while there are pending jobs which are not waiting,
+    // see wait().
+    void help(size_t w)
+    {
+        Worker *worker = m_workers[w];
+        m_waiting.fetch_add(1, std::memory_order_acq_rel);
+        Job job;
+        for (;;)
+        {
+            if (next(w, job))
+            {
+                execute(worker->L, job);
+                job = Job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (done_but_waiting())
+                break;
+            m_cv.wait(lock, [this, worker]() {
+                return done_but_waiting()
+                    || m_queued.load(std::memory_order_acquire) > 0
+                    || worker->npinned.load(std::memory_order_acquire) > 0;
+            });
+        }
+        m_waiting.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    bool done_but_waiting() const
+    {
+        return m_pending.load(std::memory_order_acquire)
+            <= m_waiting.load(std::memory_order_acquire);
+    }
+
+    // Job runs in protected mode, C++ exceptions are reported in JobCall.
+    // upvalues: JobCall
+    static int run_job(lua_State *L)
+    {
+        JobCall *call = static_cast<JobCall*>(lua_touserdata(L, lua_upvalueindex(1)));
+        try
+        {
+            (*call->job)(L);
+        }
+        catch (const std::exception &e)
+        {
+            call->error = e.what();
+        }
+        return 0;
+    }
+
+    void execute(lua_State *L, Job &job)
+    {
+        int top = lua_gettop(L);
+        JobCall call = {&job, std::string()};
+        try
+        {
+            lua_pushcfunction(L, function_msgh);            // msgh
+            lua_pushlightuserdata(L, &call);
+            lua_pushcclosure(L, run_job, 1);                // msgh run_job
+            if (lua_pcall(L, 0, 0, top + 1) != 0)
+            {
+                const char *msg = lua_tostring(L, -1);
+                error(msg ? msg : "Unknown error");
+            }
+            else if (!call.error.empty())
+                error(call.error);
+        }
+        catch (...)
+        {
+            error("Unknown error");
+        }
+        lua_settop(L, top);
+
+        m_executed.fetch_add(1, std::memory_order_relaxed);
+        size_t left = m_pending.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        bool waiting = m_waiting.load(std::memory_order_acquire) > 0;
+        if (left == 0 || waiting)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (left == 0)
+                m_done_cv.notify_all();
+            if (waiting)
+                m_cv.notify_all();
+        }
+    }
+
+    Setup m_setup;
+    std::vector<Worker*> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_done_cv;
+    bool m_stop;
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_queued;       // Stealable jobs in the deques.
+    std::atomic<size_t> m_pending;      // Queued and running jobs.
+    std::atomic<size_t> m_waiting;      // Jobs blocked in wait().
+    std::atomic<uint64_t> m_executed;
+    std::atomic<uint64_t> m_stolen;
+    std::atomic<uint64_t> m_errors;
+    std::string m_last_error;
+};
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_SCHEDULER_H
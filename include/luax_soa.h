@@ -0,0 +1,146 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_SOA_H
+#define LUAX_SOA_H
+
+#include <vector>
+
+#include "luax.h"
+#include "luax_array.h"
+
+// Struct of arrays binding: std::vector<E> members of the container are
+// exposed as properties which return array views (see luax_array.h), so
+// scripts process whole columns with array methods:
+//
+//  struct World
+//  {
+//      std::vector<float> pos_x, vel_x;
+//  };
+//
+//  LUAX_PROPERTIES_BEGIN(World)
+//      LUAX_SOA_COLUMN(World, pos_x)
+//      LUAX_SOA_COLUMN(World, vel_x)
+//  LUAX_PROPERTIES_END
+//
+//  world.pos_x:axpy(dt, world.vel_x)
+//
+// Column view keeps the container userdata alive. Views are cached per
+// (object, column) in the keep table, so repeated reads return the same
+// userdata; cached view is updated on each read if the vector was resized
+// on C++ side, but views stored by scripts between frames may be stale.
+// Scripts can't resize columns: assignment copies into the existing storage.
+
+#define LUAX_SOA_COLUMN(cls, col)                                           \
+    {#col, luax::soa_get<cls, decltype(cls::col), &cls::col>,               \
+     luax::soa_set<cls, decltype(cls::col), &cls::col>},
+
+namespace luax
+{
+
+// Address of the variable is used as key of the column in the views cache.
+template <typename T, typename V, V T::*M>
+inline void* soa_key()
+{
+    static char key;
+    return &key;
+}
+//------------------------------------------------------------------------------
+
+// Push views cache of the object at the index: keep[obj] = {[key] = view}.
+// Views are weak, so the cache doesn't keep them (and the object) alive.
+// stack: -> views
+inline void soa_views(lua_State *L, int index)
+{
+    push_array_refs(L);                                 // keep
+    lua_pushvalue(L, index);
+    lua_rawget(L, -2);                                  // keep views
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);                                // keep views
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, index);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);                              // keep[obj] = views
+    }
+    lua_remove(L, -2);                                  // views
+}
+//------------------------------------------------------------------------------
+
+// Getter: cached view of the column.
+template <typename T, typename V, V T::*M>
+inline int soa_get(lua_State *L)
+{
+    typedef typename V::value_type E;
+    V &col = type<T>::check_cast(L, 1)->*M;
+    soa_views(L, 1);                                    // views
+    rawgetp(L, -1, soa_key<T, V, M>());                 // views view
+    if (!lua_isnil(L, -1))
+    {
+        // Column may be resized since the view is created.
+        *type<Array<E> >::get(L, -1) = Array<E>(col.data(), col.size());
+        return 1;
+    }
+    lua_pop(L, 1);                                      // views
+    push_array(L, col.data(), col.size());              // views view
+    array_keep(L, -1, 1);
+    lua_pushvalue(L, -1);
+    rawsetp(L, -3, soa_key<T, V, M>());                 // views[key] = view
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Setter: number fills the column, array of the same type and size replaces
+// the column content. Storage is kept, so outstanding views stay valid.
+template <typename T, typename V, V T::*M>
+inline int soa_set(lua_State *L)
+{
+    typedef typename V::value_type E;
+    V &col = type<T>::check_cast(L, 1)->*M;
+    if (lua_type(L, 2) == LUA_TNUMBER)
+    {
+        E v = array_check<E>(L, 2);
+        for (size_t i = 0; i < col.size(); ++i)
+            col[i] = v;
+    }
+    else
+    {
+        Array<E> *src = type<Array<E> >::check_cast(L, 2);
+        if (src->size() != col.size())
+            return luaL_error(L, "column size mismatch: %d, expected %d",
+                              static_cast<int>(src->size()),
+                              static_cast<int>(col.size()));
+        // Source may be a view of the same column.
+        if (!col.empty())
+            memmove(col.data(), src->data(), col.size() * sizeof(E));
+    }
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_SOA_H
@@ -0,0 +1,265 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_SPAN_H
+#define LUAX_SPAN_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "luax.h"
+#include "luax_bind.h"
+#include "luax_utils.h"
+
+// Define span type for the element type U:
+//
+//  LUAX_SPAN(float, "FloatSpan")
+//  ...
+//  luax::type<luax::Span<float> >::register_in(L);
+//  luax::push_span(L, vec);
+#define LUAX_SPAN(U, name)                                                  \
+    LUAX_TYPE_NAME(luax::Span<U>, name)                                     \
+    namespace luax {                                                        \
+        template <> void type<Span<U> >::usr_instance_mt(lua_State *L)      \
+        {                                                                   \
+            span_mt<U>(L);                                                  \
+        }                                                                   \
+    }
+
+namespace luax
+{
+
+/**
+ * Non owning view of std::vector<U> or contiguous range of U.
+ *
+ * Vector based span follows the vector size, so elements may be added
+ * on C++ side. Data must outlive the span (same as for type::push()
+ * without GC).
+ */
+template <typename U>
+class Span
+{
+public:
+    explicit Span(std::vector<U> &vec):
+        m_vec(&vec), m_data(0), m_size(0), m_readonly(false) {}
+
+    explicit Span(const std::vector<U> &vec):
+        m_vec(const_cast<std::vector<U>*>(&vec)), m_data(0), m_size(0),
+        m_readonly(true) {}
+
+    Span(U *data, size_t size):
+        m_vec(0), m_data(data), m_size(size), m_readonly(false) {}
+
+    Span(const U *data, size_t size):
+        m_vec(0), m_data(const_cast<U*>(data)), m_size(size),
+        m_readonly(true) {}
+
+    U* data() const { return m_vec ? m_vec->data() : m_data; }
+    size_t size() const { return m_vec ? m_vec->size() : m_size; }
+    bool readonly() const { return m_readonly; }
+
+private:
+    std::vector<U> *m_vec;
+    U *m_data;
+    size_t m_size;
+    bool m_readonly;
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Span element conversion.
+ *
+ * Default implementation uses luax::push() and luax::checkget(),
+ * bound classes are pushed by reference (without GC).
+ */
+template <typename U, typename Enable = void>
+struct span_element
+{
+    static void push(lua_State *L, U &v)
+    {
+        luax::push(L, v);
+    }
+
+    static void set(lua_State *L, int index, U &v)
+    {
+        v = checkget<U>(L, index);
+    }
+};
+//------------------------------------------------------------------------------
+
+template <typename U>
+struct span_element<U, typename std::enable_if<is_bound<U>::value>::type>
+{
+    static void push(lua_State *L, U &v)
+    {
+        type<U>::push(L, &v, false);
+    }
+
+    static void set(lua_State *L, int index, U &v)
+    {
+        v = *type<U>::check_cast(L, index);
+    }
+};
+//------------------------------------------------------------------------------
+
+// Return element at the lua index or null if index is out of range.
+template <typename U>
+inline U* span_at(lua_State *L, Span<U> *s, int index)
+{
+    if (lua_type(L, index) != LUA_TNUMBER)
+        return 0;
+    lua_Number n = lua_tonumber(L, index);
+    if (n < 1 || n > static_cast<lua_Number>(s->size()))
+        return 0;
+    size_t i = static_cast<size_t>(n) - 1;
+    if (static_cast<lua_Number>(i + 1) != n)
+        return 0;
+    return s->data() + i;
+}
+//------------------------------------------------------------------------------
+
+// stack: span key
+template <typename U>
+inline int span_index(lua_State *L)
+{
+    Span<U> *s = type<Span<U> >::check_cast(L, 1);
+    if (U *v = span_at(L, s, 2))
+    {
+        span_element<U>::push(L, *v);
+        return 1;
+    }
+
+    // Methods.
+    if (lua_type(L, 2) == LUA_TSTRING)
+    {
+        lua_getmetatable(L, 1);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return 1;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// stack: span key value
+template <typename U>
+inline int span_newindex(lua_State *L)
+{
+    Span<U> *s = type<Span<U> >::check_cast(L, 1);
+    if (s->readonly())
+        return luaL_error(L, "%s is read only", type<Span<U> >::usr_name());
+    U *v = span_at(L, s, 2);
+    if (!v)
+        return luaL_error(L, "%s index is out of range", type<Span<U> >::usr_name());
+    span_element<U>::set(L, 3, *v);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+template <typename U>
+inline int span_len(lua_State *L)
+{
+    Span<U> *s = type<Span<U> >::check_cast(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(s->size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Iterator function: (span, i) -> i + 1, span[i + 1].
+template <typename U>
+inline int span_next(lua_State *L)
+{
+    Span<U> *s = type<Span<U> >::check_cast(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2) + 1;
+    if (i < 1 || static_cast<size_t>(i) > s->size())
+        return 0;
+    lua_pushinteger(L, i);
+    span_element<U>::push(L, s->data()[static_cast<size_t>(i) - 1]);
+    return 2;
+}
+//------------------------------------------------------------------------------
+
+// for i, v in span:items() do ... end
+template <typename U>
+inline int span_items(lua_State *L)
+{
+    type<Span<U> >::check_cast(L, 1);
+    lua_pushcfunction(L, span_next<U>);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    return 3;
+}
+//------------------------------------------------------------------------------
+
+// Setup span instance metatable.
+// stack: mt
+template <typename U>
+inline void span_mt(lua_State *L)
+{
+    lua_pushcfunction(L, span_index<U>);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, span_newindex<U>);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, span_len<U>);
+    lua_setfield(L, -2, "__len");
+    lua_pushcfunction(L, span_items<U>);
+    lua_setfield(L, -2, "__ipairs");
+    lua_pushcfunction(L, span_items<U>);
+    lua_setfield(L, -2, "__pairs");
+    lua_pushcfunction(L, span_items<U>);
+    lua_setfield(L, -2, "items");
+}
+//------------------------------------------------------------------------------
+
+/** Push span of the vector, const vector gives read only span. */
+template <typename U>
+inline int push_span(lua_State *L, std::vector<U> &vec)
+{
+    return type<Span<U> >::push_value(L, Span<U>(vec));
+}
+
+template <typename U>
+inline int push_span(lua_State *L, const std::vector<U> &vec)
+{
+    return type<Span<U> >::push_value(L, Span<U>(vec));
+}
+//------------------------------------------------------------------------------
+
+/** Push span of the range, const data gives read only span. */
+template <typename U>
+inline int push_span(lua_State *L, U *data, size_t size)
+{
+    return type<Span<U> >::push_value(L, Span<U>(data, size));
+}
+
+template <typename U>
+inline int push_span(lua_State *L, const U *data, size_t size)
+{
+    return type<Span<U> >::push_value(L, Span<U>(data, size));
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_SPAN_H
@@ -0,0 +1,396 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_STATE_POOL_H
+#define LUAX_STATE_POOL_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "luax.h"
+
+namespace luax
+{
+
+/**
+ * Pool of prepared lua states.
+ *
+ * States are created with the setup function (open libs, luax::init(),
+ * register types, load scripts), then handed out to the threads:
+ *
+ *  luax::StatePool pool([](lua_State *L) {
+ *      luaL_openlibs(L);
+ *      luax::init(L);
+ *      luax::type<Point>::register_in(L);
+ *  }, 4);
+ *
+ *  {
+ *      luax::StatePool::Lease L = pool.lease();
+ *      luaL_dostring(L, "...");
+ *  } // state is reset and returned to the pool
+ *
+ * On return globals and package.loaded are restored to the state right
+ * after setup: new names are removed, replaced ones are restored, then
+ * incremental GC step is done (full collect if pool is created with
+ * full_gc = true). Registry (luax metatables, LUAX_UDATA caches) is
+ * kept. Changes inside the tables (string.x = 1) are not reverted.
+ *
+ * Setup and reset run in protected mode. If setup fails checkout() returns
+ * 0, if reset fails the state is closed instead of returning to the pool;
+ * last_error() keeps the message.
+ *
+ * All states must be returned before the pool is destroyed.
+ */
+class StatePool
+{
+public:
+    typedef std::function<void(lua_State*)> Setup;
+
+    struct Stats
+    {
+        size_t size;                // States owned by the pool.
+        size_t idle;                // States ready for checkout.
+        uint64_t created;           // States created by the pool.
+        uint64_t failures;          // Failed setups and resets.
+        uint64_t checkouts;         // Number of checkouts.
+        uint64_t misses;            // Checkouts which created new state.
+        uint64_t checkout_ns;       // Total checkout time.
+        uint64_t checkout_max_ns;   // Max checkout time.
+    };
+
+    /** RAII checkout, returns the state to the pool on destruction. */
+    class Lease
+    {
+    public:
+        Lease(StatePool *pool, lua_State *L): m_pool(pool), L(L) {}
+        Lease(Lease &&other): m_pool(other.m_pool), L(other.L)
+        {
+            other.L = 0;
+        }
+        ~Lease() { if (L) m_pool->checkin(L); }
+
+        lua_State* get() const { return L; }
+        operator lua_State*() const { return L; }
+
+    private:
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+        Lease& operator=(Lease&&);
+
+        StatePool *m_pool;
+        lua_State *L;
+    };
+
+    /**
+     * Create pool with n prepared states.
+     * If full_gc is true then full garbage collection is done on each checkin.
+     */
+    explicit StatePool(Setup setup, size_t n = 0, bool full_gc = false)
+        : m_setup(setup)
+        , m_full_gc(full_gc)
+    {
+        Stats empty = {0, 0, 0, 0, 0, 0, 0, 0};
+        m_stats = empty;
+        reserve(n);
+    }
+
+    ~StatePool()
+    {
+        shrink(0);
+    }
+
+    /**
+     * Make sure there are at least n idle states.
+     * Returns false if state can't be created.
+     */
+    bool reserve(size_t n)
+    {
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_idle.size() >= n)
+                    return true;
+            }
+            lua_State *L = create();
+            if (!L)
+                return false;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_idle.push_back(L);
+        }
+    }
+
+    /** Close idle states above n. */
+    void shrink(size_t n)
+    {
+        std::vector<lua_State*> drop;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (m_idle.size() > n)
+            {
+                drop.push_back(m_idle.back());
+                m_idle.pop_back();
+            }
+            m_stats.size -= drop.size();
+        }
+        for (size_t i = 0; i < drop.size(); ++i)
+            lua_close(drop[i]);
+    }
+
+    /** Take a state, new one is created if pool is empty (0 on failure). */
+    lua_State* checkout()
+    {
+        uint64_t start = now_ns();
+        lua_State *L = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_idle.empty())
+            {
+                L = m_idle.back();
+                m_idle.pop_back();
+            }
+        }
+        bool miss = L == 0;
+        if (miss && (L = create()) == 0)
+            return 0;
+
+        uint64_t ns = now_ns() - start;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.checkouts;
+        if (miss)
+            ++m_stats.misses;
+        m_stats.checkout_ns += ns;
+        if (ns > m_stats.checkout_max_ns)
+            m_stats.checkout_max_ns = ns;
+        return L;
+    }
+
+    Lease lease() { return Lease(this, checkout()); }
+
+    /** Reset the state and return it to the pool, close it if reset fails. */
+    void checkin(lua_State *L)
+    {
+        if (!reset(L, m_full_gc))
+        {
+            error(L);
+            lua_close(L);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_stats.size;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(L);
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s = m_stats;
+        s.idle = m_idle.size();
+        return s;
+    }
+
+    std::string last_error() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_last_error;
+    }
+
+    /**
+     * Restore globals and package.loaded to the snapshot made by the pool.
+     * Returns false on error, error message is left on the stack.
+     */
+    static bool reset(lua_State *L, bool full_gc = false)
+    {
+        lua_settop(L, 0);
+        lua_pushcfunction(L, restore);
+        if (lua_pcall(L, 0, 0, 0) != 0)
+            return false;
+        lua_gc(L, full_gc ? LUA_GCCOLLECT : LUA_GCSTEP, 0);
+        return true;
+    }
+
+private:
+    StatePool(const StatePool&);
+    StatePool& operator=(const StatePool&);
+
+    static uint64_t now_ns()
+    {
+        typedef std::chrono::steady_clock Clock;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count());
+    }
+
+    static void* snapshot_key()
+    {
+        static char key;
+        return &key;
+    }
+
+    // Protected part of reset().
+    static int restore(lua_State *L)
+    {
+        rawgetp(L, LUA_REGISTRYINDEX, snapshot_key());  // snap
+        if (!lua_istable(L, 1))
+            return 0;
+
+        pushglobaltable(L);                             // snap G
+        lua_rawgeti(L, 1, 1);                           // snap G copy
+        restore_table(L, 2, 3);
+        lua_rawgeti(L, 1, 3);                           // snap G copy mt
+        if (lua_istable(L, -1))
+            lua_setmetatable(L, 2);
+        else
+        {
+            lua_pop(L, 1);
+            lua_pushnil(L);
+            lua_setmetatable(L, 2);
+        }
+        lua_settop(L, 1);                               // snap
+
+        lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");  // snap loaded
+        lua_rawgeti(L, 1, 2);                           // snap loaded copy
+        if (lua_istable(L, 2) && lua_istable(L, 3))
+            restore_table(L, 2, 3);
+        return 0;
+    }
+
+    // stack: -> copy of the table at the index
+    static void copy_table(lua_State *L, int index)
+    {
+        lua_newtable(L);                                // copy
+        lua_pushnil(L);
+        while (lua_next(L, index))                      // copy key val
+        {
+            lua_pushvalue(L, -2);                       // copy key val key
+            lua_insert(L, -2);                          // copy key key val
+            lua_rawset(L, -4);                          // copy key
+        }
+    }
+
+    // Make the table 'tbl' equal to the table 'copy' (shallow).
+    static void restore_table(lua_State *L, int tbl, int copy)
+    {
+        // Clearing existing fields is allowed during traversal.
+        lua_pushnil(L);
+        while (lua_next(L, tbl))                        // key val
+        {
+            lua_pop(L, 1);                              // key
+            lua_pushvalue(L, -1);                       // key key
+            lua_rawget(L, copy);                        // key val
+            if (lua_isnil(L, -1))
+            {
+                lua_pushvalue(L, -2);                   // key nil key
+                lua_insert(L, -2);                      // key key nil
+                lua_rawset(L, tbl);                     // key
+            }
+            else
+                lua_pop(L, 1);                          // key
+        }
+
+        lua_pushnil(L);
+        while (lua_next(L, copy))                       // key val
+        {
+            lua_pushvalue(L, -2);                       // key val key
+            lua_insert(L, -2);                          // key key val
+            lua_rawset(L, tbl);                         // key
+        }
+    }
+
+    // Runs the setup (upvalue) and makes the snapshot.
+    static int prepare(lua_State *L)
+    {
+        Setup *setup = static_cast<Setup*>(lua_touserdata(L, lua_upvalueindex(1)));
+        (*setup)(L);
+        lua_settop(L, 0);
+
+        lua_createtable(L, 3, 0);                       // snap
+        pushglobaltable(L);                             // snap G
+        copy_table(L, 2);                               // snap G copy
+        lua_rawseti(L, 1, 1);                           // snap G
+        if (lua_getmetatable(L, 2))                     // snap G mt
+            lua_rawseti(L, 1, 3);                       // snap G
+        lua_pop(L, 1);                                  // snap
+
+        lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");  // snap loaded
+        if (lua_istable(L, 2))
+        {
+            copy_table(L, 2);                           // snap loaded copy
+            lua_rawseti(L, 1, 2);                       // snap loaded
+        }
+        lua_pop(L, 1);                                  // snap
+        rawsetp(L, LUA_REGISTRYINDEX, snapshot_key());
+        return 0;
+    }
+
+    lua_State* create()
+    {
+        lua_State *L = luaL_newstate();
+        if (!L)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.failures;
+            m_last_error = "Can't create lua state";
+            return 0;
+        }
+
+        lua_pushlightuserdata(L, &m_setup);
+        lua_pushcclosure(L, prepare, 1);
+        if (lua_pcall(L, 0, 0, 0) != 0)
+        {
+            error(L);
+            lua_close(L);
+            return 0;
+        }
+        lua_settop(L, 0);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.size;
+        ++m_stats.created;
+        return L;
+    }
+
+    // Record the error message from the top of the stack.
+    void error(lua_State *L)
+    {
+        const char *msg = lua_tostring(L, -1);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.failures;
+        m_last_error = msg ? msg : "Unknown error";
+    }
+
+    Setup m_setup;
+    bool m_full_gc;
+    mutable std::mutex m_mutex;
+    std::vector<lua_State*> m_idle;
+    Stats m_stats;
+    std::string m_last_error;
+};
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_STATE_POOL_H
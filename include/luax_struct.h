@@ -0,0 +1,365 @@
+// The MIT License
+//
+// Copyright (c) 2015 Sergey Kozlov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LUAX_STRUCT_H
+#define LUAX_STRUCT_H
+
+#include <map>
+#include <new>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "luax_utils.h"
+
+// Plain structs <-> lua tables conversion.
+//
+// Fields are declared once, the macro specializes luax::push() and
+// luax::get() for the struct:
+//
+//  struct Config
+//  {
+//      std::string host;
+//      int port;
+//      std::vector<int> ids;
+//  };
+//
+//  LUAX_STRUCT(Config, (host)(port)(ids))
+//
+//  luax::push(L, cfg);                     // {host = ..., port = ..., ids = {...}}
+//  Config cfg = luax::get<Config>(L, -1);
+//
+// Field names are interned once per lua state with luax::Key, tables are
+// preallocated. Fields may be basic types, std::string, other
+// reflected structs, std::vector, std::map and std::unordered_map of them.
+// Missing (nil) fields are left default on decoding.
+//
+// Use the macro in the global namespace.
+
+#define LUAX_STRUCT(cls, seq)                                               \
+    namespace luax {                                                        \
+        template <> struct struct_info<cls>                                 \
+        {                                                                   \
+            enum { reflected = 1 };                                         \
+            enum { count = 0 LUAX_STRUCT_SEQ(LUAX_STRUCT_COUNT_A, seq) };   \
+                                                                            \
+            static const char* names()                                      \
+            {                                                               \
+                return LUAX_STRUCT_SEQ(LUAX_STRUCT_NAME_A, seq) "";         \
+            }                                                               \
+                                                                            \
+            template <typename O, typename V>                               \
+            static void fields(O &obj, V &v)                                \
+            {                                                               \
+                LUAX_STRUCT_SEQ(LUAX_STRUCT_FIELD_A, seq)                   \
+            }                                                               \
+        };                                                                  \
+        template <> inline void push(lua_State *L, cls v)                   \
+        {                                                                   \
+            struct_push(L, v);                                              \
+        }                                                                   \
+        template <> inline cls get(lua_State *L, int idx)                   \
+        {                                                                   \
+            cls v;                                                          \
+            struct_get(L, idx, v);                                          \
+            return v;                                                       \
+        }                                                                   \
+    }
+
+// Sequence (a)(b)(c) iteration: A and B expand each other until the end
+// of the sequence, then the trailing A/B is pasted with _END.
+#define LUAX_STRUCT_CAT(a, b) LUAX_STRUCT_CAT_I(a, b)
+#define LUAX_STRUCT_CAT_I(a, b) a ## b
+#define LUAX_STRUCT_SEQ(m, seq) LUAX_STRUCT_CAT(m seq, _END)
+
+#define LUAX_STRUCT_FIELD_A(x) v(#x, obj.x); LUAX_STRUCT_FIELD_B
+#define LUAX_STRUCT_FIELD_B(x) v(#x, obj.x); LUAX_STRUCT_FIELD_A
+#define LUAX_STRUCT_FIELD_A_END
+#define LUAX_STRUCT_FIELD_B_END
+
+// Field names list: "a\0b\0c\0" (terminated by empty name).
+#define LUAX_STRUCT_NAME_A(x) #x "\0" LUAX_STRUCT_NAME_B
+#define LUAX_STRUCT_NAME_B(x) #x "\0" LUAX_STRUCT_NAME_A
+#define LUAX_STRUCT_NAME_A_END
+#define LUAX_STRUCT_NAME_B_END
+
+#define LUAX_STRUCT_COUNT_A(x) + 1 LUAX_STRUCT_COUNT_B
+#define LUAX_STRUCT_COUNT_B(x) + 1 LUAX_STRUCT_COUNT_A
+#define LUAX_STRUCT_COUNT_A_END
+#define LUAX_STRUCT_COUNT_B_END
+
+namespace luax
+{
+
+// Field list of the struct, see LUAX_STRUCT().
+template <typename T>
+struct struct_info
+{
+    enum { reflected = 0 };
+};
+
+template <typename T> inline void struct_push(lua_State *L, const T &v);
+template <typename T> inline void struct_get(lua_State *L, int idx, T &v);
+
+//------------------------------------------------------------------------------
+// Field values conversion.
+//------------------------------------------------------------------------------
+
+template <typename T, bool Reflected = struct_info<T>::reflected != 0>
+struct struct_value
+{
+    static void push(lua_State *L, const T &v) { luax::push(L, v); }
+    static void get(lua_State *L, int idx, T &v) { v = luax::get<T>(L, idx); }
+};
+
+template <typename T>
+struct struct_value<T, true>
+{
+    static void push(lua_State *L, const T &v) { struct_push(L, v); }
+    static void get(lua_State *L, int idx, T &v) { struct_get(L, idx, v); }
+};
+
+template <typename E, typename A>
+struct struct_value<std::vector<E, A>, false>
+{
+    static void push(lua_State *L, const std::vector<E, A> &v)
+    {
+        lua_createtable(L, static_cast<int>(v.size()), 0);
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            struct_value<E>::push(L, v[i]);
+            lua_rawseti(L, -2, static_cast<int>(i + 1));
+        }
+    }
+
+    static void get(lua_State *L, int idx, std::vector<E, A> &v)
+    {
+        if (!lua_istable(L, idx))
+            return;
+        if (idx < 0)
+            idx = lua_gettop(L) + idx + 1;
+        size_t n = rawlen(L, idx);
+        v.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            lua_rawgeti(L, idx, static_cast<int>(i + 1));
+            struct_value<E>::get(L, -1, v[i]);
+            lua_pop(L, 1);
+        }
+    }
+};
+
+// std::map and std::unordered_map.
+template <typename M>
+struct struct_map_value
+{
+    typedef typename M::key_type K;
+    typedef typename M::mapped_type V;
+
+    static void push(lua_State *L, const M &m)
+    {
+        lua_createtable(L, 0, static_cast<int>(m.size()));
+        for (typename M::const_iterator it = m.begin(); it != m.end(); ++it)
+        {
+            struct_value<K>::push(L, it->first);
+            struct_value<V>::push(L, it->second);
+            lua_rawset(L, -3);
+        }
+    }
+
+    static void get(lua_State *L, int idx, M &m)
+    {
+        if (!lua_istable(L, idx))
+            return;
+        if (idx < 0)
+            idx = lua_gettop(L) + idx + 1;
+        m.clear();
+        lua_pushnil(L);
+        while (lua_next(L, idx))                    // key val
+        {
+            // Convert copy of the key, lua_tostring() would break lua_next().
+            K k;
+            lua_pushvalue(L, -2);                   // key val key
+            struct_value<K>::get(L, -1, k);
+            struct_value<V>::get(L, -2, m[k]);
+            lua_pop(L, 2);                          // key
+        }
+    }
+};
+
+template <typename K, typename V, typename C, typename A>
+struct struct_value<std::map<K, V, C, A>, false>:
+    struct_map_value<std::map<K, V, C, A> > {};
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct struct_value<std::unordered_map<K, V, H, E, A>, false>:
+    struct_map_value<std::unordered_map<K, V, H, E, A> > {};
+//------------------------------------------------------------------------------
+
+// True if T is decoded from a lua table: reflected structs and containers.
+template <typename T>
+struct struct_table
+{
+    enum { value = struct_info<T>::reflected };
+};
+
+template <typename E, typename A>
+struct struct_table<std::vector<E, A> > { enum { value = 1 }; };
+
+template <typename K, typename V, typename C, typename A>
+struct struct_table<std::map<K, V, C, A> > { enum { value = 1 }; };
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct struct_table<std::unordered_map<K, V, H, E, A> > { enum { value = 1 }; };
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Struct conversion.
+//------------------------------------------------------------------------------
+
+typedef std::vector<Key> StructKeys;
+
+inline int struct_keys_gc(lua_State *L)
+{
+    static_cast<StructKeys*>(lua_touserdata(L, 1))->~StructKeys();
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Registry key of the metatable of the keys userdata.
+inline void* struct_keys_mt_key()
+{
+    static char key;
+    return &key;
+}
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void* struct_keys_key()
+{
+    static char key;
+    return &key;
+}
+//------------------------------------------------------------------------------
+
+// Return interned field names of T, created once per state from
+// struct_info<T>::names() and anchored in the registry.
+template <typename T>
+inline const Key* struct_keys(lua_State *L)
+{
+    rawgetp(L, LUA_REGISTRYINDEX, struct_keys_key<T>());
+    StructKeys *keys = static_cast<StructKeys*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    if (keys)
+        return keys->data();
+
+    keys = new (lua_newuserdata(L, sizeof(StructKeys))) StructKeys();  // ud
+    rawgetp(L, LUA_REGISTRYINDEX, struct_keys_mt_key());        // ud mt
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, struct_keys_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1);
+        rawsetp(L, LUA_REGISTRYINDEX, struct_keys_mt_key());
+    }
+    lua_setmetatable(L, -2);                                    // ud
+
+    // Registered only when complete, on error the userdata is collected.
+    keys->reserve(struct_info<T>::count);
+    for (const char *name = struct_info<T>::names(); *name;
+         name += strlen(name) + 1)
+        keys->emplace_back(L, name);
+    rawsetp(L, LUA_REGISTRYINDEX, struct_keys_key<T>());
+    return keys->data();
+}
+//------------------------------------------------------------------------------
+
+// stack: tbl
+struct struct_push_visitor
+{
+    lua_State *L;
+    const Key *keys;
+
+    template <typename F>
+    void operator()(const char*, const F &field)
+    {
+        (keys++)->push();                           // tbl name
+        struct_value<F>::push(L, field);            // tbl name val
+        lua_rawset(L, -3);                          // tbl
+    }
+};
+//------------------------------------------------------------------------------
+
+// stack: tbl
+struct struct_get_visitor
+{
+    lua_State *L;
+    const Key *keys;
+
+    template <typename F>
+    void operator()(const char*, F &field)
+    {
+        (keys++)->push();                           // tbl name
+        lua_rawget(L, -2);                          // tbl val
+        if (!lua_isnil(L, -1))
+            struct_value<F>::get(L, -1, field);
+        lua_pop(L, 1);
+    }
+};
+//------------------------------------------------------------------------------
+
+/** Push table with the fields of reflected struct. */
+template <typename T>
+inline void struct_push(lua_State *L, const T &v)
+{
+    const Key *keys = struct_keys<T>(L);
+    lua_createtable(L, 0, struct_info<T>::count);   // tbl
+    struct_push_visitor visitor = {L, keys};
+    struct_info<T>::fields(v, visitor);
+}
+//------------------------------------------------------------------------------
+
+/**
+ * Fill reflected struct from the table at the index.
+ * Fields missing in the table are not changed.
+ */
+template <typename T>
+inline void struct_get(lua_State *L, int idx, T &v)
+{
+    if (!lua_istable(L, idx))
+        return;
+    const Key *keys = struct_keys<T>(L);
+    lua_pushvalue(L, idx);                          // tbl
+    struct_get_visitor visitor = {L, keys};
+    struct_info<T>::fields(v, visitor);
+    lua_pop(L, 1);
+}
+//------------------------------------------------------------------------------
+
+} // namespace luax
+
+#endif // LUAX_STRUCT_H
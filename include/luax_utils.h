@@ -459,6 +459,278 @@ inline void rawset_field(lua_State *L, int index, const char *name, T v)
     lua_rawset(L, index < 0 ? index - 2: index);
 }
 //------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Ref
+//------------------------------------------------------------------------------
+
+/**
+ * Registry reference to the value.
+ * Movable RAII handle, must be destroyed before the lua state.
+ *
+ *  luax::Ref cfg(L, -1);
+ *  cfg.push();
+ */
+class Ref
+{
+public:
+    Ref(): L(0), m_ref(LUA_NOREF) {}
+
+    /** Reference the value at the index. */
+    Ref(lua_State *L, int index): L(L)
+    {
+        lua_pushvalue(L, index);
+        m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    Ref(Ref &&other): L(other.L), m_ref(other.m_ref)
+    {
+        other.L = 0;
+        other.m_ref = LUA_NOREF;
+    }
+
+    Ref& operator=(Ref &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            L = other.L;
+            m_ref = other.m_ref;
+            other.L = 0;
+            other.m_ref = LUA_NOREF;
+        }
+        return *this;
+    }
+
+    ~Ref() { reset(); }
+
+    void reset()
+    {
+        if (L)
+            luaL_unref(L, LUA_REGISTRYINDEX, m_ref);
+        L = 0;
+        m_ref = LUA_NOREF;
+    }
+
+    bool valid() const { return L != 0; }
+    lua_State* state() const { return L; }
+
+    /** Push referenced value. */
+    void push() const { lua_rawgeti(L, LUA_REGISTRYINDEX, m_ref); }
+
+    /** Return referenced value. */
+    template <typename T>
+    T get() const
+    {
+        push();
+        T v = luax::get<T>(L, -1);
+        lua_pop(L, 1);
+        return v;
+    }
+
+private:
+    Ref(const Ref&);
+    Ref& operator=(const Ref&);
+
+    lua_State *L;
+    int m_ref;
+};
+
+
+//------------------------------------------------------------------------------
+// Key
+//------------------------------------------------------------------------------
+
+/**
+ * Interned field name.
+ *
+ * Lua string is created once and anchored in the registry, field helpers
+ * push it by reference instead of hashing the name on every call:
+ *
+ *  luax::Key width(L, "width");
+ *  luax::set_field(L, -1, width, 10);
+ *  int w = luax::rawget_field<int>(L, -1, width);
+ *
+ * Key is bound to the lua state it's created for.
+ */
+class Key
+{
+public:
+    Key(lua_State *L, const char *name)
+    {
+        lua_pushstring(L, name);
+        m_ref = Ref(L, -1);
+        lua_pop(L, 1);
+    }
+
+    lua_State* state() const { return m_ref.state(); }
+
+    /** Push the name. */
+    void push() const { m_ref.push(); }
+
+private:
+    Ref m_ref;
+};
+//------------------------------------------------------------------------------
+
+/** Same as luax::get_field() but with interned key. */
+template <typename T>
+inline T get_field(lua_State *L, int index, const Key &key)
+{
+    key.push();
+    lua_gettable(L, index < 0 ? index - 1: index);
+    T v = get<T>(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+//------------------------------------------------------------------------------
+
+/** Same as luax::set_field() but with interned key. */
+template <typename T>
+inline void set_field(lua_State *L, int index, const Key &key, T v)
+{
+    key.push();
+    push(L, v);
+    lua_settable(L, index < 0 ? index - 2: index);
+}
+//------------------------------------------------------------------------------
+
+/** Same as luax::rawget_field() but with interned key. */
+template <typename T>
+inline T rawget_field(lua_State *L, int index, const Key &key)
+{
+    key.push();
+    lua_rawget(L, index < 0 ? index - 1: index);
+    T v = get<T>(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+//------------------------------------------------------------------------------
+
+/** Same as luax::rawset_field() but with interned key. */
+template <typename T>
+inline void rawset_field(lua_State *L, int index, const Key &key, T v)
+{
+    key.push();
+    push(L, v);
+    lua_rawset(L, index < 0 ? index - 2: index);
+}
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// FieldPath
+//------------------------------------------------------------------------------
+
+/**
+ * Handle of the nested global field like "cfg.net.timeout".
+ *
+ * Path is resolved on first access: parent table and leaf key are pinned in
+ * the registry, next accesses are raw reads and writes of the leaf without
+ * name lookups. If scripts replace some table of the path then call
+ * invalidate() to resolve it again.
+ *
+ *  luax::FieldPath timeout(L, "cfg.net.timeout");
+ *  int ms = timeout.get<int>();
+ *  timeout.set(100);
+ */
+class FieldPath
+{
+public:
+    FieldPath(lua_State *L, const char *path): L(L), m_path(path),
+        m_resolved(false) {}
+
+    const std::string& path() const { return m_path; }
+
+    /** Drop resolved tables, path will be resolved on next access. */
+    void invalidate()
+    {
+        m_resolved = false;
+        m_parent.reset();
+        m_key.reset();
+    }
+
+    /**
+     * Resolve the path (does nothing if already resolved).
+     * Return false if some parent is not a table.
+     */
+    bool resolve()
+    {
+        if (m_resolved)
+            return true;
+
+        pushglobaltable(L);                             // tbl
+        size_t start = 0;
+        size_t dot;
+        while ((dot = m_path.find('.', start)) != std::string::npos)
+        {
+            lua_pushlstring(L, m_path.c_str() + start, dot - start);
+            lua_gettable(L, -2);                        // tbl sub
+            lua_remove(L, -2);                          // sub
+            if (!lua_istable(L, -1))
+            {
+                lua_pop(L, 1);
+                return false;
+            }
+            start = dot + 1;
+        }
+        m_parent = Ref(L, -1);
+        lua_pop(L, 1);
+
+        lua_pushlstring(L, m_path.c_str() + start, m_path.size() - start);
+        m_key = Ref(L, -1);
+        lua_pop(L, 1);
+
+        m_resolved = true;
+        return true;
+    }
+
+    /** Push value of the field, nil if path can't be resolved. */
+    void push()
+    {
+        if (!resolve())
+        {
+            lua_pushnil(L);
+            return;
+        }
+        m_parent.push();                                // tbl
+        m_key.push();                                   // tbl key
+        lua_rawget(L, -2);                              // tbl val
+        lua_remove(L, -2);                              // val
+    }
+
+    template <typename T>
+    T get()
+    {
+        push();
+        T v = luax::get<T>(L, -1);
+        lua_pop(L, 1);
+        return v;
+    }
+
+    /** Set value of the field, return false if path can't be resolved. */
+    template <typename T>
+    bool set(T v)
+    {
+        if (!resolve())
+            return false;
+        m_parent.push();                                // tbl
+        m_key.push();                                   // tbl key
+        luax::push(L, v);                               // tbl key val
+        lua_rawset(L, -3);                              // tbl
+        lua_pop(L, 1);
+        return true;
+    }
+
+private:
+    lua_State *L;
+    std::string m_path;
+    bool m_resolved;
+    Ref m_parent;
+    Ref m_key;
+};
+//------------------------------------------------------------------------------
 } // namespace luax
 
 #endif // LUAX_UTILS_H
@@ -0,0 +1,167 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_array.h"
+
+class LuaxArrayTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+        luax::register_arrays(L);
+    }
+};
+
+// Test: SIMD kernels give the same results as scalar ones.
+TEST_F(LuaxArrayTest, kernels)
+{
+    typedef luax::simd::kernels<float> K;
+    typedef luax::simd::scalar_kernels<float> S;
+
+    // Odd size to cover tails.
+    float a[37], b[37];
+    for (int i = 0; i < 37; ++i)
+    {
+        a[i] = static_cast<float>(i % 7) - 3;
+        b[i] = static_cast<float>(i % 5) * 0.5f;
+    }
+
+    EXPECT_FLOAT_EQ(S::sum(a, 37), K::sum(a, 37));
+    EXPECT_FLOAT_EQ(S::dot(a, b, 37), K::dot(a, b, 37));
+    EXPECT_EQ(-3, K::min(a, 37));
+    EXPECT_EQ(3, K::max(a, 37));
+    EXPECT_EQ(-3, K::min(a, 3));
+
+    K::clamp(a, -1, 1, 37);
+    EXPECT_EQ(-1, S::min(a, 37));
+    EXPECT_EQ(1, S::max(a, 37));
+
+    K::add(a, b, 37);
+    K::scale(a, 2, 37);
+    EXPECT_FLOAT_EQ((-1 + 0) * 2, a[0]);
+    EXPECT_FLOAT_EQ((1 + 0.5f) * 2, a[6]);
+
+    int64_t big[3] = {1LL << 40, 1LL << 40, 1};
+    EXPECT_EQ((1LL << 41) + 1, luax::simd::kernels<int64_t>::sum(big, 3));
+
+    typedef luax::simd::kernels<int32_t> KI;
+    typedef luax::simd::scalar_kernels<int32_t> SI;
+    int32_t c[37], d[37], e[37];
+    for (int i = 0; i < 37; ++i)
+    {
+        c[i] = i % 2 ? INT32_MAX - i : INT32_MIN + i;
+        d[i] = i * 1000 - 20000;
+    }
+    EXPECT_EQ(SI::sum(c, 37), KI::sum(c, 37));
+    EXPECT_EQ(SI::min(d, 37), KI::min(d, 37));
+    EXPECT_EQ(SI::max(d, 37), KI::max(d, 37));
+    EXPECT_EQ(-20000, KI::min(d, 3));
+    KI::clamp(d, -5000, 5000, 37);
+    EXPECT_EQ(-5000, SI::min(d, 37));
+    EXPECT_EQ(5000, SI::max(d, 37));
+
+    // Wraps around as scalar code.
+    KI::add(c, 1, 37);
+    EXPECT_EQ(INT32_MAX, c[1]);
+    memcpy(e, c, sizeof(c));
+    SI::add(e, c, 37);
+    KI::add(c, c, 37);
+    EXPECT_EQ(0, memcmp(e, c, sizeof(c)));
+}
+//------------------------------------------------------------------------------
+
+// Test: view of C++ memory.
+TEST_F(LuaxArrayTest, wrap)
+{
+    std::vector<double> v(5);
+    for (size_t i = 0; i < v.size(); ++i)
+        v[i] = static_cast<double>(i + 1);
+
+    luax::push_array(L, v.data(), v.size());
+    lua_setglobal(L, "a");
+
+    EXPECT_SCRIPT("assert(#a == 5 and a[1] == 1 and a[5] == 5 and a[6] == nil)");
+    EXPECT_SCRIPT("assert(a:sum() == 15 and a:min() == 1 and a:max() == 5)");
+    EXPECT_SCRIPT("assert(a:dot(a) == 55)");
+
+    EXPECT_SCRIPT("a[1] = 10; a:scale(2):add(1)");
+    EXPECT_EQ(21, v[0]);
+    EXPECT_EQ(5, v[1]);
+    EXPECT_FALSE(runScript("a[6] = 1"));
+
+    // Slice shares memory.
+    EXPECT_SCRIPT("local s = a:slice(2, 3); assert(#s == 2)\n"
+                  "s:fill(0)");
+    EXPECT_EQ(0, v[1]);
+    EXPECT_EQ(0, v[2]);
+    EXPECT_EQ(9, v[3]);
+    EXPECT_FALSE(runScript("a:slice(0)"));
+    EXPECT_FALSE(runScript("a:slice(2, 6)"));
+    EXPECT_SCRIPT("assert(#a:slice(6) == 0)");
+}
+//------------------------------------------------------------------------------
+
+// Test: arrays created on lua side own the elements.
+TEST_F(LuaxArrayTest, owned)
+{
+    EXPECT_SCRIPT("a = Float32Array(100); assert(#a == 100 and a:sum() == 0)");
+    EXPECT_SCRIPT("for i = 1, #a do a[i] = i end; assert(a:sum() == 5050)");
+    EXPECT_SCRIPT("local b = a:copy(); b:add(a); assert(b[100] == 200 and a[100] == 100)");
+    EXPECT_SCRIPT("a:clamp(10, 20); assert(a:min() == 10 and a:max() == 20)");
+
+    EXPECT_SCRIPT("b = Int32Array{1, 2, 3}; assert(b:sum() == 6 and b:dot(b) == 14)");
+    EXPECT_SCRIPT("local t = b:totable(); assert(#t == 3 and t[3] == 3)");
+    EXPECT_SCRIPT("local m = b:cmp('<', 2.5); assert(m[2] == 1 and m[3] == 0)");
+    EXPECT_SCRIPT("local m = b:cmp('==', 2^40); assert(m:sum() == 0)");
+    EXPECT_SCRIPT("local m = b:cmp('>=', 2); assert(m[1] == 0 and m[3] == 1)");
+    EXPECT_FALSE(runScript("b:add(Int32Array(2))"));
+    EXPECT_FALSE(runScript("b:add(Float32Array(3))"));
+
+    EXPECT_SCRIPT("local u = Uint8Array{250, 5}; u:add(10); assert(u[1] == 4 and u[2] == 15)");
+    EXPECT_SCRIPT("assert(Int64Array(0):min() == nil)");
+
+    // Slice keeps the parent alive.
+    EXPECT_SCRIPT("s = Float64Array{1, 2, 3, 4}:slice(3); collectgarbage()");
+    EXPECT_SCRIPT("collectgarbage(); assert(s:sum() == 7)");
+
+    double *data = luax::new_array<double>(L, 3);
+    data[2] = 5;
+    lua_setglobal(L, "c");
+    EXPECT_SCRIPT("assert(c[3] == 5 and c[1] == 0)");
+}
+//------------------------------------------------------------------------------
+
+// Test: size of the owned array is checked before allocation.
+TEST_F(LuaxArrayTest, hugeSize)
+{
+    EXPECT_FALSE(runScript("a = Float32Array(2^62)"));
+    EXPECT_FALSE(runScript("a = Int64Array(2^61)"));
+    EXPECT_FALSE(runScript("a = Float64Array(-1)"));
+    EXPECT_SCRIPT("assert(a == nil)");
+    EXPECT_GT(luax::array_max_size<uint8_t>(), luax::array_max_size<double>());
+}
+//------------------------------------------------------------------------------
+
+// Test: integer elements wrap around, float results saturate.
+TEST_F(LuaxArrayTest, integerOverflow)
+{
+    EXPECT_SCRIPT("a = Int32Array{2147483647, -2147483648, 65536, 5}");
+    EXPECT_SCRIPT("local b = a:copy():add(1)\n"
+                  "assert(b[1] == -2147483648 and b[2] == -2147483647)");
+    EXPECT_SCRIPT("local b = a:copy():map('sub', 1); assert(b[2] == 2147483647)");
+    EXPECT_SCRIPT("local b = a:copy():map('mul', a); assert(b[3] == 0)");
+    EXPECT_SCRIPT("local b = a:copy():map('div', -1); assert(b[2] == -2147483648)");
+    EXPECT_SCRIPT("local b = a:copy():scale(1e30)\n"
+                  "assert(b[1] == 2147483647 and b[2] == -2147483648)");
+    EXPECT_SCRIPT("local b = a:copy():scale(0/0); assert(b:sum() == 0)");
+    EXPECT_SCRIPT("local b = a:copy():axpy(-1e20, a)\n"
+                  "assert(b[1] == -2147483648 and b[2] == 2147483647)");
+    EXPECT_SCRIPT("local b = Int64Array{1}:scale(2^70); assert(b[1] > 0)");
+    EXPECT_SCRIPT("local b = Int64Array{2^62, 2^62}; assert(b:sum() == -2^63)");
+    EXPECT_SCRIPT("local b = Int64Array{2^62, 2^62}\n"
+                  "assert(b:dot(Int64Array{2, 0}) == -2^63)");
+    EXPECT_SCRIPT("local b = Int32Array{-2^31, -2^31, -2^31, -2^31, 1}\n"
+                  "assert(b:dot(b) == 1)");
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,231 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_bind.h"
+#include <vector>
+
+class LuaxBindTest: public BaseLuaxTest {};
+
+struct Size
+{
+    int w;
+    int h;
+
+    Size(int w = 0, int h = 0): w(w), h(h) {}
+};
+//------------------------------------------------------------------------------
+
+class Rect
+{
+public:
+    Rect(): x(0), y(0) {}
+
+    int area() const { return m_size.w * m_size.h; }
+
+    void resize(int w, int h)
+    {
+        m_size.w = w;
+        m_size.h = h;
+    }
+
+    double scaled(int k, const std::string &unit) const
+    {
+        return area() * k * (unit == "cm" ? 100 : 1);
+    }
+
+    std::string name() const { return m_name; }
+    void setName(const std::string &name) { m_name = name; }
+
+    // Returns copy.
+    Size size() const { return m_size; }
+    void setSize(const Size &size) { m_size = size; }
+
+    // Returns reference to the member.
+    Size& sizeRef() { return m_size; }
+
+    int x;
+    int y;
+
+private:
+    Size m_size;
+    std::string m_name;
+};
+//------------------------------------------------------------------------------
+
+static int sum(int a, int b) { return a + b; }
+static bool is_empty(const Rect *r) { return r->area() == 0; }
+
+// Not bound classes.
+struct Margin
+{
+    Margin(): left(0), right(0) {}
+
+    int left;
+    int right;
+};
+
+LUAX_STRUCT(Margin, (left)(right))
+
+static int total(const std::vector<int> &v)
+{
+    int res = 0;
+    for (size_t i = 0; i < v.size(); ++i)
+        res += v[i];
+    return res;
+}
+
+static Margin widen(const Margin &m, int k)
+{
+    Margin res;
+    res.left = m.left * k;
+    res.right = m.right * k;
+    return res;
+}
+
+static std::vector<int> range(int n)
+{
+    std::vector<int> res;
+    for (int i = 1; i <= n; ++i)
+        res.push_back(i);
+    return res;
+}
+
+static std::string label(const std::string &name, int n)
+{
+    return name + std::to_string(n);
+}
+
+LUAX_TYPE_NAME(Size, "Size")
+LUAX_TYPE_INPLACE(Size)
+LUAX_PROPERTIES_BEGIN(Size)
+    LUAX_PROPERTY("w", LUAX_BIND(&Size::w), LUAX_BIND(&Size::w))
+    LUAX_PROPERTY("h", LUAX_BIND(&Size::h), LUAX_BIND(&Size::h))
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(Rect, "Rect")
+
+LUAX_FUNCTIONS_BEGIN(Rect)
+    LUAX_FUNCTION("area", LUAX_BIND(&Rect::area))
+    LUAX_FUNCTION("resize", LUAX_BIND(&Rect::resize))
+    LUAX_FUNCTION("scaled", LUAX_BIND(&Rect::scaled))
+    LUAX_FUNCTION("sizeRef", LUAX_BIND(&Rect::sizeRef))
+    LUAX_FUNCTION("isEmpty", LUAX_BIND(&is_empty))
+LUAX_FUNCTIONS_END
+
+LUAX_PROPERTIES_BEGIN(Rect)
+    LUAX_PROPERTY("x", LUAX_BIND(&Rect::x), LUAX_BIND(&Rect::x))
+    LUAX_PROPERTY("y", LUAX_BIND(&Rect::y), 0)
+    LUAX_PROPERTY("name", LUAX_BIND(&Rect::name), LUAX_BIND(&Rect::setName))
+    LUAX_PROPERTY("size", LUAX_BIND(&Rect::size), LUAX_BIND(&Rect::setSize))
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_FUNCTIONS_BEGIN(Rect)
+    LUAX_FUNCTION("sum", LUAX_BIND(&sum))
+    LUAX_FUNCTION("total", LUAX_BIND(&total))
+    LUAX_FUNCTION("widen", LUAX_BIND(&widen))
+    LUAX_FUNCTION("range", LUAX_BIND(&range))
+    LUAX_FUNCTION("label", LUAX_BIND(&label))
+LUAX_TYPE_FUNCTIONS_END
+
+// Test: methods with typed arguments and return values.
+TEST_F(LuaxBindTest, methods)
+{
+    luax::init(L);
+    luax::type<Size>::register_in(L);
+    luax::type<Rect>::register_in(L);
+
+    Rect r;
+    luax::type<Rect>::push(L, &r, false);
+    lua_setglobal(L, "r");
+
+    EXPECT_SCRIPT("assert(r:isEmpty())");
+    EXPECT_SCRIPT("r:resize(2, 3)");
+    EXPECT_EQ(6, r.area());
+    EXPECT_SCRIPT("assert(r:area() == 6)");
+    EXPECT_SCRIPT("assert(not r:isEmpty())");
+    EXPECT_SCRIPT("assert(r:scaled(2, 'm') == 12)");
+    EXPECT_SCRIPT("assert(r:scaled(2, 'cm') == 1200)");
+
+    // Wrong arguments.
+    EXPECT_FALSE(runScript("r:resize('a', 3)"));
+    EXPECT_FALSE(runScript("r:scaled(2)"));
+    EXPECT_FALSE(runScript("r.area()"));
+
+    // Free function.
+    EXPECT_SCRIPT("assert(Rect.sum(1, 2) == 3)");
+#if LUA_VERSION_NUM >= 503
+    // Integers are converted without float round trip.
+    EXPECT_SCRIPT("assert(math.type(Rect.sum(1, 2)) == 'integer')");
+    EXPECT_SCRIPT("assert(Rect.sum(2.0, 1) == 3)");
+    EXPECT_FALSE(runScript("Rect.sum(1.5, 1)"));
+#endif
+}
+//------------------------------------------------------------------------------
+
+// Test: properties with typed getters and setters.
+TEST_F(LuaxBindTest, properties)
+{
+    luax::init(L);
+    luax::type<Size>::register_in(L);
+    luax::type<Rect>::register_in(L);
+
+    Rect r;
+    luax::type<Rect>::push(L, &r, false);
+    lua_setglobal(L, "r");
+
+    // Data members.
+    EXPECT_SCRIPT("r.x = 10");
+    EXPECT_EQ(10, r.x);
+    r.y = 20;
+    EXPECT_SCRIPT("assert(r.x == 10 and r.y == 20)");
+
+    // Methods.
+    EXPECT_SCRIPT("r.name = 'rect'");
+    EXPECT_EQ("rect", r.name());
+    EXPECT_SCRIPT("assert(r.name == 'rect')");
+
+    // Bound class by value.
+    r.resize(4, 5);
+    EXPECT_SCRIPT("s = r.size");
+    EXPECT_SCRIPT("assert(s.w == 4 and s.h == 5)");
+    EXPECT_SCRIPT("s.w = 1");
+    EXPECT_EQ(4, r.size().w);
+    EXPECT_SCRIPT("r.size = s");
+    EXPECT_EQ(1, r.size().w);
+
+    // Bound class by reference.
+    EXPECT_SCRIPT("r:sizeRef().h = 7");
+    EXPECT_EQ(7, r.size().h);
+}
+//------------------------------------------------------------------------------
+
+// Test: not bound classes are converted as tables.
+TEST_F(LuaxBindTest, tables)
+{
+    luax::init(L);
+    luax::type<Size>::register_in(L);
+    luax::type<Rect>::register_in(L);
+
+    EXPECT_SCRIPT("assert(Rect.total({1, 2, 3}) == 6)");
+    EXPECT_SCRIPT("local m = Rect.widen({left = 1, right = 2}, 3);"
+                  "assert(m.left == 3 and m.right == 6)");
+    EXPECT_SCRIPT("local t = Rect.range(3); assert(#t == 3 and t[3] == 3)");
+    EXPECT_FALSE(runScript("Rect.widen(1, 2)"));
+    EXPECT_FALSE(runScript("Rect.total(1)"));
+    EXPECT_FALSE(runScript("Rect.total('abc')"));
+}
+//------------------------------------------------------------------------------
+
+// Test: all arguments are checked before conversion.
+TEST_F(LuaxBindTest, checkArgs)
+{
+    luax::init(L);
+    luax::type<Size>::register_in(L);
+    luax::type<Rect>::register_in(L);
+
+    EXPECT_SCRIPT("assert(Rect.label('n', 1) == 'n1')");
+    EXPECT_SCRIPT("local ok, err = pcall(Rect.label, 'n', 'x');"
+                  "assert(not ok and err:find('#2'))");
+    EXPECT_SCRIPT("local ok, err = pcall(Rect.label, {}, 1);"
+                  "assert(not ok and err:find('#1'))");
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,431 @@
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "luax.h"
+#include "luax_channel.h"
+
+class LuaxChannelTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        L2 = luaL_newstate();
+        luaL_openlibs(L2);
+    }
+
+    void TearDown() override
+    {
+        lua_close(L2);
+        BaseLuaxTest::TearDown();
+    }
+
+    // Encode values returned by the script in L and decode them in L2
+    // as a global 'msg' table.
+    ::testing::AssertionResult transfer(const char *txt)
+    {
+        lua_settop(L, 0);
+        if (luaL_dostring(L, txt))
+            return ::testing::AssertionFailure() << lua_tostring(L, -1);
+
+        std::string buf;
+        const char *error = 0;
+        if (!luax::encode(L, 1, lua_gettop(L), buf, &error))
+            return ::testing::AssertionFailure() << error;
+
+        lua_settop(L2, 0);
+        lua_newtable(L2);
+        int n = luax::decode(L2, buf.data(), buf.size());
+        if (n != lua_gettop(L))
+            return ::testing::AssertionFailure() << "decoded " << n;
+        for (int i = n; i > 0; --i)
+            lua_rawseti(L2, 1, i);
+        lua_setglobal(L2, "msg");
+        lua_settop(L, 0);
+        return ::testing::AssertionSuccess();
+    }
+
+    ::testing::AssertionResult check(const char *txt)
+    {
+        if (luaL_dostring(L2, txt))
+        {
+            auto res = ::testing::AssertionFailure() << lua_tostring(L2, -1);
+            lua_settop(L2, 0);
+            return res;
+        }
+        return ::testing::AssertionSuccess();
+    }
+
+    lua_State *L2;
+};
+//------------------------------------------------------------------------------
+
+struct Parcel
+{
+    int weight;
+};
+
+struct Crate: public Parcel
+{
+};
+
+static int parcel_weight(lua_State *L)
+{
+    lua_pushinteger(L, luax::type<Parcel>::check_cast(L, 1)->weight);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Parcel, "Parcel")
+LUAX_FUNCTIONS_BEGIN(Parcel)
+    LUAX_FUNCTION("weight", parcel_weight)
+LUAX_FUNCTIONS_END
+
+LUAX_TYPE_NAME(Crate, "Crate")
+LUAX_TYPE_SUPER_NAME(Crate, "Parcel")
+
+// Instances owned by the state memory.
+struct Pallet
+{
+    int weight;
+};
+
+LUAX_TYPE_NAME(Pallet, "Pallet")
+
+namespace luax {
+template <> bool type<Pallet>::usr_inplace() { return true; }
+template <> Pallet* type<Pallet>::usr_inplace_constructor(lua_State*, void *mem)
+{
+    return new (mem) Pallet();
+}
+}
+
+// Test: scalar values keep their types.
+TEST_F(LuaxChannelTest, scalars)
+{
+    ASSERT_TRUE(transfer("return nil, true, false, 0, -1, 300, 1.5, -0.25,"
+                         " 2^53, 'abc', ''"));
+    EXPECT_TRUE(check("assert(msg[1] == nil and msg[2] == true)"));
+    EXPECT_TRUE(check("assert(msg[3] == false and msg[4] == 0)"));
+    EXPECT_TRUE(check("assert(msg[5] == -1 and msg[6] == 300)"));
+    EXPECT_TRUE(check("assert(msg[7] == 1.5 and msg[8] == -0.25)"));
+    EXPECT_TRUE(check("assert(msg[9] == 2^53)"));
+    EXPECT_TRUE(check("assert(msg[10] == 'abc' and msg[11] == '')"));
+#if LUA_VERSION_NUM >= 503
+    ASSERT_TRUE(transfer("return 1, 1.0, math.mininteger, math.maxinteger"));
+    EXPECT_TRUE(check("assert(math.type(msg[1]) == 'integer')"));
+    EXPECT_TRUE(check("assert(math.type(msg[2]) == 'float')"));
+    EXPECT_TRUE(check("assert(msg[3] == math.mininteger)"));
+    EXPECT_TRUE(check("assert(msg[4] == math.maxinteger)"));
+#endif
+}
+//------------------------------------------------------------------------------
+
+// Test: strings are binary safe.
+TEST_F(LuaxChannelTest, binaryString)
+{
+    ASSERT_TRUE(transfer("return 'a\\0b\\255', string.rep('x', 1000)"));
+    EXPECT_TRUE(check("assert(msg[1] == 'a\\0b\\255' and #msg[1] == 4)"));
+    EXPECT_TRUE(check("assert(msg[2] == string.rep('x', 1000))"));
+}
+//------------------------------------------------------------------------------
+
+// Test: nested tables with array and hash parts.
+TEST_F(LuaxChannelTest, tables)
+{
+    ASSERT_TRUE(transfer(
+        "return {1, 2, 3, name = 'x', [10] = 'ten', [1.5] = true,"
+        " sub = {ids = {4, 5}, empty = {}}, [true] = 'yes'}"));
+    EXPECT_TRUE(check("t = msg[1]; assert(#t == 3 and t[3] == 3)"));
+    EXPECT_TRUE(check("assert(t.name == 'x' and t[10] == 'ten')"));
+    EXPECT_TRUE(check("assert(t[1.5] == true and t[true] == 'yes')"));
+    EXPECT_TRUE(check("assert(t.sub.ids[2] == 5 and next(t.sub.empty) == nil)"));
+    EXPECT_TRUE(check("local n = 0; for _ in pairs(t) do n = n + 1 end;"
+                      "assert(n == 8)"));
+}
+//------------------------------------------------------------------------------
+
+// Test: luax objects are passed by pointer.
+TEST_F(LuaxChannelTest, objects)
+{
+    luax::init(L);
+    luax::type<Parcel>::register_in(L);
+    luax::type<Crate>::register_in(L);
+    luax::init(L2);
+    luax::type<Parcel>::register_in(L2);
+    luax::type<Crate>::register_in(L2);
+
+    Parcel parcel;
+    parcel.weight = 5;
+    Crate crate;
+    crate.weight = 7;
+    luax::type<Parcel>::push(L, &parcel, false);
+    lua_setglobal(L, "parcel");
+    luax::type<Crate>::push(L, &crate, false);
+    lua_setglobal(L, "crate");
+
+    ASSERT_TRUE(transfer("return parcel, {crate, parcel}"));
+    EXPECT_TRUE(check("assert(msg[1]:weight() == 5)"));
+    EXPECT_TRUE(check("assert(msg[2][1]:weight() == 7)"));
+    EXPECT_TRUE(check("assert(msg[2][2] == msg[1])"));
+
+    lua_getglobal(L2, "msg");
+    lua_rawgeti(L2, -1, 1);
+    EXPECT_EQ(&parcel, luax::type<Parcel>::check_get(L2, -1));
+    lua_rawgeti(L2, -2, 2);
+    lua_rawgeti(L2, -1, 1);
+    EXPECT_EQ(&crate, luax::type<Crate>::check_get(L2, -1));
+    lua_settop(L2, 0);
+
+    // Receiving state doesn't own the objects.
+    EXPECT_TRUE(check("msg = nil; collectgarbage()"));
+    EXPECT_EQ(5, parcel.weight);
+}
+//------------------------------------------------------------------------------
+
+// Test: object of the type not registered in the receiver isn't decoded.
+TEST_F(LuaxChannelTest, unregisteredType)
+{
+    luax::init(L);
+    luax::type<Parcel>::register_in(L);
+    luax::init(L2);
+
+    Parcel parcel;
+    luax::type<Parcel>::push(L, &parcel, false);
+    std::string buf;
+    ASSERT_TRUE(luax::encode(L, 1, 1, buf));
+    lua_settop(L, 0);
+
+    const char *error = 0;
+    lua_pushinteger(L2, 1);
+    EXPECT_EQ(-1, luax::decode(L2, buf.data(), buf.size(), &error));
+    EXPECT_STREQ("luax type is not registered in the receiver", error);
+    EXPECT_EQ(1, lua_gettop(L2));
+    lua_settop(L2, 0);
+
+    luax::Channel chan(2);
+    ASSERT_TRUE(chan.send(buf));
+    chan.push_receive(L2);
+    lua_setglobal(L2, "receive");
+    EXPECT_NE(0, luaL_dostring(L2, "receive()"));
+    EXPECT_TRUE(strstr(lua_tostring(L2, -1), "not registered") != 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: unsupported values are rejected.
+TEST_F(LuaxChannelTest, unsupported)
+{
+    std::string buf;
+    const char *error = 0;
+
+    luaL_dostring(L, "return print, {f = print}, io.stdout, coroutine.create(print)");
+    for (int i = 1; i <= 4; ++i)
+    {
+        error = 0;
+        EXPECT_FALSE(luax::encode(L, i, i, buf, &error));
+        EXPECT_TRUE(error != 0);
+    }
+    lua_settop(L, 0);
+
+    luaL_dostring(L, "local t = {}; t.self = t; return t");
+    EXPECT_FALSE(luax::encode(L, 1, 1, buf, &error));
+    EXPECT_STREQ("table is too deep or cyclic", error);
+    lua_settop(L, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: only objects not owned by the sender state are sent.
+TEST_F(LuaxChannelTest, ownership)
+{
+    luax::init(L);
+    luax::type<Parcel>::register_in(L);
+    luax::type<Pallet>::register_in(L);
+    luax::init(L2);
+    luax::type<Parcel>::register_in(L2);
+
+    std::string buf;
+    const char *error = 0;
+
+    // Accepted: pushed without GC, C++ side keeps it alive.
+    Parcel parcel;
+    parcel.weight = 3;
+    luax::type<Parcel>::push(L, &parcel, false);
+    EXPECT_TRUE(luax::encode(L, 1, 1, buf, &error));
+    lua_settop(L, 0);
+    ASSERT_EQ(1, luax::decode(L2, buf.data(), buf.size()));
+    EXPECT_EQ(&parcel, luax::type<Parcel>::check_get(L2, 1));
+    lua_settop(L2, 0);
+
+    // Rejected: GC owned, in the userdata block, shared.
+    Parcel *owned = new Parcel();
+    luax::type<Parcel>::push(L, owned, true);
+    luaL_dostring(L, "return Pallet(), {Pallet()}");
+    std::shared_ptr<const Parcel> shared = std::make_shared<Parcel>();
+    luax::type<Parcel>::push_shared(L, shared);
+    lua_newtable(L);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    for (int i = 1; i <= lua_gettop(L); ++i)
+    {
+        error = 0;
+        buf.clear();
+        EXPECT_FALSE(luax::encode(L, i, i, buf, &error)) << i;
+        EXPECT_STREQ("luax object is owned by the state", error);
+    }
+    lua_settop(L, 0);
+
+    luax::Channel chan(2);
+    chan.push_send(L);
+    lua_setglobal(L, "send");
+    EXPECT_FALSE(runScript("send(Pallet())"));
+    EXPECT_EQ(0u, chan.size());
+}
+//------------------------------------------------------------------------------
+
+// Test: malformed data doesn't change the stack.
+TEST_F(LuaxChannelTest, malformed)
+{
+    luaL_dostring(L, "return 'abc', {1, 2, x = 'y'}");
+    std::string buf;
+    ASSERT_TRUE(luax::encode(L, 1, 2, buf));
+
+    for (size_t n = 1; n < buf.size(); ++n)
+    {
+        // Truncated message may still contain complete values.
+        lua_pushinteger(L2, 1);
+        int res = luax::decode(L2, buf.data(), n);
+        EXPECT_LT(res, 2);
+        EXPECT_EQ(1 + (res > 0 ? res : 0), lua_gettop(L2));
+        lua_settop(L2, 0);
+    }
+
+    std::string bad(1, '\x7f');
+    EXPECT_EQ(-1, luax::decode(L2, bad.data(), bad.size()));
+    EXPECT_EQ(0, luax::decode(L2, "", 0));
+
+    // Channel reports malformed message instead of empty one.
+    luax::Channel chan(2);
+    std::string msg = bad;
+    ASSERT_TRUE(chan.send(msg));
+    EXPECT_EQ(-2, chan.receive(L2));
+    EXPECT_EQ(0, lua_gettop(L2));
+    EXPECT_EQ(-1, chan.receive(L2));
+
+    chan.push_receive(L2);
+    lua_setglobal(L2, "receive");
+    msg = bad;
+    ASSERT_TRUE(chan.send(msg));
+    EXPECT_FALSE(check("receive()"));
+    EXPECT_TRUE(check("assert(receive() == false)"));
+}
+//------------------------------------------------------------------------------
+
+// Test: channel is bounded and keeps the order.
+TEST_F(LuaxChannelTest, channel)
+{
+    luax::Channel chan(3);
+    EXPECT_EQ(4u, chan.capacity());
+    EXPECT_EQ(-1, chan.receive(L2));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        lua_pushinteger(L, i);
+        lua_pushstring(L, "x");
+        EXPECT_TRUE(chan.send(L, 1, 2));
+        lua_settop(L, 0);
+    }
+    lua_pushinteger(L, 4);
+    EXPECT_FALSE(chan.send(L, 1, 1));
+    lua_settop(L, 0);
+    EXPECT_EQ(4u, chan.size());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(2, chan.receive(L2));
+        EXPECT_EQ(i, lua_tointeger(L2, 1));
+        EXPECT_STREQ("x", lua_tostring(L2, 2));
+        lua_settop(L2, 0);
+    }
+    EXPECT_EQ(-1, chan.receive(L2));
+    EXPECT_EQ(0u, chan.size());
+
+    // Slots are reused after wrap around.
+    lua_pushinteger(L, 10);
+    EXPECT_TRUE(chan.send(L, 1, 1));
+    lua_settop(L, 0);
+    ASSERT_EQ(1, chan.receive(L2));
+    EXPECT_EQ(10, lua_tointeger(L2, 1));
+    lua_settop(L2, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: lua side send() and receive().
+TEST_F(LuaxChannelTest, luaFunctions)
+{
+    luax::Channel chan(2);
+    chan.push_send(L);
+    lua_setglobal(L, "send");
+    chan.push_receive(L2);
+    lua_setglobal(L2, "receive");
+
+    EXPECT_SCRIPT("assert(send(1, {a = 'b'}) == true)");
+    EXPECT_SCRIPT("assert(send() == true)");
+    EXPECT_SCRIPT("assert(send(3) == false)");
+    EXPECT_FALSE(runScript("send(print)"));
+
+    EXPECT_TRUE(check("local ok, n, t = receive(); assert(ok and n == 1 and t.a == 'b')"));
+    EXPECT_TRUE(check("assert(select('#', receive()) == 1)"));
+    EXPECT_TRUE(check("assert(receive() == false)"));
+}
+//------------------------------------------------------------------------------
+
+// Test: many producers, single consumer.
+TEST_F(LuaxChannelTest, producers)
+{
+    const int threads = 4;
+    const int count = 2000;
+    luax::Channel chan(64);
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t)
+    {
+        producers.push_back(std::thread([&chan, t]() {
+            lua_State *S = luaL_newstate();
+            for (int i = 0; i < count; ++i)
+            {
+                lua_pushinteger(S, t);
+                lua_pushinteger(S, i);
+                while (!chan.send(S, 1, 2))
+                    std::this_thread::yield();
+                lua_settop(S, 0);
+            }
+            lua_close(S);
+        }));
+    }
+
+    std::vector<int> next(threads, 0);
+    int received = 0;
+    while (received < threads * count)
+    {
+        int n = chan.receive(L2);
+        if (n < 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(2, n);
+        int t = static_cast<int>(lua_tointeger(L2, 1));
+        int i = static_cast<int>(lua_tointeger(L2, 2));
+        lua_settop(L2, 0);
+        ASSERT_TRUE(t >= 0 && t < threads);
+        // Messages of each producer keep the order.
+        EXPECT_EQ(next[t], i);
+        next[t] = i + 1;
+        ++received;
+    }
+
+    for (size_t t = 0; t < producers.size(); ++t)
+        producers[t].join();
+    EXPECT_EQ(-1, chan.receive(L2));
+}
+//------------------------------------------------------------------------------
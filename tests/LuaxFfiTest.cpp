@@ -0,0 +1,112 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_ffi.h"
+
+class LuaxFfiTest: public BaseLuaxTest {};
+
+// Standard layout type with padding between fields.
+struct Body
+{
+    int32_t id;
+    double mass;
+    uint8_t flags;
+    float pos[3];
+
+    int scale(lua_State *L)
+    {
+        mass *= luaL_checknumber(L, 1);
+        return 0;
+    }
+};
+//------------------------------------------------------------------------------
+
+static int body_weight(lua_State *L)
+{
+    Body *b = luax::type<Body>::check_get(L, 1);
+    lua_pushnumber(L, b->mass * 10);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Body, "Body")
+
+LUAX_FUNCTIONS_M_BEGIN(Body)
+    LUAX_FUNCTION("scale", &Body::scale)
+LUAX_FUNCTIONS_END
+
+LUAX_PROPERTIES_BEGIN(Body)
+    LUAX_PROPERTY("weight", body_weight, 0)
+LUAX_PROPERTIES_END
+
+LUAX_FFI_FIELDS_BEGIN(Body)
+    LUAX_FFI_FIELD(Body, id)
+    LUAX_FFI_FIELD(Body, mass)
+    LUAX_FFI_FIELD(Body, flags)
+    LUAX_FFI_FIELD(Body, pos)
+LUAX_FFI_FIELDS_END
+
+// Test: generated struct declaration.
+TEST_F(LuaxFfiTest, cdef)
+{
+    std::string def = luax::ffi<Body>::cdef();
+    EXPECT_NE(std::string::npos, def.find("int32_t id;"));
+    EXPECT_NE(std::string::npos, def.find("double mass;"));
+    EXPECT_NE(std::string::npos, def.find("uint8_t flags;"));
+    EXPECT_NE(std::string::npos, def.find("float pos[3];"));
+    EXPECT_NE(std::string::npos, def.find("} luax_Body;"));
+}
+//------------------------------------------------------------------------------
+
+// Test: fields, methods and properties of the instance pushed with ffi.
+// With LuaJIT instance is a cdata pointer, with PUC Lua - userdata.
+TEST_F(LuaxFfiTest, push)
+{
+    luax::init(L);
+    luax::type<Body>::register_in(L);
+    bool jit = luax::ffi<Body>::register_in(L);
+    EXPECT_EQ(jit, luax::ffi<Body>::available(L));
+
+    lua_getglobal(L, "jit");
+    EXPECT_EQ(jit, !lua_isnil(L, -1));
+    lua_pop(L, 1);
+
+    Body b = {1, 2.5, 3, {1, 2, 3}};
+    luax::ffi<Body>::push(L, &b);
+    lua_setglobal(L, "b");
+
+    if (jit)
+    {
+        EXPECT_SCRIPT("assert(type(b) == 'cdata')");
+        std::string size = "assert(require('ffi').sizeof('luax_Body') == "
+            + std::to_string(sizeof(Body)) + ")";
+        EXPECT_SCRIPT(size.c_str());
+
+        // Fields are accessed directly.
+        EXPECT_SCRIPT("assert(b.id == 1 and b.mass == 2.5 and b.flags == 3)");
+        EXPECT_SCRIPT("assert(b.pos[0] == 1 and b.pos[2] == 3)");
+        EXPECT_SCRIPT("b.id = 7; b.mass = 4; b.pos[1] = 9");
+        EXPECT_EQ(7, b.id);
+        EXPECT_EQ(4, b.mass);
+        EXPECT_EQ(9, b.pos[1]);
+        EXPECT_SCRIPT("for i = 1, 1000 do b.id = b.id + 1 end");
+        EXPECT_EQ(1007, b.id);
+
+        // Same instance is pushed as the same cdata.
+        luax::ffi<Body>::push(L, &b);
+        lua_setglobal(L, "b2");
+        EXPECT_SCRIPT("assert(rawequal(b, b2))");
+    }
+    else
+        EXPECT_SCRIPT("assert(type(b) == 'userdata')");
+
+    // Methods and properties are forwarded to the userdata.
+    b.mass = 2;
+    EXPECT_SCRIPT("b:scale(3)");
+    EXPECT_EQ(6, b.mass);
+    EXPECT_SCRIPT("assert(b.weight == 60)");
+
+    luax::ffi<Body>::push(L, 0);
+    EXPECT_TRUE(lua_isnil(L, -1));
+    lua_pop(L, 1);
+}
+//------------------------------------------------------------------------------
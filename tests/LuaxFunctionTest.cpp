@@ -0,0 +1,172 @@
+#include <tuple>
+#include <vector>
+#include "common.h"
+#include "luax_function.h"
+
+class LuaxFunctionTest: public BaseLuaxTest {};
+
+// Test: call typed function.
+TEST_F(LuaxFunctionTest, call)
+{
+    EXPECT_SCRIPT("function add(a, b) return a + b end\n"
+                  "function greet(name) return 'hello ' .. name end\n"
+                  "calls = 0\n"
+                  "function touch() calls = calls + 1 end");
+
+    luax::Function<int(int, int)> add(L, "add");
+    ASSERT_TRUE(add.valid());
+    EXPECT_EQ(5, add(2, 3));
+    EXPECT_TRUE(add.ok());
+
+    int res = 0;
+    EXPECT_TRUE(add.call(&res, 10, 20));
+    EXPECT_EQ(30, res);
+
+    luax::Function<std::string(const std::string&)> greet(L, "greet");
+    EXPECT_EQ("hello lua", greet("lua"));
+
+    luax::Function<void()> touch(L, "touch");
+    touch();
+    touch();
+    EXPECT_SCRIPT("assert(calls == 2)");
+
+    // Function is pinned: global may be changed.
+    EXPECT_SCRIPT("add = nil");
+    EXPECT_EQ(7, add(3, 4));
+
+    EXPECT_EQ(0, lua_gettop(L));
+}
+//------------------------------------------------------------------------------
+
+// Test: errors are reported with traceback.
+TEST_F(LuaxFunctionTest, error)
+{
+    EXPECT_SCRIPT("function fail(x) error('bad ' .. x) end\n"
+                  "function ret(x) return x end");
+
+    luax::Function<int(int)> fail(L, "fail");
+    EXPECT_EQ(0, fail(1));
+    EXPECT_FALSE(fail.ok());
+    EXPECT_NE(std::string::npos, fail.error().find("bad 1"));
+    EXPECT_NE(std::string::npos, fail.error().find("traceback"));
+    EXPECT_EQ(0, lua_gettop(L));
+
+    luax::Function<int(int)> ret(L, "ret");
+    EXPECT_EQ(8, ret(8));
+    EXPECT_TRUE(ret.ok());
+
+    luax::Function<void()> none(L, "no_such_function");
+    EXPECT_FALSE(none.valid());
+    none();
+    EXPECT_FALSE(none.ok());
+    EXPECT_EQ(0, lua_gettop(L));
+}
+//------------------------------------------------------------------------------
+
+// Callback which calls the same Function handle, passed as upvalue.
+static int function_reenter(lua_State *L)
+{
+    typedef luax::Function<int(int)> F;
+    F *f = static_cast<F*>(lua_touserdata(L, lua_upvalueindex(1)));
+    // Garbage on the callback stack must not affect the nested call.
+    lua_pushliteral(L, "pad");
+    lua_pushliteral(L, "pad");
+    int res = (*f)(static_cast<int>(luaL_checkinteger(L, 1)));
+    lua_pushinteger(L, res);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+// Test: function is called again from the lua code it runs.
+TEST_F(LuaxFunctionTest, reenter)
+{
+    EXPECT_SCRIPT("function fact(n)\n"
+                  "  if n < 0 then error('negative') end\n"
+                  "  if n <= 1 then return 1 end\n"
+                  "  return n * reenter(n - 1)\n"
+                  "end\n"
+                  "function guarded(n) return reenter(-1) + n end");
+
+    luax::Function<int(int)> fact(L, "fact");
+    lua_pushlightuserdata(L, &fact);
+    lua_pushcclosure(L, function_reenter, 1);
+    lua_setglobal(L, "reenter");
+
+    // Caller's stack is kept.
+    lua_pushliteral(L, "caller");
+    EXPECT_EQ(120, fact(5));
+    EXPECT_TRUE(fact.ok());
+    ASSERT_EQ(1, lua_gettop(L));
+    EXPECT_STREQ("caller", lua_tostring(L, 1));
+
+    // Nested error doesn't break the outer call.
+    luax::Function<int(int)> guarded(L, "guarded");
+    EXPECT_EQ(3, guarded(3));
+    EXPECT_TRUE(guarded.ok());
+    EXPECT_FALSE(fact.ok());
+    ASSERT_EQ(1, lua_gettop(L));
+    EXPECT_STREQ("caller", lua_tostring(L, 1));
+    lua_settop(L, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: move and reset.
+TEST_F(LuaxFunctionTest, move)
+{
+    ASSERT_EQ(0, luaL_dostring(L, "return function(x) return x * 2 end"));
+
+    luax::Function<double(double)> f(L, -1);
+    lua_pop(L, 1);
+    EXPECT_DOUBLE_EQ(3.0, f(1.5));
+
+    luax::Function<double(double)> g(std::move(f));
+    EXPECT_FALSE(f.valid());
+    EXPECT_DOUBLE_EQ(4.0, g(2));
+
+    luax::Function<double(double)> h;
+    EXPECT_FALSE(h.valid());
+    h = std::move(g);
+    EXPECT_DOUBLE_EQ(6.0, h(3));
+
+    h.reset();
+    EXPECT_FALSE(h.valid());
+}
+//------------------------------------------------------------------------------
+
+// Test: batched calls.
+TEST_F(LuaxFunctionTest, callAll)
+{
+    EXPECT_SCRIPT("function sq(x) return x * x end\n"
+                  "function mul(a, b) return a * b end\n"
+                  "sum = 0\n"
+                  "function acc(x) sum = sum + x end\n"
+                  "function check(x) if x > 2 then error('too big') end return x end");
+
+    std::vector<int> in = {1, 2, 3, 4};
+    std::vector<int> out;
+
+    luax::Function<int(int)> sq(L, "sq");
+    EXPECT_TRUE(sq.call_all(in.begin(), in.end(), std::back_inserter(out)));
+    EXPECT_EQ(std::vector<int>({1, 4, 9, 16}), out);
+
+    std::vector<std::tuple<int, int> > pairs = {std::make_tuple(2, 3),
+                                                std::make_tuple(4, 5)};
+    int res[2] = {0, 0};
+    luax::Function<int(int, int)> mul(L, "mul");
+    EXPECT_TRUE(mul.call_all(pairs.begin(), pairs.end(), res));
+    EXPECT_EQ(6, res[0]);
+    EXPECT_EQ(20, res[1]);
+
+    luax::Function<void(int)> acc(L, "acc");
+    EXPECT_TRUE(acc.call_all(in.begin(), in.end()));
+    EXPECT_SCRIPT("assert(sum == 10)");
+
+    // Stops on error, processed results are written.
+    out.clear();
+    luax::Function<int(int)> check(L, "check");
+    EXPECT_FALSE(check.call_all(in.begin(), in.end(), std::back_inserter(out)));
+    EXPECT_NE(std::string::npos, check.error().find("too big"));
+    EXPECT_EQ(std::vector<int>({1, 2}), out);
+    EXPECT_EQ(0, lua_gettop(L));
+}
+//------------------------------------------------------------------------------
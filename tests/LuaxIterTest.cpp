@@ -0,0 +1,188 @@
+#include <list>
+#include "common.h"
+#include "luax.h"
+#include "luax_iter.h"
+
+class LuaxIterTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+    }
+};
+
+struct Stock
+{
+    int weight;
+
+    Stock(int weight = 0): weight(weight) {}
+};
+//------------------------------------------------------------------------------
+
+class Inventory
+{
+public:
+    std::vector<Stock> items;
+
+    int lua_items(lua_State *L)
+    {
+        return luax::push_iter(L, items, 1);
+    }
+
+    // Generator of the item weights.
+    int lua_weights(lua_State *L)
+    {
+        size_t i = 0;
+        std::vector<Stock> *v = &items;
+        return luax::push_generator<int>(L, [i, v](int &out) mutable
+        {
+            if (i == v->size())
+                return false;
+            out = (*v)[i++].weight;
+            return true;
+        }, 1);
+    }
+};
+//------------------------------------------------------------------------------
+
+static int stock_weight(lua_State *L)
+{
+    Stock *s = luax::type<Stock>::check_get(L, 1);
+    if (lua_gettop(L) == 1)
+    {
+        lua_pushinteger(L, s->weight);
+        return 1;
+    }
+    s->weight = static_cast<int>(luaL_checkinteger(L, 2));
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Stock, "Stock")
+LUAX_PROPERTIES_BEGIN(Stock)
+    LUAX_PROPERTY("weight", stock_weight, stock_weight)
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(Inventory, "Inventory")
+LUAX_FUNCTIONS_M_BEGIN(Inventory)
+    LUAX_FUNCTION("items", &Inventory::lua_items)
+    LUAX_FUNCTION("weights", &Inventory::lua_weights)
+LUAX_FUNCTIONS_END
+
+// Test: range of values.
+TEST_F(LuaxIterTest, values)
+{
+    std::list<std::string> names;
+    names.push_back("a");
+    names.push_back("b");
+    names.push_back("c");
+    luax::push_iter(L, names.begin(), names.end());
+    lua_setglobal(L, "names");
+    EXPECT_SCRIPT("local s = ''\n"
+                  "for n in names do s = s .. n end\n"
+                  "assert(s == 'abc')");
+
+    // Exhausted iterator.
+    EXPECT_SCRIPT("assert(names() == nil)");
+
+    const std::vector<int> v(5, 2);
+    luax::push_iter(L, v);
+    lua_setglobal(L, "ints");
+    EXPECT_SCRIPT("local sum = 0\n"
+                  "for x in ints do sum = sum + x end\n"
+                  "assert(sum == 10)");
+    // Pointers to not bound types are pushed with luax::push().
+    const char *words[] = {"x", "y"};
+    luax::push_iter(L, words);
+    lua_setglobal(L, "words");
+    EXPECT_SCRIPT("local s = ''\n"
+                  "for w in words do s = s .. w end\n"
+                  "assert(s == 'xy')");
+}
+//------------------------------------------------------------------------------
+
+// Test: bound elements are pushed by reference, owner is kept alive.
+TEST_F(LuaxIterTest, bound)
+{
+    luax::type<Stock>::register_in(L);
+    luax::type<Inventory>::register_in(L);
+
+    Inventory inv;
+    inv.items.push_back(Stock(1));
+    inv.items.push_back(Stock(2));
+    inv.items.push_back(Stock(3));
+    luax::type<Inventory>::push(L, &inv, false);
+    lua_setglobal(L, "inv");
+
+    EXPECT_SCRIPT("for item in inv:items() do item.weight = item.weight * 10 end");
+    EXPECT_EQ(10, inv.items[0].weight);
+    EXPECT_EQ(30, inv.items[2].weight);
+
+    // Early stop.
+    EXPECT_SCRIPT("local n = 0\n"
+                  "for item in inv:items() do\n"
+                  "  n = n + 1\n"
+                  "  if item.weight == 20 then break end\n"
+                  "end\n"
+                  "assert(n == 2)");
+
+    EXPECT_SCRIPT("local f = inv:items(); inv = nil; collectgarbage()\n"
+                  "assert(f().weight == 10)");
+
+    std::vector<Stock*> ptrs;
+    ptrs.push_back(&inv.items[1]);
+    luax::push_iter(L, ptrs);
+    lua_setglobal(L, "ptrs");
+    EXPECT_SCRIPT("ptrs().weight = 5");
+    EXPECT_EQ(5, inv.items[1].weight);
+}
+//------------------------------------------------------------------------------
+
+struct CountingGen
+{
+    static int destroyed;
+    int n;
+
+    CountingGen(int n): n(n) {}
+    CountingGen(const CountingGen &other): n(other.n) {}
+    ~CountingGen() { ++destroyed; }
+
+    bool operator()(Stock &out)
+    {
+        if (n == 0)
+            return false;
+        out.weight = n--;
+        return true;
+    }
+};
+int CountingGen::destroyed = 0;
+//------------------------------------------------------------------------------
+
+// Test: generators.
+TEST_F(LuaxIterTest, generator)
+{
+    luax::type<Stock>::register_in(L);
+    luax::type<Inventory>::register_in(L);
+
+    Inventory inv;
+    inv.items.push_back(Stock(4));
+    inv.items.push_back(Stock(5));
+    luax::type<Inventory>::push(L, &inv, false);
+    lua_setglobal(L, "inv");
+    EXPECT_SCRIPT("local sum = 0\n"
+                  "for w in inv:weights() do sum = sum + w end\n"
+                  "assert(sum == 9)");
+
+    // Bound values are copied, generator state is destructed on GC.
+    CountingGen::destroyed = 0;
+    luax::push_generator<Stock>(L, CountingGen(3));
+    lua_setglobal(L, "gen");
+    int before = CountingGen::destroyed;
+    EXPECT_SCRIPT("local a = gen(); local b = gen()\n"
+                  "assert(a.weight == 3 and b.weight == 2)");
+    EXPECT_SCRIPT("gen = nil; collectgarbage()");
+    EXPECT_EQ(before + 1, CountingGen::destroyed);
+}
+//------------------------------------------------------------------------------
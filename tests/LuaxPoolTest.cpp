@@ -0,0 +1,199 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_pool.h"
+#include <set>
+#include <thread>
+#include <vector>
+
+class LuaxPoolTest: public BaseLuaxTest {};
+
+static int particles = 0;
+
+struct Particle
+{
+    double x;
+    double y;
+
+    Particle(double x, double y): x(x), y(y) { ++particles; }
+    ~Particle() { --particles; }
+};
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Particle, "Particle")
+LUAX_TYPE_POOL(Particle)
+
+namespace luax {
+template <> Particle* type<Particle>::usr_inplace_constructor(lua_State *L,
+                                                              void *mem)
+{
+    return new (mem) Particle(luaL_checknumber(L, 2), luaL_checknumber(L, 3));
+}
+}
+
+static int pt_x(lua_State *L)
+{
+    lua_pushnumber(L, luax::type<Particle>::check_get(L, 1)->x);
+    return 1;
+}
+
+LUAX_PROPERTIES_BEGIN(Particle)
+    LUAX_PROPERTY("x", pt_x, 0)
+LUAX_PROPERTIES_END
+
+// Test: pool allocator.
+TEST_F(LuaxPoolTest, pool)
+{
+    luax::Pool<Particle, 4> pool;
+    EXPECT_EQ(0u, pool.capacity());
+
+    std::set<void*> mem;
+    for (int i = 0; i < 6; ++i)
+        mem.insert(pool.alloc());
+    EXPECT_EQ(6u, mem.size());
+    EXPECT_EQ(6u, pool.occupancy());
+    EXPECT_EQ(6u, pool.high_water());
+    EXPECT_EQ(2u, pool.blocks());
+    EXPECT_EQ(8u, pool.capacity());
+
+    void *p = *mem.begin();
+    pool.free(p);
+    EXPECT_EQ(5u, pool.occupancy());
+    EXPECT_EQ(6u, pool.high_water());
+
+    // Freed slot is reused.
+    EXPECT_EQ(p, pool.alloc());
+
+    for (std::set<void*>::iterator it = mem.begin(); it != mem.end(); ++it)
+        pool.free(*it);
+    EXPECT_EQ(0u, pool.occupancy());
+    EXPECT_EQ(6u, pool.high_water());
+    EXPECT_EQ(8u, pool.capacity());
+}
+//------------------------------------------------------------------------------
+
+// Test: instances created from lua are allocated in the pool and
+// recycled on GC.
+TEST_F(LuaxPoolTest, create)
+{
+    luax::Pool<Particle> &pool = luax::Pool<Particle>::local();
+    size_t occupancy = pool.occupancy();
+    particles = 0;
+
+    luax::init(L);
+    luax::type<Particle>::register_in(L);
+
+    EXPECT_SCRIPT("list = {}; for i = 1, 100 do list[i] = Particle(i, 0) end");
+    EXPECT_SCRIPT("assert(list[10].x == 10)");
+    EXPECT_EQ(100, particles);
+    EXPECT_EQ(occupancy + 100, pool.occupancy());
+
+    // Same instance is pushed as the same userdata.
+    EXPECT_SCRIPT("p = list[1]");
+    lua_getglobal(L, "p");
+    Particle *p = luax::type<Particle>::check_get(L, -1);
+    luax::type<Particle>::push(L, p);
+    EXPECT_TRUE(lua_rawequal(L, -1, -2));
+    lua_pop(L, 2);
+
+    EXPECT_SCRIPT("list = nil; p = nil; collectgarbage()");
+    EXPECT_EQ(0, particles);
+    EXPECT_EQ(occupancy, pool.occupancy());
+
+    // Memory is reused.
+    size_t capacity = pool.capacity();
+    EXPECT_SCRIPT("for i = 1, 1000 do\n"
+                  "  local p = Particle(i, 0)\n"
+                  "  if i % 50 == 0 then collectgarbage() end\n"
+                  "end\n"
+                  "collectgarbage()");
+    EXPECT_EQ(capacity, pool.capacity());
+    EXPECT_EQ(occupancy, pool.occupancy());
+}
+//------------------------------------------------------------------------------
+
+// Test: memory is returned to the pool if constructor fails.
+TEST_F(LuaxPoolTest, createError)
+{
+    luax::Pool<Particle> &pool = luax::Pool<Particle>::local();
+    size_t occupancy = pool.occupancy();
+    particles = 0;
+
+    luax::init(L);
+    luax::type<Particle>::register_in(L);
+
+    EXPECT_FALSE(runScript("p = Particle('x', 1)"));
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    EXPECT_EQ(0, particles);
+    EXPECT_EQ(occupancy, pool.occupancy());
+}
+//------------------------------------------------------------------------------
+
+// Test: memory freed on another thread goes back to the owner pool and
+// stays valid after the owner thread exits.
+TEST_F(LuaxPoolTest, crossThread)
+{
+    typedef luax::Pool<Particle, 4> SmallPool;
+
+    std::vector<Particle*> mem;
+    std::thread owner([&mem]() {
+        SmallPool &pool = SmallPool::local();
+        for (int i = 0; i < 6; ++i)
+            mem.push_back(new (pool.alloc()) Particle(i, 0));
+    });
+    owner.join();
+
+    // Owner pool is destroyed, the instances are still usable.
+    SmallPool &pool = SmallPool::local();
+    size_t occupancy = pool.occupancy();
+    for (size_t i = 0; i < mem.size(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(static_cast<double>(i), mem[i]->x);
+        mem[i]->~Particle();
+        pool.free(mem[i]);
+        // Slot doesn't belong to this pool.
+        EXPECT_EQ(occupancy, pool.occupancy());
+    }
+
+    // Slots freed on another thread are reused by the owner.
+    void *a = pool.alloc();
+    std::thread other([a]() { SmallPool::local().free(a); });
+    other.join();
+    EXPECT_EQ(occupancy, pool.occupancy());
+
+    size_t capacity = pool.capacity();
+    std::set<void*> reused;
+    while (pool.occupancy() < capacity)
+        reused.insert(pool.alloc());
+    EXPECT_EQ(capacity, pool.capacity());
+    EXPECT_EQ(1u, reused.count(a));
+    for (std::set<void*>::iterator it = reused.begin(); it != reused.end(); ++it)
+        pool.free(*it);
+}
+//------------------------------------------------------------------------------
+
+// Test: lua state with pooled instances is closed on another thread
+// after the creating thread exits.
+TEST_F(LuaxPoolTest, stateMovedBetweenThreads)
+{
+    particles = 0;
+    lua_State *S = 0;
+    std::thread creator([&S]() {
+        S = luaL_newstate();
+        luaL_openlibs(S);
+        luax::init(S);
+        luax::type<Particle>::register_in(S);
+        if (luaL_dostring(S, "list = {}; for i = 1, 300 do list[i] = Particle(i, 0) end"))
+            ADD_FAILURE() << lua_tostring(S, -1);
+    });
+    creator.join();
+    EXPECT_EQ(300, particles);
+
+    size_t occupancy = luax::Pool<Particle>::local().occupancy();
+    EXPECT_EQ(0, luaL_dostring(S, "assert(list[300].x == 300); list[1] = nil;"
+                                  "collectgarbage()"));
+    EXPECT_EQ(299, particles);
+    lua_close(S);
+    EXPECT_EQ(0, particles);
+    EXPECT_EQ(occupancy, luax::Pool<Particle>::local().occupancy());
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,188 @@
+#include "common.h"
+#include "luax.h"
+
+class LuaxProfileTest: public BaseLuaxTest {};
+
+struct Tally
+{
+    int value;
+
+    Tally(): value(0) {}
+
+    int inc(lua_State*)
+    {
+        ++value;
+        return 0;
+    }
+
+    int getValue(lua_State *L)
+    {
+        lua_pushinteger(L, value);
+        return 1;
+    }
+
+    int setValue(lua_State *L)
+    {
+        value = static_cast<int>(luaL_checkinteger(L, 1));
+        return 0;
+    }
+};
+//------------------------------------------------------------------------------
+
+static int tally_fail(lua_State *L)
+{
+    return luaL_error(L, "fail");
+}
+//------------------------------------------------------------------------------
+
+static const luax::profile::Stats* find(const std::vector<luax::profile::Entry> &entries,
+                                 const char *type, const char *name)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].type == type && entries[i].name == name)
+            return &entries[i].stats;
+    }
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Tally, "Tally")
+
+LUAX_FUNCTIONS_BEGIN(Tally)
+    LUAX_FUNCTION("fail", tally_fail)
+LUAX_FUNCTIONS_END
+
+LUAX_FUNCTIONS_M_BEGIN(Tally)
+    LUAX_FUNCTION("inc", &Tally::inc)
+LUAX_FUNCTIONS_END
+
+LUAX_PROPERTIES_M_BEGIN(Tally)
+    LUAX_PROPERTY("value", &Tally::getValue, &Tally::setValue)
+LUAX_PROPERTIES_END
+
+namespace luax {
+template <> Tally* type<Tally>::usr_constructor(lua_State*) { return new Tally(); }
+}
+
+// Test: stats are collected only if enabled for the state.
+TEST_F(LuaxProfileTest, disabled)
+{
+    luax::init(L);
+    luax::type<Tally>::register_in(L);
+    EXPECT_FALSE(luax::profile::enabled(L));
+
+    EXPECT_SCRIPT("local i = Tally(); i:inc(); i.value = 2");
+    EXPECT_TRUE(luax::profile::snapshot(L).empty());
+}
+//------------------------------------------------------------------------------
+
+// Test: stats are readable from c++.
+TEST_F(LuaxProfileTest, snapshot)
+{
+    luax::profile::enable(L);
+    luax::init(L);
+    luax::type<Tally>::register_in(L);
+    EXPECT_TRUE(luax::profile::enabled(L));
+
+    ASSERT_SCRIPT("i = Tally()");
+    EXPECT_SCRIPT("for n = 1, 10 do i:inc() end");
+    EXPECT_SCRIPT("assert(i.value == 10)");
+    EXPECT_SCRIPT("i.value = 3");
+    EXPECT_SCRIPT("assert(i.value == 3)");
+    EXPECT_FALSE(runScript("i:fail()"));
+    EXPECT_SCRIPT("i = nil; collectgarbage()");
+
+    std::vector<luax::profile::Entry> entries = luax::profile::snapshot(L);
+    const luax::profile::Stats *s;
+
+    s = find(entries, "Tally", "inc");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(10u, s->calls);
+    EXPECT_LE(s->min_ns, s->max_ns);
+    EXPECT_GE(s->total_ns, s->max_ns);
+    uint64_t hist = 0;
+    for (int i = 0; i < LUAX_PROFILE_BUCKETS; ++i)
+        hist += s->hist[i];
+    EXPECT_EQ(10u, hist);
+
+    s = find(entries, "Tally", "get:value");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(2u, s->calls);
+
+    s = find(entries, "Tally", "set:value");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(1u, s->calls);
+
+    // Failed calls are not recorded.
+    s = find(entries, "Tally", "fail");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(0u, s->calls);
+
+    s = find(entries, "Tally", "__call");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(1u, s->calls);
+
+    s = find(entries, "Tally", "__gc");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(1u, s->calls);
+
+    luax::profile::reset(L);
+    entries = luax::profile::snapshot(L);
+    s = find(entries, "Tally", "inc");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(0u, s->calls);
+}
+//------------------------------------------------------------------------------
+
+// Test: stats are readable from lua.
+TEST_F(LuaxProfileTest, snapshotLua)
+{
+    luax::profile::enable(L);
+    luax::init(L);
+    luax::type<Tally>::register_in(L);
+
+    lua_pushcfunction(L, luax::profile::lua_snapshot);
+    lua_setglobal(L, "profile");
+    lua_pushcfunction(L, luax::profile::lua_reset);
+    lua_setglobal(L, "profile_reset");
+
+    Tally item;
+    luax::type<Tally>::push(L, &item, false);
+    lua_setglobal(L, "i");
+
+    EXPECT_SCRIPT("for n = 1, 5 do i:inc() end");
+    EXPECT_EQ(5, item.value);
+    EXPECT_SCRIPT(
+        "local p = profile().Tally.inc\n"
+        "assert(p.calls == 5)\n"
+        "assert(p.min_ns <= p.max_ns)\n"
+        "local n = 0\n"
+        "for b, count in pairs(p.hist) do n = n + count end\n"
+        "assert(n == 5)");
+    EXPECT_SCRIPT("profile_reset(); assert(profile().Tally.inc.calls == 0)");
+}
+//------------------------------------------------------------------------------
+
+// Test: bulk calls are profiled as the method.
+TEST_F(LuaxProfileTest, invokeAll)
+{
+    luax::profile::enable(L);
+    luax::init(L);
+    luax::type<Tally>::register_in(L);
+
+    std::vector<Tally> items(3);
+    luax::type<Tally>::push_range(L, items.begin(), items.end());
+    lua_setglobal(L, "list");
+
+    EXPECT_SCRIPT("Tally.invoke_all(list, 'inc')");
+    EXPECT_SCRIPT("Tally.invoke_into(nil, list, 'inc')");
+    EXPECT_EQ(3, luax::type<Tally>::invoke_all(L, items.begin(), items.end(),
+                                              "inc"));
+    EXPECT_EQ(3, items[2].value);
+
+    const luax::profile::Stats *s = find(luax::profile::snapshot(L), "Tally", "inc");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(9u, s->calls);
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,162 @@
+#include <atomic>
+#include <vector>
+#include "common.h"
+#include "luax.h"
+#include "luax_utils.h"
+#include "luax_scheduler.h"
+
+static std::atomic<long> sched_sum(0);
+static std::atomic<int> sched_states(0);
+
+static int sched_record(lua_State *L)
+{
+    sched_sum += static_cast<long>(luaL_checkinteger(L, 1));
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+static void sched_setup(lua_State *L)
+{
+    luaL_openlibs(L);
+    lua_pushcfunction(L, sched_record);
+    lua_setglobal(L, "record");
+    luax::set_global(L, "id", sched_states++);
+    luaL_dostring(L, "acc = 0\n"
+                     "function add(a, b) record(a + b) end\n"
+                     "function greet(s) if s ~= 'hi' then error('bad') end end\n"
+                     "function accumulate(x) acc = acc + x end\n"
+                     "function fail() error('boom') end");
+}
+//------------------------------------------------------------------------------
+
+class LuaxSchedulerTest: public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        sched_sum = 0;
+        sched_states = 0;
+    }
+};
+
+// Test: typed calls are executed.
+TEST_F(LuaxSchedulerTest, call)
+{
+    luax::Scheduler sched(3, sched_setup);
+    EXPECT_EQ(3u, sched.size());
+    EXPECT_EQ(3u, sched.current_worker());
+
+    for (int i = 0; i < 1000; ++i)
+        sched.call("add", i, 1);
+    std::string hi("hi");
+    sched.call("greet", "hi");
+    sched.call("greet", hi);
+    sched.wait();
+
+    EXPECT_EQ(1000 * 999 / 2 + 1000, sched_sum.load());
+    luax::Scheduler::Stats s = sched.stats();
+    EXPECT_EQ(1002u, s.executed);
+    EXPECT_EQ(0u, s.errors);
+}
+//------------------------------------------------------------------------------
+
+// Test: errors are counted.
+TEST_F(LuaxSchedulerTest, errors)
+{
+    luax::Scheduler sched(2, sched_setup);
+    sched.call("fail");
+    sched.call("no_such_function");
+    sched.submit([](lua_State*) { throw std::runtime_error("cpp error"); });
+    sched.wait();
+
+    EXPECT_EQ(3u, sched.stats().errors);
+    EXPECT_EQ(3u, sched.stats().executed);
+    EXPECT_FALSE(sched.last_error().empty());
+}
+//------------------------------------------------------------------------------
+
+// Test: jobs with affinity run on the same state.
+TEST_F(LuaxSchedulerTest, affinity)
+{
+    luax::Scheduler sched(4, sched_setup);
+
+    for (int i = 1; i <= 100; ++i)
+        sched.call_on(2, "accumulate", i);
+
+    int acc = 0;
+    size_t worker = 0;
+    sched.submit_to(2, [&](lua_State *L) {
+        acc = luax::get_global<int>(L, "acc");
+        worker = sched.current_worker();
+    });
+    sched.wait();
+
+    EXPECT_EQ(5050, acc);
+    EXPECT_EQ(2u, worker);
+}
+//------------------------------------------------------------------------------
+
+// Test: jobs submitted from the worker are queued to the same worker.
+TEST_F(LuaxSchedulerTest, nested)
+{
+    luax::Scheduler sched(2, sched_setup);
+
+    std::atomic<int> done(0);
+    for (int i = 0; i < 10; ++i)
+    {
+        sched.submit([&](lua_State*) {
+            size_t worker = sched.current_worker();
+            sched.submit([&, worker](lua_State*) {
+                if (sched.current_worker() == worker)
+                    ++done;
+            });
+        });
+    }
+    sched.wait();
+    // Nested job runs on the same worker unless it's stolen.
+    EXPECT_LE(10u, done.load() + sched.stats().stolen);
+    EXPECT_EQ(20u, sched.stats().executed);
+}
+//------------------------------------------------------------------------------
+
+// Test: raw jobs raising lua errors are protected.
+TEST_F(LuaxSchedulerTest, jobErrors)
+{
+    luax::Scheduler sched(2, sched_setup);
+    for (int i = 0; i < 4; ++i)
+        sched.submit([](lua_State *L) { luaL_error(L, "raw error"); });
+    sched.call("add", 1, 2);
+    sched.wait();
+
+    EXPECT_EQ(4u, sched.stats().errors);
+    EXPECT_EQ(5u, sched.stats().executed);
+    EXPECT_NE(std::string::npos, sched.last_error().find("raw error"));
+    EXPECT_EQ(3, sched_sum.load());
+}
+//------------------------------------------------------------------------------
+
+// Test: wait() called from the jobs runs other jobs instead of deadlock.
+TEST_F(LuaxSchedulerTest, waitFromJob)
+{
+    luax::Scheduler sched(2, sched_setup);
+
+    std::atomic<int> waited(0);
+    for (int i = 0; i < 4; ++i)
+    {
+        sched.submit([&](lua_State *L) {
+            lua_pushinteger(L, 1);
+            for (int j = 0; j < 50; ++j)
+                sched.call("add", j, 0);
+            sched.wait();
+            if (lua_gettop(L) == 1)
+                ++waited;
+        });
+    }
+    sched.wait();
+
+    EXPECT_EQ(4, waited.load());
+    EXPECT_EQ(4 * 50 * 49 / 2, sched_sum.load());
+    EXPECT_EQ(204u, sched.stats().executed);
+    EXPECT_EQ(0u, sched.stats().errors);
+}
+//------------------------------------------------------------------------------
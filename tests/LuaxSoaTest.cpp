@@ -0,0 +1,178 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_soa.h"
+
+class LuaxSoaTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+        luax::register_arrays(L);
+    }
+};
+
+struct World
+{
+    std::vector<float> pos_x;
+    std::vector<float> vel_x;
+    std::vector<int32_t> hp;
+
+    void resize(size_t n)
+    {
+        pos_x.resize(n);
+        vel_x.resize(n);
+        hp.resize(n);
+    }
+};
+//------------------------------------------------------------------------------
+
+static int world_count(lua_State *L)
+{
+    World *w = luax::type<World>::check_get(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(w->pos_x.size()));
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(World, "World")
+LUAX_PROPERTIES_BEGIN(World)
+    LUAX_SOA_COLUMN(World, pos_x)
+    LUAX_SOA_COLUMN(World, vel_x)
+    LUAX_SOA_COLUMN(World, hp)
+    LUAX_PROPERTY("count", world_count, 0)
+LUAX_PROPERTIES_END
+
+// Derived container inherits the columns.
+struct Level: public World
+{
+};
+
+LUAX_TYPE_NAME(Level, "Level")
+LUAX_TYPE_SUPER_NAME(Level, "World")
+
+// Test: columns are views of the container vectors.
+TEST_F(LuaxSoaTest, columns)
+{
+    luax::type<World>::register_in(L);
+
+    World w;
+    w.resize(4);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        w.pos_x[i] = static_cast<float>(i);
+        w.vel_x[i] = 1;
+        w.hp[i] = static_cast<int32_t>(i * 10);
+    }
+    luax::type<World>::push(L, &w, false);
+    lua_setglobal(L, "w");
+
+    EXPECT_SCRIPT("assert(w.count == 4 and #w.pos_x == 4 and w.hp[4] == 30)");
+
+    // Integration step.
+    EXPECT_SCRIPT("w.pos_x:axpy(0.5, w.vel_x)");
+    EXPECT_EQ(0.5f, w.pos_x[0]);
+    EXPECT_EQ(3.5f, w.pos_x[3]);
+
+    // Setters.
+    EXPECT_SCRIPT("w.vel_x = 2");
+    EXPECT_EQ(2, w.vel_x[3]);
+    EXPECT_SCRIPT("w.vel_x = Float32Array{1, 2, 3, 4}");
+    EXPECT_EQ(4.0f, w.vel_x[3]);
+    EXPECT_SCRIPT("w.vel_x = w.pos_x");
+    EXPECT_EQ(1.5f, w.vel_x[1]);
+    EXPECT_SCRIPT("w.vel_x = w.vel_x");
+    EXPECT_EQ(1.5f, w.vel_x[1]);
+    EXPECT_FALSE(runScript("w.hp = Float32Array(4)"));
+
+    // Size can't be changed from lua.
+    EXPECT_FALSE(runScript("w.vel_x = Float32Array{1, 2}"));
+    EXPECT_FALSE(runScript("w.vel_x = w.pos_x:slice(2)"));
+    EXPECT_EQ(4u, w.vel_x.size());
+}
+//------------------------------------------------------------------------------
+
+// Test: views taken before assignment stay valid.
+TEST_F(LuaxSoaTest, viewAfterSet)
+{
+    luax::type<World>::register_in(L);
+
+    World w;
+    w.resize(3);
+    luax::type<World>::push(L, &w, false);
+    lua_setglobal(L, "w");
+
+    EXPECT_SCRIPT("other = Float32Array{7, 8, 9}");
+    EXPECT_SCRIPT("local px = w.pos_x; w.pos_x = other; print(px[1])\n"
+                  "assert(px[1] == 7 and px[3] == 9)");
+    EXPECT_EQ(7.0f, w.pos_x[0]);
+}
+//------------------------------------------------------------------------------
+
+// Test: views are cached per object and column, derived objects are accepted.
+TEST_F(LuaxSoaTest, viewCache)
+{
+    luax::type<World>::register_in(L);
+    luax::type<Level>::register_in(L);
+
+    World w;
+    w.resize(2);
+    luax::type<World>::push(L, &w, false);
+    lua_setglobal(L, "w");
+
+    EXPECT_SCRIPT("assert(rawequal(w.pos_x, w.pos_x))");
+    EXPECT_SCRIPT("assert(not rawequal(w.pos_x, w.vel_x))");
+
+    // Cached view follows the resize on C++ side.
+    EXPECT_SCRIPT("px = w.pos_x");
+    w.resize(5);
+    EXPECT_SCRIPT("assert(rawequal(px, w.pos_x) and #px == 5)");
+
+    Level lv;
+    lv.resize(3);
+    lv.hp[2] = 7;
+    luax::type<Level>::push(L, &lv, false);
+    lua_setglobal(L, "lv");
+    EXPECT_SCRIPT("assert(#lv.hp == 3 and lv.hp[3] == 7)");
+    EXPECT_SCRIPT("lv.hp = 1");
+    EXPECT_EQ(1, lv.hp[2]);
+    EXPECT_SCRIPT("assert(not rawequal(lv.hp, w.hp))");
+}
+//------------------------------------------------------------------------------
+
+// Test: column operations.
+TEST_F(LuaxSoaTest, ops)
+{
+    EXPECT_SCRIPT("a = Int32Array{5, 1, 7, 3}");
+
+    EXPECT_SCRIPT("local m = a:cmp('>', 2)\n"
+                  "assert(m[1] == 1 and m[2] == 0 and m:sum() == 3)\n"
+                  "local f = a:filter(m)\n"
+                  "assert(#f == 3 and f[1] == 5 and f[3] == 3)\n"
+                  "local idx = m:indices()\n"
+                  "assert(#idx == 3 and idx[1] == 1 and idx[2] == 3)\n"
+                  "local g = a:gather(idx)\n"
+                  "assert(g:sum() == 15)");
+
+    EXPECT_SCRIPT("local b = a:copy():map('mul', 2):map('sub', Int32Array{1, 1, 1, 1})\n"
+                  "assert(b[1] == 9 and b[2] == 1)\n"
+                  "b:map('div', 0); assert(b:sum() == 0)\n"
+                  "b:map('set', a):map('min', 4):map('max', 2)\n"
+                  "assert(b[1] == 4 and b[2] == 2 and b[4] == 3)");
+
+    EXPECT_SCRIPT("local b = a:copy()\n"
+                  "b:where(a:cmp('<', a:copy():fill(4)), 0)\n"
+                  "assert(b[1] == 5 and b[2] == 0 and b[4] == 0)");
+
+    EXPECT_SCRIPT("local b = a:copy()\n"
+                  "b:scatter(Int32Array{2, 4}, Int32Array{20, 40})\n"
+                  "assert(b[2] == 20 and b[4] == 40)\n"
+                  "b:scatter(Int32Array{1}, 0); assert(b[1] == 0)");
+
+    EXPECT_FALSE(runScript("a:map('pow', 2)"));
+    EXPECT_FALSE(runScript("a:gather(Int32Array{5})"));
+    EXPECT_FALSE(runScript("a:where(Uint8Array(3), 1)"));
+    EXPECT_FALSE(runScript("a:scatter(Int32Array{1}, Int32Array{1, 2})"));
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,136 @@
+#include "common.h"
+#include "luax.h"
+#include "luax_span.h"
+
+class LuaxSpanTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+    }
+};
+
+struct Cell
+{
+    int value;
+
+    Cell(int value = 0): value(value) {}
+};
+//------------------------------------------------------------------------------
+
+static int cell_value(lua_State *L)
+{
+    Cell *c = luax::type<Cell>::check_get(L, 1);
+    if (lua_gettop(L) == 1)
+    {
+        lua_pushinteger(L, c->value);
+        return 1;
+    }
+    c->value = static_cast<int>(luaL_checkinteger(L, 2));
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Cell, "Cell")
+LUAX_PROPERTIES_BEGIN(Cell)
+    LUAX_PROPERTY("value", cell_value, cell_value)
+LUAX_PROPERTIES_END
+
+LUAX_SPAN(int, "IntSpan")
+LUAX_SPAN(double, "DoubleSpan")
+LUAX_SPAN(std::string, "StringSpan")
+LUAX_SPAN(Cell, "CellSpan")
+
+// Test: vector proxy.
+TEST_F(LuaxSpanTest, vector)
+{
+    luax::type<luax::Span<int> >::register_in(L);
+
+    std::vector<int> v;
+    v.push_back(10);
+    v.push_back(20);
+    v.push_back(30);
+
+    luax::push_span(L, v);
+    lua_setglobal(L, "s");
+
+    EXPECT_SCRIPT("assert(#s == 3)");
+    EXPECT_SCRIPT("assert(s[1] == 10 and s[3] == 30)");
+    EXPECT_SCRIPT("assert(s[0] == nil and s[4] == nil and s[1.5] == nil)");
+    EXPECT_SCRIPT("assert(s.foo == nil)");
+
+    // Writes go to the vector.
+    EXPECT_SCRIPT("s[2] = 21");
+    EXPECT_EQ(21, v[1]);
+    EXPECT_FALSE(runScript("s[4] = 1"));
+    EXPECT_FALSE(runScript("s[1] = 'x'"));
+
+    // Size follows the vector.
+    v.push_back(40);
+    EXPECT_SCRIPT("assert(#s == 4 and s[4] == 40)");
+
+    EXPECT_SCRIPT("local sum = 0\n"
+                  "for i, x in s:items() do sum = sum + x end\n"
+                  "assert(sum == 10 + 21 + 30 + 40)");
+#if LUA_VERSION_NUM >= 503
+    EXPECT_SCRIPT("assert(math.type(#s) == 'integer')");
+    EXPECT_SCRIPT("for i in s:items() do assert(math.type(i) == 'integer') end");
+#endif
+}
+//------------------------------------------------------------------------------
+
+// Test: read only and pointer ranges.
+TEST_F(LuaxSpanTest, range)
+{
+    luax::type<luax::Span<double> >::register_in(L);
+
+    double data[] = {1.5, 2.5};
+    luax::push_span(L, data, 2);
+    lua_setglobal(L, "s");
+    EXPECT_SCRIPT("assert(#s == 2 and s[2] == 2.5)");
+    EXPECT_SCRIPT("s[1] = 3");
+    EXPECT_EQ(3, data[0]);
+
+    const std::vector<double> cv(2, 7.0);
+    luax::push_span(L, cv);
+    lua_setglobal(L, "cs");
+    EXPECT_SCRIPT("assert(cs[1] == 7)");
+    EXPECT_FALSE(runScript("cs[1] = 1"));
+
+    const double *cdata = data;
+    luax::push_span(L, cdata, 2);
+    lua_setglobal(L, "cr");
+    EXPECT_FALSE(runScript("cr[1] = 1"));
+}
+//------------------------------------------------------------------------------
+
+// Test: strings and bound element types.
+TEST_F(LuaxSpanTest, elements)
+{
+    luax::type<Cell>::register_in(L);
+    luax::type<luax::Span<std::string> >::register_in(L);
+    luax::type<luax::Span<Cell> >::register_in(L);
+
+    std::vector<std::string> names;
+    names.push_back("a");
+    names.push_back("b");
+    luax::push_span(L, names);
+    lua_setglobal(L, "names");
+    EXPECT_SCRIPT("assert(names[2] == 'b')");
+    EXPECT_SCRIPT("names[1] = 'x'");
+    EXPECT_EQ("x", names[0]);
+
+    // Bound elements are pushed by reference.
+    std::vector<Cell> cells(3);
+    luax::push_span(L, cells);
+    lua_setglobal(L, "cells");
+    EXPECT_SCRIPT("cells[2].value = 5");
+    EXPECT_EQ(5, cells[1].value);
+    EXPECT_SCRIPT("assert(cells[2] == cells[2])");
+    EXPECT_SCRIPT("cells[3] = cells[2]");
+    EXPECT_EQ(5, cells[2].value);
+    EXPECT_FALSE(runScript("cells[1] = 1"));
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,161 @@
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "luax.h"
+#include "luax_state_pool.h"
+
+class LuaxStatePoolTest: public ::testing::Test {};
+
+struct Gadget
+{
+    int value;
+};
+
+static int gadget_value(lua_State *L)
+{
+    lua_pushinteger(L, luax::type<Gadget>::check_get(L, 1)->value);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Gadget, "Gadget")
+LUAX_FUNCTIONS_BEGIN(Gadget)
+    LUAX_FUNCTION("value", gadget_value)
+LUAX_FUNCTIONS_END
+
+static void setup(lua_State *L)
+{
+    luaL_openlibs(L);
+    luax::init(L);
+    luax::type<Gadget>::register_in(L);
+    luaL_dostring(L, "limit = 10");
+}
+//------------------------------------------------------------------------------
+
+static bool run(lua_State *L, const char *txt)
+{
+    bool ok = luaL_dostring(L, txt) == 0;
+    if (!ok)
+        ADD_FAILURE() << lua_tostring(L, -1);
+    lua_settop(L, 0);
+    return ok;
+}
+//------------------------------------------------------------------------------
+
+// Test: states are prepared and reused.
+TEST_F(LuaxStatePoolTest, checkout)
+{
+    luax::StatePool pool(setup, 2);
+    luax::StatePool::Stats s = pool.stats();
+    EXPECT_EQ(2u, s.size);
+    EXPECT_EQ(2u, s.idle);
+    EXPECT_EQ(2u, s.created);
+
+    lua_State *L = pool.checkout();
+    EXPECT_TRUE(run(L, "assert(Gadget and limit == 10)"));
+    pool.checkin(L);
+
+    lua_State *L2 = pool.checkout();
+    EXPECT_EQ(L, L2);
+    lua_State *L3 = pool.checkout();
+    lua_State *L4 = pool.checkout();
+    EXPECT_NE(L3, L4);
+
+    s = pool.stats();
+    EXPECT_EQ(3u, s.size);
+    EXPECT_EQ(0u, s.idle);
+    EXPECT_EQ(4u, s.checkouts);
+    EXPECT_EQ(1u, s.misses);
+    EXPECT_GE(s.checkout_ns, s.checkout_max_ns);
+
+    pool.checkin(L2);
+    pool.checkin(L3);
+    pool.checkin(L4);
+    EXPECT_EQ(3u, pool.stats().idle);
+}
+//------------------------------------------------------------------------------
+
+// Test: globals are restored on checkin, types are kept.
+TEST_F(LuaxStatePoolTest, reset)
+{
+    luax::StatePool pool(setup, 1);
+
+    Gadget g = {42};
+    {
+        luax::StatePool::Lease L = pool.lease();
+        luax::type<Gadget>::push(L, &g, false);
+        lua_setglobal(L, "g");
+        EXPECT_TRUE(run(L, "assert(g:value() == 42)\n"
+                           "junk = {}\n"
+                           "limit = 20\n"
+                           "print = nil\n"
+                           "Gadget = nil\n"
+                           "package.loaded.mod = {}\n"
+                           "setmetatable(_G, {__index = function() return 1 end})"));
+    }
+
+    luax::StatePool::Lease L = pool.lease();
+    EXPECT_TRUE(run(L, "assert(g == nil and junk == nil and undefined == nil)\n"
+                       "assert(limit == 10 and print and Gadget)\n"
+                       "assert(package.loaded.mod == nil)"));
+
+    // Metatables are kept.
+    luax::type<Gadget>::push(L, &g, false);
+    lua_setglobal(L, "g");
+    EXPECT_TRUE(run(L, "assert(g:value() == 42)"));
+    EXPECT_EQ(1u, pool.stats().created);
+}
+//------------------------------------------------------------------------------
+
+// Test: concurrent checkouts.
+TEST_F(LuaxStatePoolTest, threads)
+{
+    luax::StatePool pool(setup, 2);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::thread([&pool]() {
+            for (int i = 0; i < 50; ++i)
+            {
+                luax::StatePool::Lease L = pool.lease();
+                run(L, "assert(counter == nil) counter = 1");
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    luax::StatePool::Stats s = pool.stats();
+    EXPECT_EQ(200u, s.checkouts);
+    EXPECT_EQ(s.size, s.idle);
+    EXPECT_LE(s.size, 4u);
+}
+//------------------------------------------------------------------------------
+
+// Test: setup errors don't escape, size follows closed states.
+TEST_F(LuaxStatePoolTest, failures)
+{
+    luax::StatePool bad([](lua_State *L) {
+        luaL_error(L, "setup failed");
+    }, 0);
+    EXPECT_FALSE(bad.reserve(1));
+    EXPECT_TRUE(bad.checkout() == 0);
+    luax::StatePool::Stats s = bad.stats();
+    EXPECT_EQ(0u, s.size);
+    EXPECT_EQ(0u, s.created);
+    EXPECT_EQ(2u, s.failures);
+    EXPECT_NE(std::string::npos, bad.last_error().find("setup failed"));
+
+    luax::StatePool pool(setup, 3, true);
+    EXPECT_EQ(3u, pool.stats().size);
+    pool.shrink(1);
+    s = pool.stats();
+    EXPECT_EQ(1u, s.size);
+    EXPECT_EQ(1u, s.idle);
+    EXPECT_EQ(0u, s.failures);
+
+    luax::StatePool::Lease L = pool.lease();
+    EXPECT_TRUE(run(L, "junk = {}"));
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,117 @@
+#include <map>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "luax_struct.h"
+
+class LuaxStructTest: public BaseLuaxTest {};
+
+struct Endpoint
+{
+    Endpoint(): port(0) {}
+
+    std::string host;
+    int port;
+};
+
+struct NetConfig
+{
+    NetConfig(): timeout(0), verbose(false) {}
+
+    double timeout;
+    bool verbose;
+    Endpoint main;
+    std::vector<Endpoint> backups;
+    std::vector<int> ids;
+    std::map<std::string, int> limits;
+};
+
+LUAX_STRUCT(Endpoint, (host)(port))
+LUAX_STRUCT(NetConfig, (timeout)(verbose)(main)(backups)(ids)(limits))
+
+// Test: field list.
+TEST_F(LuaxStructTest, info)
+{
+    EXPECT_EQ(2, luax::struct_info<Endpoint>::count);
+    EXPECT_EQ(6, luax::struct_info<NetConfig>::count);
+    EXPECT_EQ(0, luax::struct_info<int>::reflected);
+}
+//------------------------------------------------------------------------------
+
+// Test: push struct as table.
+TEST_F(LuaxStructTest, push)
+{
+    NetConfig cfg;
+    cfg.timeout = 1.5;
+    cfg.verbose = true;
+    cfg.main.host = "localhost";
+    cfg.main.port = 80;
+    cfg.backups.resize(2);
+    cfg.backups[1].host = "backup";
+    cfg.ids.push_back(3);
+    cfg.ids.push_back(4);
+    cfg.limits["rps"] = 100;
+
+    luax::push(L, cfg);
+    lua_setglobal(L, "cfg");
+    EXPECT_EQ(0, lua_gettop(L));
+
+    EXPECT_SCRIPT("assert(cfg.timeout == 1.5 and cfg.verbose == true)\n"
+                  "assert(cfg.main.host == 'localhost' and cfg.main.port == 80)\n"
+                  "assert(#cfg.backups == 2 and cfg.backups[2].host == 'backup')\n"
+                  "assert(#cfg.ids == 2 and cfg.ids[2] == 4)\n"
+                  "assert(cfg.limits.rps == 100)");
+}
+//------------------------------------------------------------------------------
+
+// Test: get struct from table.
+TEST_F(LuaxStructTest, get)
+{
+    ASSERT_EQ(0, luaL_dostring(L, "return {\n"
+                                  "  timeout = 2, verbose = true,\n"
+                                  "  main = {host = 'a', port = 1},\n"
+                                  "  backups = {{host = 'b'}, {port = 3}},\n"
+                                  "  ids = {7, 8, 9},\n"
+                                  "  limits = {rps = 5, [10] = 6}}"));
+
+    NetConfig cfg = luax::get<NetConfig>(L, -1);
+    lua_pop(L, 1);
+    EXPECT_EQ(0, lua_gettop(L));
+
+    EXPECT_DOUBLE_EQ(2, cfg.timeout);
+    EXPECT_TRUE(cfg.verbose);
+    EXPECT_EQ("a", cfg.main.host);
+    EXPECT_EQ(1, cfg.main.port);
+    ASSERT_EQ(2u, cfg.backups.size());
+    EXPECT_EQ("b", cfg.backups[0].host);
+    EXPECT_EQ(0, cfg.backups[0].port);
+    EXPECT_EQ(3, cfg.backups[1].port);
+    EXPECT_EQ(std::vector<int>({7, 8, 9}), cfg.ids);
+    EXPECT_EQ(2u, cfg.limits.size());
+    EXPECT_EQ(5, cfg.limits["rps"]);
+    EXPECT_EQ(6, cfg.limits["10"]);
+
+    // Missing fields and non tables are left default.
+    lua_newtable(L);
+    Endpoint e = luax::get<Endpoint>(L, -1);
+    EXPECT_EQ("", e.host);
+    lua_pushnumber(L, 1);
+    e = luax::get<Endpoint>(L, -1);
+    EXPECT_EQ(0, e.port);
+    lua_pop(L, 2);
+}
+//------------------------------------------------------------------------------
+
+// Test: round trip.
+TEST_F(LuaxStructTest, roundTrip)
+{
+    Endpoint e;
+    e.host = "x";
+    e.port = 8080;
+    luax::set_global(L, "e", e);
+    EXPECT_SCRIPT("e.port = e.port + 1");
+    Endpoint r = luax::get_global<Endpoint>(L, "e");
+    EXPECT_EQ("x", r.host);
+    EXPECT_EQ(8081, r.port);
+}
+//------------------------------------------------------------------------------
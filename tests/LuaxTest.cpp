@@ -1,5 +1,8 @@
 #include "common.h"
 #include "luax.h"
+#include <memory>
+#include <thread>
+#include <vector>
 
 class LuaxTest: public BaseLuaxTest {};
 
@@ -153,6 +156,94 @@ TEST_F(LuaxTest, gc)
 }
 //------------------------------------------------------------------------------
 
+// Test: push reuses userdata for the same instance.
+struct PointHolder
+{
+    Point pt;
+};
+
+LUAX_TYPE_NAME(PointHolder, "PointHolder")
+
+TEST_F(LuaxTest, pushIdentity)
+{
+    luax::init(L);
+    luax::type<Point>::register_in(L);
+    luax::type<PointHolder>::register_in(L);
+
+    Point pt;
+    luax::type<Point>::push(L, &pt, false);
+    luax::type<Point>::push(L, &pt, false);
+    EXPECT_TRUE(lua_rawequal(L, -1, -2));
+    lua_settop(L, 0);
+
+    // Holder and it's first member have the same address but they must be
+    // different userdata.
+    PointHolder holder;
+    ASSERT_EQ(static_cast<void*>(&holder), static_cast<void*>(&holder.pt));
+    luax::type<PointHolder>::push(L, &holder, false);
+    luax::type<Point>::push(L, &holder.pt, false);
+    EXPECT_FALSE(lua_rawequal(L, -1, -2));
+    EXPECT_EQ(&holder, luax::type<PointHolder>::get(L, -2));
+    EXPECT_EQ(&holder.pt, luax::type<Point>::get(L, -1));
+    lua_settop(L, 0);
+
+    // Cache is available in the LUAX_UDATA table.
+    lua_getfield(L, LUA_REGISTRYINDEX, LUAX_UDATA);
+    lua_getfield(L, -1, "Point");
+    EXPECT_TRUE(lua_istable(L, -1));
+    lua_settop(L, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: push array of objects.
+TEST_F(LuaxTest, pushRange)
+{
+    luax::init(L);
+    luax::type<Point>::register_in(L);
+
+    std::vector<Point> pts(3);
+    pts[1].x = 10;
+
+    // Already pushed object reuses its userdata.
+    luax::type<Point>::push(L, &pts[0], false);
+    lua_setglobal(L, "p0");
+
+    luax::type<Point>::push_range(L, pts.begin(), pts.end(), false);
+    lua_setglobal(L, "list");
+    EXPECT_EQ(0, lua_gettop(L));
+
+    EXPECT_SCRIPT("assert(#list == 3)");
+    EXPECT_SCRIPT("assert(list[1] == p0)");
+    EXPECT_SCRIPT("assert(list[2]:getX() == 10)");
+
+    // Pointers, null pointers are skipped.
+    Point *ptrs[] = {&pts[2], 0, &pts[1]};
+    luax::type<Point>::push_range(L, ptrs, ptrs + 3, false);
+    lua_setglobal(L, "ptrs");
+    EXPECT_SCRIPT("assert(#ptrs == 2)");
+    EXPECT_SCRIPT("assert(ptrs[1] == list[3])");
+    EXPECT_SCRIPT("assert(ptrs[2] == list[2])");
+
+    // Empty range.
+    luax::type<Point>::push_range(L, ptrs, ptrs, false);
+    EXPECT_TRUE(lua_istable(L, -1));
+    lua_pop(L, 1);
+
+    // Values are never collected, even with default useGc.
+    const std::vector<Point> &cpts = pts;
+    luax::type<Point>::push_range(L, cpts.begin(), cpts.end());
+    lua_setglobal(L, "clist");
+    EXPECT_SCRIPT("assert(clist[2] == list[2])");
+    std::vector<Point> more(2);
+    more[0].x = 5;
+    luax::type<Point>::push_range(L, more.begin(), more.end());
+    lua_setglobal(L, "more");
+    EXPECT_SCRIPT("assert(more[1]:getX() == 5)");
+    EXPECT_SCRIPT("more = nil; clist = nil; list = nil; collectgarbage()");
+    EXPECT_EQ(5, more[0].x);
+}
+//------------------------------------------------------------------------------
+
 // Test: methods.
 LUAX_FUNCTIONS_BEGIN(Point)
     LUAX_FUNCTION("getx", pt_x)
@@ -202,6 +293,133 @@ TEST_F(LuaxTest, methods)
 }
 //------------------------------------------------------------------------------
 
+// Test: compile time method trampolines.
+struct Counter
+{
+    int value;
+
+    Counter(): value(0) {}
+
+    // Self is removed, arguments start at 1.
+    int add(lua_State *L)
+    {
+        value += static_cast<int>(luaL_checkinteger(L, 1));
+        lua_pushinteger(L, value);
+        return 1;
+    }
+
+    // Self is at 1, arguments start at 2.
+    int addSelf(lua_State *L)
+    {
+        assert(luax::type<Counter>::get(L, 1) == this);
+        value += static_cast<int>(luaL_checkinteger(L, 2));
+        lua_pushinteger(L, value);
+        return 1;
+    }
+
+    int getValue(lua_State *L)
+    {
+        lua_pushinteger(L, value);
+        return 1;
+    }
+
+    int setValue(lua_State *L)
+    {
+        value = static_cast<int>(luaL_checkinteger(L, 2));
+        return 0;
+    }
+};
+
+LUAX_TYPE_NAME(Counter, "Counter")
+
+LUAX_FUNCTIONS_BEGIN(Counter)
+    LUAX_FUNCTION("add", LUAX_METHOD(&Counter::add))
+    LUAX_FUNCTION("addSelf", LUAX_METHOD_SELF(&Counter::addSelf))
+LUAX_FUNCTIONS_END
+
+// Same method via upvalue dispatch to compare.
+LUAX_FUNCTIONS_M_BEGIN(Counter)
+    LUAX_FUNCTION("addUp", &Counter::add)
+LUAX_FUNCTIONS_END
+
+LUAX_PROPERTIES_BEGIN(Counter)
+    LUAX_PROPERTY("value", LUAX_METHOD_SELF(&Counter::getValue),
+                  LUAX_METHOD_SELF(&Counter::setValue))
+LUAX_PROPERTIES_END
+
+TEST_F(LuaxTest, methodTrampoline)
+{
+    luax::init(L);
+    luax::type<Counter>::register_in(L);
+
+    Counter c;
+    luax::type<Counter>::push(L, &c, false);
+    lua_setglobal(L, "c");
+
+    EXPECT_SCRIPT("assert(c:add(2) == 2)");
+    EXPECT_SCRIPT("assert(c:addSelf(3) == 5)");
+    EXPECT_SCRIPT("assert(c:addUp(1) == 6)");
+    EXPECT_EQ(6, c.value);
+
+    EXPECT_SCRIPT("assert(c.value == 6)");
+    EXPECT_SCRIPT("c.value = 10");
+    EXPECT_EQ(10, c.value);
+
+    EXPECT_FALSE(runScript("c.add(2)"));
+    EXPECT_FALSE(runScript("c.addSelf(2)"));
+}
+//------------------------------------------------------------------------------
+
+class LuaxCounterTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+        luax::type<Counter>::register_in(L);
+        luax::type<Counter>::push(L, &c, false);
+        lua_setglobal(L, "c");
+    }
+
+    Counter c;
+};
+
+// Test: bulk method call.
+TEST_F(LuaxCounterTest, invokeAll)
+{
+    std::vector<Counter> counters(3);
+    luax::type<Counter>::push_range(L, counters.begin(), counters.end(), false);
+    lua_setglobal(L, "list");
+
+    // Method<T> and free function methods.
+    EXPECT_SCRIPT("Counter.invoke_all(list, 'addUp', 2)");
+    EXPECT_SCRIPT("Counter.invoke_all(list, 'add', 3)");
+    EXPECT_EQ(5, counters[0].value);
+    EXPECT_EQ(5, counters[2].value);
+
+    EXPECT_SCRIPT("local out = Counter.invoke_into({}, list, 'addUp', 1)\n"
+                  "assert(#out == 3 and out[1] == 6 and out[3] == 6)");
+    EXPECT_SCRIPT("local out = Counter.invoke_into({}, list, 'addSelf', 1)\n"
+                  "assert(out[2] == 7)");
+    EXPECT_SCRIPT("local out = Counter.invoke_into(nil, list, 'addUp', 0)\n"
+                  "assert(#out == 3 and out[2] == 7)");
+    EXPECT_FALSE(runScript("Counter.invoke_into(nil, 1, 'addUp')"));
+
+    EXPECT_FALSE(runScript("Counter.invoke_all(list, 'nope')"));
+    EXPECT_FALSE(runScript("Counter.invoke_all({c, 1}, 'addUp', 1)"));
+    EXPECT_EQ(1, c.value);
+
+    // C++ range, arguments are taken from the stack.
+    lua_pushinteger(L, 10);
+    EXPECT_EQ(3, luax::type<Counter>::invoke_all(L, counters.begin(),
+                                                 counters.end(), "addUp", 1));
+    EXPECT_EQ(1, lua_gettop(L));
+    lua_pop(L, 1);
+    EXPECT_EQ(17, counters[1].value);
+}
+//------------------------------------------------------------------------------
+
 // Test: constructor.
 namespace luax {
 template <> Point* type<Point>::usr_constructor(lua_State *L)
@@ -235,6 +453,252 @@ TEST_F(LuaxTest, construct)
 }
 //------------------------------------------------------------------------------
 
+// Test: inplace instances.
+static int vec_counter = 0;
+
+struct Vec
+{
+    double x;
+    double y;
+
+    Vec(double x = 0, double y = 0): x(x), y(y) { ++vec_counter; }
+    Vec(const Vec &other): x(other.x), y(other.y) { ++vec_counter; }
+    ~Vec() { --vec_counter; }
+
+    int len2(lua_State *L)
+    {
+        lua_pushnumber(L, x * x + y * y);
+        return 1;
+    }
+};
+
+// Overaligned value type.
+struct alignas(32) AlignedVec: public Vec
+{
+    AlignedVec(double x = 0, double y = 0): Vec(x, y) {}
+};
+
+LUAX_TYPE_NAME(Vec, "Vec")
+LUAX_TYPE_INPLACE(Vec)
+LUAX_FUNCTIONS_M_BEGIN(Vec)
+    LUAX_FUNCTION("len2", &Vec::len2)
+LUAX_FUNCTIONS_END
+
+static int vec_get_x(lua_State *L)
+{
+    lua_pushnumber(L, luax::type<Vec>::check_get(L, 1)->x);
+    return 1;
+}
+
+static int vec_set_x(lua_State *L)
+{
+    luax::type<Vec>::check_get(L, 1)->x = luaL_checknumber(L, 2);
+    return 0;
+}
+
+LUAX_PROPERTIES_BEGIN(Vec)
+    LUAX_PROPERTY("x", vec_get_x, vec_set_x)
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(AlignedVec, "AlignedVec")
+LUAX_TYPE_INPLACE(AlignedVec)
+
+namespace luax {
+template <> Vec* type<Vec>::usr_inplace_constructor(lua_State *L, void *mem)
+{
+    // Arguments are at the same indices as for usr_constructor().
+    if (lua_gettop(L) == 1)
+        return new (mem) Vec();
+    return new (mem) Vec(luaL_checknumber(L, 2), luaL_checknumber(L, 3));
+}
+
+template <> AlignedVec* type<AlignedVec>::usr_inplace_constructor(lua_State*,
+                                                                  void *mem)
+{
+    return new (mem) AlignedVec(1, 2);
+}
+}
+
+TEST_F(LuaxTest, inplace)
+{
+    luax::init(L);
+    luax::type<Vec>::register_in(L);
+    luax::type<AlignedVec>::register_in(L);
+
+    vec_counter = 0;
+
+    ASSERT_SCRIPT("v = Vec(3, 4)");
+    EXPECT_SCRIPT("assert(v:len2() == 25)");
+    ASSERT_SCRIPT("v0 = Vec()");
+    EXPECT_SCRIPT("assert(v0:len2() == 0)");
+    EXPECT_EQ(2, vec_counter);
+
+    // Instance is stored inside the userdata.
+    lua_getglobal(L, "v");
+    Vec *v = luax::type<Vec>::get(L, -1);
+    ASSERT_TRUE(v != 0);
+    char *block = static_cast<char*>(lua_touserdata(L, -1));
+    EXPECT_TRUE(reinterpret_cast<char*>(v) > block);
+    EXPECT_EQ(v, luax::type<Vec>::check_get(L, -1));
+    EXPECT_DOUBLE_EQ(3, v->x);
+
+    // Pushing the pointer returns the same userdata.
+    luax::type<Vec>::push(L, v);
+    EXPECT_TRUE(lua_rawequal(L, -1, -2));
+    lua_settop(L, 0);
+
+    // Copy.
+    Vec local(5, 12);
+    luax::type<Vec>::push_value(L, local);
+    EXPECT_NE(&local, luax::type<Vec>::get(L, -1));
+    lua_setglobal(L, "v1");
+    EXPECT_SCRIPT("assert(v1:len2() == 169)");
+    EXPECT_EQ(4, vec_counter);
+
+    // Instances are destructed on GC.
+    EXPECT_SCRIPT("v = nil; v0 = nil; v1 = nil");
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    EXPECT_EQ(1, vec_counter);
+
+    // Alignment.
+    ASSERT_SCRIPT("a = AlignedVec()");
+    lua_getglobal(L, "a");
+    AlignedVec *a = luax::type<AlignedVec>::get(L, -1);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(a) % 32);
+    EXPECT_DOUBLE_EQ(2, a->y);
+    lua_settop(L, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: shared instance is owned by all states it's pushed to.
+TEST_F(LuaxTest, shared)
+{
+    vec_counter = 0;
+    std::shared_ptr<const Vec> vec = std::make_shared<Vec>(3, 4);
+
+    lua_State *states[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        lua_State *S = luaL_newstate();
+        luaL_openlibs(S);
+        luax::init(S);
+        luax::type<Vec>::register_in(S);
+        luax::type<Vec>::push_shared(S, vec);
+        lua_setglobal(S, "v");
+
+        // Same userdata, single reference per state.
+        luax::type<Vec>::push_shared(S, vec);
+        lua_getglobal(S, "v");
+        EXPECT_TRUE(lua_rawequal(S, -1, -2));
+        EXPECT_EQ(vec.get(), luax::type<Vec>::check_get(S, -1));
+        lua_settop(S, 0);
+        states[i] = S;
+    }
+    EXPECT_EQ(4, vec.use_count());
+
+    vec.reset();
+    EXPECT_EQ(1, vec_counter);
+
+    // Each state drops its own reference, the last one deletes.
+    lua_close(states[1]);
+    lua_close(states[2]);
+    EXPECT_EQ(1, vec_counter);
+    lua_State *S = states[0];
+    EXPECT_EQ(0, luaL_dostring(S, "assert(v:len2() == 25); v = nil"));
+    lua_gc(S, LUA_GCCOLLECT, 0);
+    EXPECT_EQ(0, vec_counter);
+    lua_close(S);
+
+    std::shared_ptr<const Vec> none;
+    luax::type<Vec>::push_shared(L, none);
+    EXPECT_TRUE(lua_isnil(L, -1));
+    lua_settop(L, 0);
+}
+//------------------------------------------------------------------------------
+
+// Test: shared instance is read-only.
+TEST_F(LuaxTest, sharedReadOnly)
+{
+    std::shared_ptr<const Vec> vec = std::make_shared<Vec>(3, 4);
+
+    luax::init(L);
+    luax::type<Vec>::register_in(L);
+    luax::type<Vec>::push_shared(L, vec);
+    lua_setglobal(L, "v");
+
+    EXPECT_SCRIPT("assert(v.x == 3 and v:len2() == 25)");
+    EXPECT_FALSE(runScript("v.x = 1"));
+    EXPECT_FALSE(runScript("v.y = 1"));
+    EXPECT_DOUBLE_EQ(3, vec->x);
+
+    // Instances of the same type pushed by value are still writable.
+    EXPECT_SCRIPT("local w = Vec(1, 2); w.x = 5; assert(w.x == 5)");
+}
+//------------------------------------------------------------------------------
+
+// Test: shared push after the raw one takes the reference.
+TEST_F(LuaxTest, sharedAfterRaw)
+{
+    vec_counter = 0;
+    std::shared_ptr<const Vec> vec = std::make_shared<Vec>(3, 4);
+
+    luax::init(L);
+    luax::type<Vec>::register_in(L);
+    luax::type<Vec>::push(L, const_cast<Vec*>(vec.get()), false);
+    lua_setglobal(L, "raw");
+    luax::type<Vec>::push_shared(L, vec);
+    lua_setglobal(L, "v");
+    EXPECT_EQ(2, vec.use_count());
+
+    // Cache now holds the owning userdata.
+    luax::type<Vec>::push_shared(L, vec);
+    lua_getglobal(L, "v");
+    EXPECT_TRUE(lua_rawequal(L, -1, -2));
+    lua_settop(L, 0);
+    EXPECT_EQ(2, vec.use_count());
+
+    vec.reset();
+    EXPECT_SCRIPT("raw = nil; collectgarbage()");
+    EXPECT_EQ(1, vec_counter);
+    EXPECT_SCRIPT("assert(v:len2() == 25)");
+    EXPECT_SCRIPT("v = nil; collectgarbage()");
+    EXPECT_EQ(0, vec_counter);
+}
+//------------------------------------------------------------------------------
+
+// Test: shared instance is used and released by states on many threads.
+TEST_F(LuaxTest, sharedThreads)
+{
+    vec_counter = 0;
+    std::shared_ptr<const Vec> vec = std::make_shared<Vec>(1, 2);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::thread([vec]() {
+            for (int i = 0; i < 50; ++i)
+            {
+                lua_State *S = luaL_newstate();
+                luaL_openlibs(S);
+                luax::init(S);
+                luax::type<Vec>::register_in(S);
+                luax::type<Vec>::push_shared(S, vec);
+                lua_setglobal(S, "v");
+                if (luaL_dostring(S, "for i = 1, 10 do assert(v:len2() == 5) end"))
+                    ADD_FAILURE() << lua_tostring(S, -1);
+                lua_close(S);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    EXPECT_EQ(1, vec.use_count());
+    vec.reset();
+    EXPECT_EQ(0, vec_counter);
+}
+//------------------------------------------------------------------------------
+
 // Test: inheritance.
 struct PointExt: public Point
 {
@@ -393,6 +857,31 @@ TEST_F(LuaxTest, propInherit)
     EXPECT_SCRIPT("assert(p.X == 33)");
 }
 //------------------------------------------------------------------------------
+
+// Test: next states are registered from the compiled type descriptors
+// (preallocated tables), result must be the same.
+TEST_F(LuaxTest, propInheritStates)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        lua_State *S = luaL_newstate();
+        luaL_openlibs(S);
+        luax::init(S);
+        luax::type<Point>::register_in(S);
+        luax::type<PointExt>::register_in(S);
+
+        PointExt pt(10, 20);
+        luax::type<PointExt>::push(S, &pt, false);
+        lua_setglobal(S, "p");
+
+        const char *script = "assert(p.x == 10 and p.X == 10)\n"
+                             "p.x = 11; p.y = 12; p.X = 33\n"
+                             "assert(p.x == 33 and p.y == 12)";
+        EXPECT_EQ(0, luaL_dostring(S, script)) << lua_tostring(S, -1);
+        lua_close(S);
+    }
+}
+//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
 
@@ -424,7 +913,7 @@ template <> int type<PointExt2>::usr_getter(lua_State *L)
     getter_called = true;
     return 1;
 }
-template <> int type<PointExt2>::usr_setter(lua_State *L)
+template <> int type<PointExt2>::usr_setter(lua_State*)
 {
     setter_called = true;
     return 0;
@@ -525,6 +1014,308 @@ TEST_F(LuaxTest, propWithUserIndexBenchSet)
     EXPECT_SCRIPT("for i=1,1000000 do p.x=i end");
 }
 //------------------------------------------------------------------------------
+
+// Test: tag based type check.
+TEST_F(LuaxTest, cast)
+{
+    luax::init(L);
+    luax::type<Point>::register_in(L);
+    luax::type<PointExt>::register_in(L);
+    luax::type<PointExt2>::register_in(L);
+    luax::type<Vec>::register_in(L);
+
+    Point pt;
+    PointExt2 pt2;
+    luax::type<Point>::push(L, &pt, false);         // 1
+    luax::type<PointExt2>::push(L, &pt2, false);    // 2
+    luax::type<Vec>::push_value(L, Vec(1, 2));      // 3
+    lua_pushlightuserdata(L, &pt);                  // 4
+    lua_pushinteger(L, 1);                          // 5
+    lua_getglobal(L, "io");
+    lua_getfield(L, -1, "stdout");                  // 7, foreign userdata
+
+    EXPECT_EQ(&pt, luax::type<Point>::cast(L, 1));
+    EXPECT_EQ(static_cast<Point*>(&pt2), luax::type<Point>::cast(L, 2));
+    EXPECT_EQ(static_cast<PointExt*>(&pt2), luax::type<PointExt>::cast(L, 2));
+    EXPECT_EQ(&pt2, luax::type<PointExt2>::cast(L, 2));
+
+    // Base instance is not derived one.
+    EXPECT_EQ(nullptr, luax::type<PointExt>::cast(L, 1));
+    EXPECT_EQ(nullptr, luax::type<PointExt2>::cast(L, 1));
+
+    EXPECT_EQ(nullptr, luax::type<Point>::cast(L, 3));
+    EXPECT_EQ(1, luax::type<Vec>::cast(L, 3)->x);
+    EXPECT_EQ(nullptr, luax::type<Point>::cast(L, 4));
+    EXPECT_EQ(nullptr, luax::type<Point>::cast(L, 5));
+    EXPECT_EQ(nullptr, luax::type<Point>::cast(L, 7));
+
+    // check_cast() raises an error.
+    lua_settop(L, 2);
+    lua_setglobal(L, "p2");
+    lua_setglobal(L, "p");
+    lua_pushcfunction(L, [](lua_State *L) {
+        luax::type<Point>::check_cast(L, 1);
+        return 0;
+    });
+    lua_setglobal(L, "check");
+
+    EXPECT_SCRIPT("check(p)");
+    EXPECT_SCRIPT("check(p2)");
+    EXPECT_FALSE(runScript("check(io.stdout)"));
+    EXPECT_FALSE(runScript("check(Vec(1, 2))"));
+    EXPECT_FALSE(runScript("check({})"));
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+
+// Inheritance chain to test properties access on different depths:
+// Level<1> <- Level<2> <- ... <- Level<6>.
+template <int N> struct Level: public Level<N - 1> {};
+
+template <> struct Level<1>
+{
+    int x;
+    Level(): x(0) {}
+
+    int getX(lua_State *L)
+    {
+        lua_pushinteger(L, x);
+        return 1;
+    }
+
+    int setX(lua_State *L)
+    {
+        x = static_cast<int>(luaL_checkinteger(L, 1));
+        return 0;
+    }
+};
+
+LUAX_TYPE_NAME(Level<1>, "Level1")
+LUAX_FUNCTIONS_M_BEGIN(Level<1>)
+    LUAX_FUNCTION("getX", &Level<1>::getX)
+LUAX_FUNCTIONS_END
+LUAX_PROPERTIES_M_BEGIN(Level<1>)
+    LUAX_PROPERTY("x", &Level<1>::getX, &Level<1>::setX)
+    LUAX_PROPERTY("y", &Level<1>::getX, &Level<1>::setX)
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(Level<2>, "Level2")
+LUAX_TYPE_SUPER_NAME(Level<2>, "Level1")
+LUAX_TYPE_NAME(Level<3>, "Level3")
+LUAX_TYPE_SUPER_NAME(Level<3>, "Level2")
+LUAX_TYPE_NAME(Level<4>, "Level4")
+LUAX_TYPE_SUPER_NAME(Level<4>, "Level3")
+LUAX_TYPE_NAME(Level<5>, "Level5")
+LUAX_TYPE_SUPER_NAME(Level<5>, "Level4")
+LUAX_TYPE_NAME(Level<6>, "Level6")
+LUAX_TYPE_SUPER_NAME(Level<6>, "Level5")
+
+// Level<3> overrides superclass property 'y' with a method.
+static int level3_y(lua_State *L)
+{
+    lua_pushinteger(L, 33);
+    return 1;
+}
+
+LUAX_FUNCTIONS_BEGIN(Level<3>)
+    LUAX_FUNCTION("y", level3_y)
+LUAX_FUNCTIONS_END
+
+class LuaxLevelTest: public BaseLuaxTest
+{
+protected:
+    void SetUp() override
+    {
+        BaseLuaxTest::SetUp();
+        luax::init(L);
+        luax::type<Level<1> >::register_in(L);
+        luax::type<Level<2> >::register_in(L);
+        luax::type<Level<3> >::register_in(L);
+        luax::type<Level<4> >::register_in(L);
+        luax::type<Level<5> >::register_in(L);
+        luax::type<Level<6> >::register_in(L);
+    }
+
+    template <int N> void pushLevel(const char *name)
+    {
+        luax::type<Level<N> >::push(L, &level<N>(), false);
+        lua_setglobal(L, name);
+    }
+
+    template <int N> Level<N>& level()
+    {
+        static Level<N> obj;
+        return obj;
+    }
+};
+
+// Test: inherited attributes access on different depths.
+TEST_F(LuaxLevelTest, propDeepInherit)
+{
+    pushLevel<2>("p2");
+    pushLevel<6>("p6");
+
+    EXPECT_SCRIPT("p2.x = 12");
+    EXPECT_SCRIPT("assert(p2.x == 12)");
+    EXPECT_SCRIPT("assert(p2:getX() == 12)");
+    EXPECT_SCRIPT("assert(p2.fake == nil)");
+
+    EXPECT_SCRIPT("p6.x = 42");
+    EXPECT_SCRIPT("assert(p6.x == 42)");
+    EXPECT_SCRIPT("assert(p6:getX() == 42)");
+
+    // Level<3> hides 'y' property by the method,
+    // but setter is still inherited.
+    EXPECT_SCRIPT("p6.y = 43");
+    EXPECT_SCRIPT("assert(type(p6.y) == 'function')");
+    EXPECT_SCRIPT("assert(p6:y() == 33)");
+    EXPECT_SCRIPT("assert(p6:getX() == 43)");
+    EXPECT_SCRIPT("assert(p2.y == 12)");
+    EXPECT_SCRIPT("assert(p6.fake == nil)");
+}
+//------------------------------------------------------------------------------
+
+// Base type without properties, its usr_instance_mt() adds members.
+struct Shape
+{
+    int r;
+};
+
+struct Circle: public Shape
+{
+};
+
+static int shape_area(lua_State *L)
+{
+    lua_pushinteger(L, 3 * luax::type<Shape>::check_cast(L, 1)->r);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+static int shape_kind(lua_State *L)
+{
+    lua_pushliteral(L, "shape");
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+static int circle_r(lua_State *L)
+{
+    lua_pushinteger(L, luax::type<Circle>::check_cast(L, 1)->r);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Shape, "Shape")
+LUAX_FUNCTIONS_BEGIN(Shape)
+    LUAX_FUNCTION("area", shape_area)
+LUAX_FUNCTIONS_END
+
+LUAX_TYPE_NAME(Circle, "Circle")
+LUAX_TYPE_SUPER_NAME(Circle, "Shape")
+LUAX_PROPERTIES_BEGIN(Circle)
+    LUAX_PROPERTY("r", circle_r, 0)
+LUAX_PROPERTIES_END
+
+namespace luax {
+template <> void type<Shape>::usr_instance_mt(lua_State *L)
+{
+    lua_pushcfunction(L, shape_kind);
+    lua_setfield(L, -2, "kind");
+    lua_createtable(L, 0, 1);
+    lua_pushinteger(L, 0);
+    lua_setfield(L, -2, "sides");
+    lua_setfield(L, -2, "info");
+}
+}
+
+// Test: attributes and state specific members of the superclass without
+// properties are inherited, in every state.
+TEST_F(LuaxTest, inheritExtras)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        lua_State *S = luaL_newstate();
+        luaL_openlibs(S);
+        luax::init(S);
+        luax::type<Shape>::register_in(S);
+        luax::type<Circle>::register_in(S);
+
+        Circle c;
+        c.r = 2;
+        luax::type<Circle>::push(S, &c, false);
+        lua_setglobal(S, "c");
+
+        const char *script = "assert(c.r == 2 and c:area() == 6)\n"
+                             "assert(c:kind() == 'shape' and c.fake == nil)\n"
+                             "assert(c.info.sides == 0)\n"
+                             "assert(rawget(getmetatable(c), 'area') == nil)";
+        EXPECT_EQ(0, luaL_dostring(S, script)) << lua_tostring(S, -1);
+        lua_close(S);
+    }
+}
+//------------------------------------------------------------------------------
+
+// Types registered only by inheritOrder test, so the first registration
+// of Grass happens without the superclass.
+struct Ground
+{
+    int height;
+};
+
+struct Grass: public Ground
+{
+};
+
+static int ground_height(lua_State *L)
+{
+    lua_pushinteger(L, luax::type<Ground>::check_cast(L, 1)->height);
+    return 1;
+}
+//------------------------------------------------------------------------------
+
+LUAX_TYPE_NAME(Ground, "Ground")
+LUAX_PROPERTIES_BEGIN(Ground)
+    LUAX_PROPERTY("height", ground_height, 0)
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(Grass, "Grass")
+LUAX_TYPE_SUPER_NAME(Grass, "Ground")
+
+static int register_grass(lua_State *L)
+{
+    luax::type<Grass>::register_in(L);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+// Test: derived type can't be registered before the superclass, failed
+// registration doesn't affect other states.
+TEST_F(LuaxTest, inheritOrder)
+{
+    lua_State *S = luaL_newstate();
+    luax::init(S);
+    lua_pushcfunction(S, register_grass);
+    ASSERT_NE(0, lua_pcall(S, 0, 0, 0));
+    EXPECT_STREQ("Superclass Ground of Grass is not registered",
+                 lua_tostring(S, -1));
+    lua_pop(S, 1);
+    luaL_getmetatable(S, "Grass");
+    EXPECT_TRUE(lua_isnil(S, -1));
+    lua_close(S);
+
+    luax::init(L);
+    luax::type<Ground>::register_in(L);
+    luax::type<Grass>::register_in(L);
+    Grass g;
+    g.height = 3;
+    luax::type<Grass>::push(L, &g, false);
+    lua_setglobal(L, "g");
+    EXPECT_SCRIPT("assert(g.height == 3)");
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 
 LUAX_TYPE_ENUMS_BEGIN(Point)
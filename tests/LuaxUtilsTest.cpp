@@ -221,6 +221,91 @@ TEST_F(LuaxUtilsTest, rawset_field)
 }
 //------------------------------------------------------------------------------
 
+// Test: Ref.
+TEST_F(LuaxUtilsTest, ref)
+{
+    lua_pushstring(L, "hello");
+    luax::Ref ref(L, -1);
+    lua_pop(L, 1);
+    EXPECT_TRUE(ref.valid());
+    EXPECT_EQ(std::string("hello"), ref.get<std::string>());
+
+    luax::Ref other(std::move(ref));
+    EXPECT_FALSE(ref.valid());
+    other.push();
+    EXPECT_STREQ("hello", lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    other.reset();
+    EXPECT_FALSE(other.valid());
+    EXPECT_EQ(0, lua_gettop(L));
+}
+//------------------------------------------------------------------------------
+
+// Test: field helpers with interned keys.
+TEST_F(LuaxUtilsTest, key)
+{
+    EXPECT_SCRIPT(
+                "tbl = {}\n"
+                "mt = {\n"
+                "__index = function(o,k) return 42 end,\n"
+                "__newindex = function(o,k,v) fake = v end}\n"
+                "setmetatable(tbl, mt)"
+            );
+
+    luax::Key num(L, "num");
+    EXPECT_EQ(L, num.state());
+    lua_getglobal(L, "tbl");
+
+    EXPECT_EQ(42, luax::get_field<int>(L, -1, num));
+    EXPECT_EQ(0, luax::rawget_field<int>(L, 1, num));
+    EXPECT_EQ(1, lua_gettop(L));
+
+    luax::set_field(L, -1, num, 7);
+    EXPECT_EQ(7, luax::get_global<int>(L, "fake"));
+    EXPECT_EQ(0, luax::rawget_field<int>(L, -1, num));
+
+    luax::rawset_field(L, 1, num, "str");
+    EXPECT_EQ(1, lua_gettop(L));
+    EXPECT_EQ(std::string("str"), luax::rawget_field<std::string>(L, -1, num));
+    EXPECT_EQ(std::string("str"), luax::get_field<std::string>(L, -1, "num"));
+}
+//------------------------------------------------------------------------------
+
+// Test: FieldPath.
+TEST_F(LuaxUtilsTest, fieldPath)
+{
+    EXPECT_SCRIPT("cfg = {net = {timeout = 10}}\n"
+                  "top = 5");
+
+    luax::FieldPath timeout(L, "cfg.net.timeout");
+    EXPECT_EQ(10, timeout.get<int>());
+    EXPECT_TRUE(timeout.set(20));
+    EXPECT_SCRIPT("assert(cfg.net.timeout == 20)");
+
+    // Leaf is not cached.
+    EXPECT_SCRIPT("cfg.net.timeout = 30");
+    EXPECT_EQ(30, timeout.get<int>());
+
+    // Parent tables are cached until invalidate().
+    EXPECT_SCRIPT("cfg.net = {timeout = 40}");
+    EXPECT_EQ(30, timeout.get<int>());
+    timeout.invalidate();
+    EXPECT_EQ(40, timeout.get<int>());
+
+    luax::FieldPath top(L, "top");
+    EXPECT_EQ(5, top.get<int>());
+    EXPECT_TRUE(top.set("str"));
+    EXPECT_EQ(std::string("str"), luax::get_global<std::string>(L, "top"));
+
+    luax::FieldPath bad(L, "cfg.none.x");
+    EXPECT_FALSE(bad.resolve());
+    EXPECT_EQ(0, bad.get<int>());
+    EXPECT_FALSE(bad.set(1));
+    EXPECT_EQ(0, lua_gettop(L));
+}
+//------------------------------------------------------------------------------
+
 
 int f_void(lua_State *L)
 {
@@ -0,0 +1,74 @@
+#include <vector>
+#include "bench.h"
+#include "luax.h"
+#include "luax_array.h"
+
+// Per element lua loops vs bulk array methods, 1024 elements per iteration.
+
+BENCH_SUITE(array)
+{
+    bench::State L;
+    luax::init(L);
+    luax::register_arrays(L);
+
+    const size_t size = 1024;
+    std::vector<float> a(size), b(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        a[i] = static_cast<float>(i % 17);
+        b[i] = static_cast<float>(i % 13) * 0.5f;
+    }
+
+    r.run("array/kernel/sum/scalar", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::simd::scalar_kernels<float>::sum(a.data(), size));
+    });
+
+    r.run("array/kernel/sum/simd", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::simd::kernels<float>::sum(a.data(), size));
+    });
+
+    r.run("array/kernel/dot/scalar", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::simd::scalar_kernels<float>::dot(a.data(), b.data(), size));
+    });
+
+    r.run("array/kernel/dot/simd", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::simd::kernels<float>::dot(a.data(), b.data(), size));
+    });
+
+    // Lua side.
+
+    lua_createtable(L, static_cast<int>(size), 0);
+    for (size_t i = 0; i < size; ++i)
+    {
+        lua_pushnumber(L, a[i]);
+        lua_rawseti(L, -2, static_cast<int>(i + 1));
+    }
+    bench::Loop table_sum(L, "local t, n = ...\n"
+                             "for k = 1, n do\n"
+                             "  local s = 0\n"
+                             "  for i = 1, #t do s = s + t[i] end\n"
+                             "end");
+    r.run("array/sum/table_loop", 10000, [&](long n) { table_sum(n); });
+
+    const char *index_loop = "local a, n = ...\n"
+                             "for k = 1, n do\n"
+                             "  local s = 0\n"
+                             "  for i = 1, #a do s = s + a[i] end\n"
+                             "end";
+    luax::push_array(L, a.data(), size);
+    bench::Loop array_index(L, index_loop);
+    r.run("array/sum/index_loop", 10000, [&](long n) { array_index(n); });
+
+    luax::push_array(L, a.data(), size);
+    bench::Loop array_sum(L, "local a, n = ...; for k = 1, n do local s = a:sum() end");
+    r.run("array/sum/method", 10000, [&](long n) { array_sum(n); });
+
+    luax::push_array(L, a.data(), size);
+    bench::Loop array_scale(L, "local a, n = ...; for k = 1, n do a:scale(1) end");
+    r.run("array/scale/method", 10000, [&](long n) { array_scale(n); });
+}
+//------------------------------------------------------------------------------
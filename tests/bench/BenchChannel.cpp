@@ -0,0 +1,84 @@
+#include <string>
+#include "bench.h"
+#include "luax_channel.h"
+
+// Message encoding and channel round trip between two states.
+
+namespace {
+
+const char *message =
+    "return {id = 42, kind = 'update', ratio = 0.75, ok = true,"
+    " tags = {'a', 'b', 'c'}, values = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10,"
+    " 11, 12, 13, 14, 15, 16}, pos = {x = 1.5, y = -2.5, z = 0}}";
+
+// Text serialization in lua, for comparison.
+const char *text_codec =
+    "local fmt, concat = string.format, table.concat\n"
+    "function serialize(v)\n"
+    "  local t = type(v)\n"
+    "  if t == 'table' then\n"
+    "    local out = {}\n"
+    "    for k, x in pairs(v) do\n"
+    "      out[#out + 1] = '[' .. serialize(k) .. ']=' .. serialize(x)\n"
+    "    end\n"
+    "    return '{' .. concat(out, ',') .. '}'\n"
+    "  elseif t == 'string' then return fmt('%q', v)\n"
+    "  else return tostring(v) end\n"
+    "end\n";
+
+} // namespace
+
+BENCH_SUITE(channel)
+{
+    bench::State L;
+    bench::State L2;
+
+    luaL_dostring(L, message);
+    std::string buf;
+    luax::encode(L, 1, 1, buf);
+
+    r.run("channel/encode", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            buf.clear();
+            luax::encode(L, 1, 1, buf);
+            bench::keep(buf.size());
+        }
+    });
+
+    r.run("channel/decode", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::decode(L2, buf.data(), buf.size());
+            lua_pop(L2, 1);
+        }
+    });
+
+    luax::Channel chan(16);
+    r.run("channel/send_receive", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            chan.send(L, 1, 1);
+            chan.receive(L2);
+            lua_pop(L2, 1);
+        }
+    });
+
+    luaL_dostring(L, text_codec);
+    r.run("channel/lua_text", 10000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_getglobal(L, "serialize");
+            lua_pushvalue(L, 1);
+            lua_call(L, 1, 1);
+            size_t len;
+            const char *txt = lua_tolstring(L, -1, &len);
+            std::string chunk = std::string("return ") + std::string(txt, len);
+            luaL_loadbuffer(L2, chunk.data(), chunk.size(), "msg");
+            lua_call(L2, 0, 1);
+            lua_pop(L2, 1);
+            lua_pop(L, 1);
+        }
+    });
+}
+//------------------------------------------------------------------------------
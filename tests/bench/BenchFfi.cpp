@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "luax.h"
+#include "luax_ffi.h"
+
+// Field access through luax properties vs LuaJIT FFI cdata.
+
+namespace {
+
+struct Particle
+{
+    double x;
+    double y;
+};
+//------------------------------------------------------------------------------
+
+int particle_x(lua_State *L)
+{
+    Particle *p = luax::type<Particle>::get(L, 1);
+    if (lua_gettop(L) == 1)
+    {
+        lua_pushnumber(L, p->x);
+        return 1;
+    }
+    p->x = luaL_checknumber(L, 2);
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+} // namespace
+
+LUAX_TYPE_NAME(Particle, "Particle")
+
+LUAX_PROPERTIES_BEGIN(Particle)
+    LUAX_PROPERTY("x", particle_x, particle_x)
+LUAX_PROPERTIES_END
+
+LUAX_FFI_FIELDS_BEGIN(Particle)
+    LUAX_FFI_FIELD(Particle, x)
+    LUAX_FFI_FIELD(Particle, y)
+LUAX_FFI_FIELDS_END
+
+BENCH_SUITE(ffi)
+{
+    bench::State L;
+    luax::init(L);
+    luax::type<Particle>::register_in(L);
+
+    Particle p = {1, 2};
+    const char *get = "local o, n = ...; local s = 0; for i = 1, n do s = s + o.x end";
+    const char *set = "local o, n = ...; for i = 1, n do o.x = i end";
+
+    luax::type<Particle>::push(L, &p, false);
+    bench::Loop ud_get(L, get);
+    r.run("ffi/userdata/get", 1000000, [&](long n) { ud_get(n); });
+
+    luax::type<Particle>::push(L, &p, false);
+    bench::Loop ud_set(L, set);
+    r.run("ffi/userdata/set", 1000000, [&](long n) { ud_set(n); });
+
+    // Without FFI (PUC Lua) push() gives the same userdata.
+    if (!luax::ffi<Particle>::register_in(L))
+        return;
+
+    luax::ffi<Particle>::push(L, &p);
+    bench::Loop cdata_get(L, get);
+    r.run("ffi/cdata/get", 1000000, [&](long n) { cdata_get(n); });
+
+    luax::ffi<Particle>::push(L, &p);
+    bench::Loop cdata_set(L, set);
+    r.run("ffi/cdata/set", 1000000, [&](long n) { cdata_set(n); });
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,38 @@
+#include <vector>
+#include "bench.h"
+#include "luax_function.h"
+
+// Calling lua function from C++: lookup by name vs pinned reference.
+
+BENCH_SUITE(function)
+{
+    bench::State L;
+    luaL_dostring(L, "function add(a, b) return a + b end");
+
+    r.run("function/call/getglobal", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_getglobal(L, "add");
+            luax::push(L, static_cast<int>(i));
+            luax::push(L, 1);
+            if (lua_pcall(L, 2, 1, 0) == 0)
+                bench::keep(luax::get<int>(L, -1));
+            lua_pop(L, 1);
+        }
+    });
+
+    luax::Function<int(int, int)> add(L, "add");
+    r.run("function/call/pinned", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(add(static_cast<int>(i), 1));
+    });
+
+    std::vector<std::tuple<int, int> > args(1024, std::make_tuple(1, 2));
+    std::vector<int> res(args.size());
+    r.run("function/call/batch", 1000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            add.call_all(args.begin(), args.end(), res.begin());
+        bench::keep(res[0]);
+    });
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,97 @@
+#include "bench.h"
+#include "luax.h"
+
+// State startup: register 500 types (with methods, properties, enums and
+// inheritance) in a fresh state.
+
+namespace {
+
+template <int N>
+struct Kind
+{
+    int value;
+};
+
+int kind_func(lua_State *L)
+{
+    lua_pushinteger(L, 0);
+    return 1;
+}
+
+} // namespace
+
+#define BENCH_KIND(a, b, c)                                         \
+    LUAX_TYPE_NAME(Kind<a * 100 + b * 10 + c>, "Kind" #a #b #c)     \
+    LUAX_FUNCTIONS_BEGIN(Kind<a * 100 + b * 10 + c>)                \
+        LUAX_FUNCTION("value", kind_func)                           \
+        LUAX_FUNCTION("reset", kind_func)                           \
+        LUAX_FUNCTION("update", kind_func)                          \
+        LUAX_FUNCTION("draw", kind_func)                            \
+    LUAX_FUNCTIONS_END                                              \
+    LUAX_PROPERTIES_BEGIN(Kind<a * 100 + b * 10 + c>)               \
+        LUAX_PROPERTY("x", kind_func, kind_func)                    \
+        LUAX_PROPERTY("y", kind_func, kind_func)                    \
+        LUAX_PROPERTY("visible", kind_func, 0)                      \
+    LUAX_PROPERTIES_END                                             \
+    LUAX_TYPE_ENUMS_BEGIN(Kind<a * 100 + b * 10 + c>)               \
+        LUAX_ENUM("SMALL", 1)                                  \
+        LUAX_ENUM("LARGE", 2)                                  \
+    LUAX_TYPE_ENUMS_END
+
+// Odd types derive from the previous one.
+#define BENCH_KIND_SUPER(a, b, c)                                   \
+    BENCH_KIND(a, b, c)                                             \
+    LUAX_TYPE_SUPER_NAME(Kind<a * 100 + b * 10 + c + 1>, "Kind" #a #b #c)
+
+#define BENCH_KIND_10(a, b)                                         \
+    BENCH_KIND_SUPER(a, b, 0) BENCH_KIND(a, b, 1)                   \
+    BENCH_KIND_SUPER(a, b, 2) BENCH_KIND(a, b, 3)                   \
+    BENCH_KIND_SUPER(a, b, 4) BENCH_KIND(a, b, 5)                   \
+    BENCH_KIND_SUPER(a, b, 6) BENCH_KIND(a, b, 7)                   \
+    BENCH_KIND_SUPER(a, b, 8) BENCH_KIND(a, b, 9)
+
+#define BENCH_KIND_100(a)                                           \
+    BENCH_KIND_10(a, 0) BENCH_KIND_10(a, 1) BENCH_KIND_10(a, 2)     \
+    BENCH_KIND_10(a, 3) BENCH_KIND_10(a, 4) BENCH_KIND_10(a, 5)     \
+    BENCH_KIND_10(a, 6) BENCH_KIND_10(a, 7) BENCH_KIND_10(a, 8)     \
+    BENCH_KIND_10(a, 9)
+
+BENCH_KIND_100(0)
+BENCH_KIND_100(1)
+BENCH_KIND_100(2)
+BENCH_KIND_100(3)
+BENCH_KIND_100(4)
+
+namespace {
+
+template <int N>
+struct Registrar
+{
+    static void run(lua_State *L)
+    {
+        Registrar<N - 1>::run(L);
+        luax::type<Kind<N - 1> >::register_in(L);
+    }
+};
+
+template <>
+struct Registrar<0>
+{
+    static void run(lua_State*) {}
+};
+
+} // namespace
+
+BENCH_SUITE(register)
+{
+    r.run("register/500_types", 10, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_State *L = luaL_newstate();
+            luax::init(L);
+            Registrar<500>::run(L);
+            lua_close(L);
+        }
+    });
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,33 @@
+#include "bench.h"
+#include "luax_scheduler.h"
+
+// Throughput of lua calls by the number of workers. Each job runs a small
+// lua loop, time per job should drop with the workers count up to the
+// number of cores.
+
+static void setup(lua_State *L)
+{
+    luaL_openlibs(L);
+    luaL_dostring(L, "function work(n)\n"
+                     "  local s = 0\n"
+                     "  for i = 1, n do s = s + i % 7 end\n"
+                     "  return s\n"
+                     "end");
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(scheduler)
+{
+    const size_t workers[] = {1, 2, 4, 8};
+    for (size_t k = 0; k < sizeof(workers) / sizeof(workers[0]); ++k)
+    {
+        luax::Scheduler sched(workers[k], setup);
+        std::string name = "scheduler/call/workers_" + std::to_string(workers[k]);
+        r.run(name, 2000, [&](long n) {
+            for (long i = 0; i < n; ++i)
+                sched.call("work", 500);
+            sched.wait();
+        });
+    }
+}
+//------------------------------------------------------------------------------
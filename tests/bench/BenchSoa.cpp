@@ -0,0 +1,53 @@
+#include <vector>
+#include "bench.h"
+#include "luax.h"
+#include "luax_soa.h"
+
+// Per entity loop vs whole column operations, 1024 entities per iteration.
+
+namespace {
+
+struct Particles
+{
+    std::vector<float> x;
+    std::vector<float> vx;
+};
+
+} // namespace
+
+LUAX_TYPE_NAME(Particles, "Particles")
+LUAX_PROPERTIES_BEGIN(Particles)
+    LUAX_SOA_COLUMN(Particles, x)
+    LUAX_SOA_COLUMN(Particles, vx)
+LUAX_PROPERTIES_END
+
+BENCH_SUITE(soa)
+{
+    bench::State L;
+    luax::init(L);
+    luax::register_arrays(L);
+    luax::type<Particles>::register_in(L);
+
+    Particles p;
+    p.x.assign(1024, 0);
+    p.vx.assign(1024, 1);
+
+    luax::type<Particles>::push(L, &p, false);
+    bench::Loop entity(L, "local p, n = ...\n"
+                          "local x, vx = p.x, p.vx\n"
+                          "for k = 1, n do\n"
+                          "  for i = 1, #x do x[i] = x[i] + vx[i] * 0.01 end\n"
+                          "end");
+    r.run("soa/integrate/entity_loop", 1000, [&](long n) { entity(n); });
+
+    luax::type<Particles>::push(L, &p, false);
+    bench::Loop column(L, "local p, n = ...\n"
+                          "for k = 1, n do p.x:axpy(0.01, p.vx) end");
+    r.run("soa/integrate/column", 1000, [&](long n) { column(n); });
+
+    luax::type<Particles>::push(L, &p, false);
+    bench::Loop mask(L, "local p, n = ...\n"
+                        "for k = 1, n do p.vx:where(p.x:cmp('>', 100), 0) end");
+    r.run("soa/mask/column", 1000, [&](long n) { mask(n); });
+}
+//------------------------------------------------------------------------------
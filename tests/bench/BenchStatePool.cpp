@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "luax.h"
+#include "luax_state_pool.h"
+
+// Fresh state with registered types vs pooled state.
+
+namespace {
+
+template <int N>
+struct Kind
+{
+    int value;
+};
+
+int kind_value(lua_State *L)
+{
+    lua_pushinteger(L, 0);
+    return 1;
+}
+
+} // namespace
+
+#define BENCH_KIND(n)                                       \
+    LUAX_TYPE_NAME(Kind<n>, "Kind" #n)                      \
+    LUAX_FUNCTIONS_BEGIN(Kind<n>)                           \
+        LUAX_FUNCTION("value", kind_value)                  \
+        LUAX_FUNCTION("other", kind_value)                  \
+    LUAX_FUNCTIONS_END
+
+BENCH_KIND(0) BENCH_KIND(1) BENCH_KIND(2) BENCH_KIND(3)
+BENCH_KIND(4) BENCH_KIND(5) BENCH_KIND(6) BENCH_KIND(7)
+
+static void setup(lua_State *L)
+{
+    luaL_openlibs(L);
+    luax::init(L);
+    luax::type<Kind<0> >::register_in(L);
+    luax::type<Kind<1> >::register_in(L);
+    luax::type<Kind<2> >::register_in(L);
+    luax::type<Kind<3> >::register_in(L);
+    luax::type<Kind<4> >::register_in(L);
+    luax::type<Kind<5> >::register_in(L);
+    luax::type<Kind<6> >::register_in(L);
+    luax::type<Kind<7> >::register_in(L);
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(state_pool)
+{
+    r.run("state_pool/new_state", 100, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_State *L = luaL_newstate();
+            setup(L);
+            bench::keep(L);
+            lua_close(L);
+        }
+    });
+
+    luax::StatePool pool(setup, 1);
+    r.run("state_pool/checkout", 100, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::StatePool::Lease L = pool.lease();
+            bench::keep(L.get());
+        }
+    });
+}
+//------------------------------------------------------------------------------
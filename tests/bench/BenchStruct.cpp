@@ -0,0 +1,78 @@
+#include <string>
+#include "bench.h"
+#include "luax_struct.h"
+
+// Struct to table and back: field by field helpers vs LUAX_STRUCT().
+
+namespace {
+
+struct Request
+{
+    Request(): id(0), priority(0), timeout(0), retry(false) {}
+
+    std::string method;
+    std::string path;
+    int id;
+    int priority;
+    double timeout;
+    bool retry;
+};
+
+} // namespace
+
+LUAX_STRUCT(Request, (method)(path)(id)(priority)(timeout)(retry))
+
+BENCH_SUITE(struct)
+{
+    bench::State L;
+
+    Request req;
+    req.method = "GET";
+    req.path = "/index";
+    req.id = 1;
+    req.timeout = 2.5;
+
+    r.run("struct/push/fields", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_newtable(L);
+            luax::set_field(L, -1, "method", req.method.c_str());
+            luax::set_field(L, -1, "path", req.path.c_str());
+            luax::set_field(L, -1, "id", req.id);
+            luax::set_field(L, -1, "priority", req.priority);
+            luax::set_field(L, -1, "timeout", req.timeout);
+            luax::set_field(L, -1, "retry", req.retry);
+            lua_pop(L, 1);
+        }
+    });
+
+    r.run("struct/push/reflected", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::push(L, req);
+            lua_pop(L, 1);
+        }
+    });
+
+    luax::push(L, req);
+    r.run("struct/get/fields", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            Request v;
+            v.method = luax::get_field<std::string>(L, -1, "method");
+            v.path = luax::get_field<std::string>(L, -1, "path");
+            v.id = luax::get_field<int>(L, -1, "id");
+            v.priority = luax::get_field<int>(L, -1, "priority");
+            v.timeout = luax::get_field<double>(L, -1, "timeout");
+            v.retry = luax::get_field<bool>(L, -1, "retry");
+            bench::keep(v.id);
+        }
+    });
+
+    r.run("struct/get/reflected", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::get<Request>(L, -1).id);
+    });
+    lua_pop(L, 1);
+}
+//------------------------------------------------------------------------------
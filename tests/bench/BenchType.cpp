@@ -0,0 +1,467 @@
+#include "bench.h"
+#include "luax.h"
+#include "luax_bind.h"
+#include "luax_pool.h"
+#include <memory>
+#include <vector>
+
+// Benchmarks for luax::type: push, get, method calls, properties
+// and create/gc.
+
+namespace {
+
+struct Point
+{
+    int x;
+    int y;
+
+    Point(int x = 0, int y = 0): x(x), y(y) {}
+
+    int getX(lua_State *L)
+    {
+        lua_pushinteger(L, x);
+        return 1;
+    }
+
+    int setX(lua_State *L)
+    {
+        x = static_cast<int>(luaL_checkinteger(L, 1));
+        return 0;
+    }
+
+    int move(lua_State *L)
+    {
+        x += static_cast<int>(luaL_checkinteger(L, 1));
+        return 0;
+    }
+
+    int moveSelf(lua_State *L)
+    {
+        x += static_cast<int>(luaL_checkinteger(L, 2));
+        return 0;
+    }
+
+    void moveTyped(int dx) { x += dx; }
+};
+//------------------------------------------------------------------------------
+
+int pt_move(lua_State *L)
+{
+    Point *pt = luax::type<Point>::get(L, 1);
+    pt->x += static_cast<int>(luaL_checkinteger(L, 2));
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+int pt_y(lua_State *L)
+{
+    Point *pt = luax::type<Point>::get(L, 1);
+    if (lua_gettop(L) == 1)
+    {
+        lua_pushinteger(L, pt->y);
+        return 1;
+    }
+    pt->y = static_cast<int>(luaL_checkinteger(L, 2));
+    return 0;
+}
+//------------------------------------------------------------------------------
+
+struct PointExt: public Point {};
+
+// Same as Point but allocated in luax::Pool when created from lua.
+struct PooledPoint: public Point
+{
+    PooledPoint(int x, int y): Point(x, y) {}
+};
+
+struct Vec
+{
+    double x;
+    double y;
+
+    Vec(double x = 0, double y = 0): x(x), y(y) {}
+};
+//------------------------------------------------------------------------------
+
+// Inheritance chain to measure property access depth:
+// Level<1> <- Level<2> <- ... <- Level<6>.
+template <int N> struct Level: public Level<N - 1> {};
+
+template <> struct Level<1>
+{
+    int x;
+
+    Level(): x(0) {}
+
+    int getX(lua_State *L)
+    {
+        lua_pushinteger(L, x);
+        return 1;
+    }
+
+    int setX(lua_State *L)
+    {
+        x = static_cast<int>(luaL_checkinteger(L, 1));
+        return 0;
+    }
+};
+//------------------------------------------------------------------------------
+
+} // namespace
+
+
+LUAX_TYPE_NAME(Point, "Point")
+
+LUAX_FUNCTIONS_BEGIN(Point)
+    LUAX_FUNCTION("moveC", pt_move)
+    LUAX_FUNCTION("moveT", LUAX_METHOD(&Point::move))
+    LUAX_FUNCTION("moveTS", LUAX_METHOD_SELF(&Point::moveSelf))
+    LUAX_FUNCTION("moveB", LUAX_BIND(&Point::moveTyped))
+LUAX_FUNCTIONS_END
+
+LUAX_FUNCTIONS_M_BEGIN(Point)
+    LUAX_FUNCTION("move", &Point::move)
+    LUAX_FUNCTION("getX", &Point::getX)
+LUAX_FUNCTIONS_END
+
+LUAX_PROPERTIES_BEGIN(Point)
+    LUAX_PROPERTY("y", pt_y, pt_y)
+LUAX_PROPERTIES_END
+
+LUAX_PROPERTIES_M_BEGIN(Point)
+    LUAX_PROPERTY("x", &Point::getX, &Point::setX)
+LUAX_PROPERTIES_END
+
+namespace luax {
+template <> Point* type<Point>::usr_constructor(lua_State *L)
+{
+    return new Point(static_cast<int>(luaL_optinteger(L, 2, 0)),
+                     static_cast<int>(luaL_optinteger(L, 3, 0)));
+}
+}
+
+LUAX_TYPE_NAME(PointExt, "PointExt")
+LUAX_TYPE_SUPER_NAME(PointExt, "Point")
+
+LUAX_TYPE_NAME(PooledPoint, "PooledPoint")
+LUAX_TYPE_POOL(PooledPoint)
+
+namespace luax {
+template <> PooledPoint* type<PooledPoint>::usr_inplace_constructor(lua_State *L,
+                                                                    void *mem)
+{
+    return new (mem) PooledPoint(static_cast<int>(luaL_optinteger(L, 2, 0)),
+                                 static_cast<int>(luaL_optinteger(L, 3, 0)));
+}
+}
+
+LUAX_TYPE_NAME(Vec, "Vec")
+LUAX_TYPE_INPLACE(Vec)
+
+namespace luax {
+template <> Vec* type<Vec>::usr_inplace_constructor(lua_State *L, void *mem)
+{
+    return new (mem) Vec(luaL_optnumber(L, 2, 0), luaL_optnumber(L, 3, 0));
+}
+}
+
+LUAX_TYPE_NAME(Level<1>, "Level1")
+LUAX_PROPERTIES_M_BEGIN(Level<1>)
+    LUAX_PROPERTY("x", &Level<1>::getX, &Level<1>::setX)
+LUAX_PROPERTIES_END
+
+LUAX_TYPE_NAME(Level<2>, "Level2")
+LUAX_TYPE_SUPER_NAME(Level<2>, "Level1")
+LUAX_TYPE_NAME(Level<3>, "Level3")
+LUAX_TYPE_SUPER_NAME(Level<3>, "Level2")
+LUAX_TYPE_NAME(Level<4>, "Level4")
+LUAX_TYPE_SUPER_NAME(Level<4>, "Level3")
+LUAX_TYPE_NAME(Level<5>, "Level5")
+LUAX_TYPE_SUPER_NAME(Level<5>, "Level4")
+LUAX_TYPE_NAME(Level<6>, "Level6")
+LUAX_TYPE_SUPER_NAME(Level<6>, "Level5")
+
+
+static void register_types(lua_State *L)
+{
+    luax::init(L);
+    luax::type<Point>::register_in(L);
+    luax::type<PointExt>::register_in(L);
+    luax::type<PooledPoint>::register_in(L);
+    luax::type<Vec>::register_in(L);
+    luax::type<Level<1> >::register_in(L);
+    luax::type<Level<2> >::register_in(L);
+    luax::type<Level<3> >::register_in(L);
+    luax::type<Level<4> >::register_in(L);
+    luax::type<Level<5> >::register_in(L);
+    luax::type<Level<6> >::register_in(L);
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(push)
+{
+    bench::State L;
+    register_types(L);
+
+    Point pt[4];
+    r.run("push/hit", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::type<Point>::push(L, &pt[i & 3], false);
+            lua_pop(L, 1);
+        }
+    });
+
+    // Cache entries are weak, so full GC before each repetition makes
+    // every push a miss.
+    std::vector<Point> many(100000);
+    r.run("push/miss", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::type<Point>::push(L, &many[i % many.size()], false);
+            lua_pop(L, 1);
+        }
+    }, [&]() { lua_gc(L, LUA_GCCOLLECT, 0); });
+
+    Vec v(1, 2);
+    r.run("push/value", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::type<Vec>::push_value(L, v);
+            lua_pop(L, 1);
+        }
+    }, [&]() { lua_gc(L, LUA_GCCOLLECT, 0); });
+
+    // Cached userdata, the reference is taken only on the first push.
+    std::shared_ptr<const Point> shared = std::make_shared<Point>();
+    r.run("push/shared", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::type<Point>::push_shared(L, shared);
+            lua_pop(L, 1);
+        }
+    });
+}
+//------------------------------------------------------------------------------
+
+// Push arrays of k objects into a table: per object loop vs push_range().
+// Each op is one element, every push is a cache miss.
+static void bench_push_range(bench::Runner &r, lua_State *L, int k,
+                             const char *size)
+{
+    std::vector<Point> objs(k);
+    std::string name = std::string("push/") + size;
+    long iters = k < 1000 ? 100000 : 1000000;
+
+    r.run(name + "/loop", iters, [&](long n) {
+        for (long done = 0; done < n; done += k)
+        {
+            lua_newtable(L);
+            for (int i = 0; i < k; ++i)
+            {
+                luax::type<Point>::push(L, &objs[i], false);
+                lua_rawseti(L, -2, i + 1);
+            }
+            lua_pop(L, 1);
+        }
+    }, [&]() { lua_gc(L, LUA_GCCOLLECT, 0); });
+
+    r.run(name + "/range", iters, [&](long n) {
+        for (long done = 0; done < n; done += k)
+        {
+            luax::type<Point>::push_range(L, objs.begin(), objs.end(), false);
+            lua_pop(L, 1);
+        }
+    }, [&]() { lua_gc(L, LUA_GCCOLLECT, 0); });
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(push_range)
+{
+    bench::State L;
+    register_types(L);
+
+    bench_push_range(r, L, 10, "10");
+    bench_push_range(r, L, 1000, "1k");
+    bench_push_range(r, L, 100000, "100k");
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(get)
+{
+    bench::State L;
+    register_types(L);
+
+    Point pt;
+    PointExt ext;
+    luax::type<Point>::push(L, &pt, false);         // 1
+    luax::type<PointExt>::push(L, &ext, false);     // 2
+    std::shared_ptr<const Point> shared = std::make_shared<Point>();
+    luax::type<Point>::push_shared(L, shared);      // 3
+
+    r.run("get/get", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::type<Point>::get(L, 1));
+    });
+
+    // Shared instance is read without touching the reference counter.
+    r.run("get/get/shared", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::type<Point>::get(L, 3));
+    });
+
+    r.run("get/check_get", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::type<Point>::check_get(L, 1));
+    });
+
+    r.run("get/check_cast", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::type<Point>::check_cast(L, 1));
+    });
+
+    r.run("get/check_cast/derived", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::type<Point>::check_cast(L, 2));
+    });
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(method)
+{
+    bench::State L;
+    register_types(L);
+
+    Point pt;
+
+    lua_pushnil(L);
+    bench::Loop baseline(L, "local o, n = ...; for i = 1, n do end");
+    r.run("lua/loop", 1000000, [&](long n) { baseline(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop on_method(L, "local o, n = ...; for i = 1, n do o:move(1) end");
+    r.run("method/on_method", 1000000, [&](long n) { on_method(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop func(L, "local o, n = ...; for i = 1, n do o:moveC(1) end");
+    r.run("method/cfunction", 1000000, [&](long n) { func(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop tramp(L, "local o, n = ...; for i = 1, n do o:moveT(1) end");
+    r.run("method/trampoline", 1000000, [&](long n) { tramp(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop tramp_self(L, "local o, n = ...; for i = 1, n do o:moveTS(1) end");
+    r.run("method/trampoline_self", 1000000, [&](long n) { tramp_self(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop bound(L, "local o, n = ...; for i = 1, n do o:moveB(1) end");
+    r.run("method/bind", 1000000, [&](long n) { bound(n); });
+}
+//------------------------------------------------------------------------------
+
+// Call method of 1000 objects: lua loop vs invoke_all().
+// Each op is one object.
+BENCH_SUITE(invoke)
+{
+    bench::State L;
+    register_types(L);
+
+    std::vector<Point> objs(1000);
+
+    luax::type<Point>::push_range(L, objs.begin(), objs.end(), false);
+    bench::Loop loop(L, "local l, n = ...\n"
+                        "for d = 1, n, #l do\n"
+                        "  for i = 1, #l do l[i]:move(1) end\n"
+                        "end");
+    r.run("invoke/loop", 1000000, [&](long n) { loop(n); });
+
+    luax::type<Point>::push_range(L, objs.begin(), objs.end(), false);
+    bench::Loop all(L, "local l, n = ...\n"
+                       "local invoke = Point.invoke_all\n"
+                       "for d = 1, n, #l do invoke(l, 'move', 1) end");
+    r.run("invoke/invoke_all", 1000000, [&](long n) { all(n); });
+
+    luax::type<Point>::push_range(L, objs.begin(), objs.end(), false);
+    bench::Loop into(L, "local l, n = ...\n"
+                        "local invoke, out = Point.invoke_into, {}\n"
+                        "for d = 1, n, #l do invoke(out, l, 'getX') end");
+    r.run("invoke/invoke_into", 1000000, [&](long n) { into(n); });
+
+    r.run("invoke/range", 1000000, [&](long n) {
+        lua_pushinteger(L, 1);
+        for (long done = 0; done < n; done += 1000)
+            luax::type<Point>::invoke_all(L, objs.begin(), objs.end(), "move", 1);
+        lua_pop(L, 1);
+    });
+}
+//------------------------------------------------------------------------------
+
+template <int N>
+static void bench_prop_depth(bench::Runner &r, lua_State *L, const char *depth)
+{
+    Level<N> obj;
+    std::string name = std::string("prop/depth") + depth;
+
+    luax::type<Level<N> >::push(L, &obj, false);
+    bench::Loop get(L, "local o, n = ...; for i = 1, n do local v = o.x end");
+    r.run(name + "/get", 1000000, [&](long n) { get(n); });
+
+    luax::type<Level<N> >::push(L, &obj, false);
+    bench::Loop set(L, "local o, n = ...; for i = 1, n do o.x = i end");
+    r.run(name + "/set", 1000000, [&](long n) { set(n); });
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(prop)
+{
+    bench::State L;
+    register_types(L);
+
+    Point pt;
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop mget(L, "local o, n = ...; for i = 1, n do local v = o.x end");
+    r.run("prop/method/get", 1000000, [&](long n) { mget(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop mset(L, "local o, n = ...; for i = 1, n do o.x = i end");
+    r.run("prop/method/set", 1000000, [&](long n) { mset(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop fget(L, "local o, n = ...; for i = 1, n do local v = o.y end");
+    r.run("prop/func/get", 1000000, [&](long n) { fget(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop fset(L, "local o, n = ...; for i = 1, n do o.y = i end");
+    r.run("prop/func/set", 1000000, [&](long n) { fset(n); });
+
+    luax::type<Point>::push(L, &pt, false);
+    bench::Loop miss(L, "local o, n = ...; for i = 1, n do local v = o.nope end");
+    r.run("prop/miss", 1000000, [&](long n) { miss(n); });
+
+    bench_prop_depth<1>(r, L, "1");
+    bench_prop_depth<3>(r, L, "3");
+    bench_prop_depth<6>(r, L, "6");
+}
+//------------------------------------------------------------------------------
+
+BENCH_SUITE(create)
+{
+    bench::State L;
+    register_types(L);
+
+    // Includes GC of all created instances.
+    lua_pushnil(L);
+    bench::Loop heap(L, "local o, n = ...; for i = 1, n do local p = Point(i, i) end; collectgarbage()");
+    r.run("create/gc", 100000, [&](long n) { heap(n); });
+
+    lua_pushnil(L);
+    bench::Loop inplace(L, "local o, n = ...; for i = 1, n do local p = Vec(i, i) end; collectgarbage()");
+    r.run("create/gc/inplace", 100000, [&](long n) { inplace(n); });
+
+    lua_pushnil(L);
+    bench::Loop pooled(L, "local o, n = ...; for i = 1, n do local p = PooledPoint(i, i) end; collectgarbage()");
+    r.run("create/gc/pool", 100000, [&](long n) { pooled(n); });
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,117 @@
+#include "bench.h"
+#include "luax_utils.h"
+
+// Benchmarks for luax_utils.h helpers.
+
+BENCH_SUITE(utils)
+{
+    bench::State L;
+
+    r.run("utils/push_get/int", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::push(L, static_cast<int>(i));
+            bench::keep(luax::get<int>(L, -1));
+            lua_pop(L, 1);
+        }
+    });
+
+    r.run("utils/push_get/double", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::push(L, i * 0.5);
+            bench::keep(luax::get<double>(L, -1));
+            lua_pop(L, 1);
+        }
+    });
+
+    std::string str("some string value");
+    r.run("utils/push_get/string", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::push(L, str);
+            bench::keep(luax::get<std::string>(L, -1));
+            lua_pop(L, 1);
+        }
+    });
+
+    r.run("utils/checkget/int", 1000000, [&](long n) {
+        luax::push(L, 42);
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::checkget<int>(L, -1));
+        lua_pop(L, 1);
+    });
+
+    lua_newtable(L);
+    luax::set_field(L, -1, "width", 10);
+    lua_setglobal(L, "tbl");
+    luax::set_global(L, "gval", 1);
+
+    lua_getglobal(L, "tbl");
+    r.run("utils/get_field", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::get_field<int>(L, -1, "width"));
+    });
+
+    r.run("utils/set_field", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            luax::set_field(L, -1, "width", static_cast<int>(i));
+    });
+
+    r.run("utils/rawget_field", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::rawget_field<int>(L, -1, "width"));
+    });
+
+    luax::Key width(L, "width");
+    r.run("utils/rawget_field/key", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::rawget_field<int>(L, -1, width));
+    });
+
+    // Struct to table conversion.
+    r.run("utils/to_table/name", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::rawset_field(L, -1, "x", 1.0);
+            luax::rawset_field(L, -1, "y", 2.0);
+            luax::rawset_field(L, -1, "width", 3);
+            luax::rawset_field(L, -1, "height", 4);
+        }
+    });
+
+    luax::Key x(L, "x"), y(L, "y"), height(L, "height");
+    r.run("utils/to_table/key", 100000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            luax::rawset_field(L, -1, x, 1.0);
+            luax::rawset_field(L, -1, y, 2.0);
+            luax::rawset_field(L, -1, width, 3);
+            luax::rawset_field(L, -1, height, 4);
+        }
+    });
+    lua_pop(L, 1);
+
+    r.run("utils/get_global", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(luax::get_global<int>(L, "gval"));
+    });
+
+    luaL_dostring(L, "cfg = {net = {timeout = 10}}");
+    r.run("utils/get_path/lookup", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+        {
+            lua_getglobal(L, "cfg");
+            lua_getfield(L, -1, "net");
+            bench::keep(luax::get_field<int>(L, -1, "timeout"));
+            lua_pop(L, 2);
+        }
+    });
+
+    luax::FieldPath timeout(L, "cfg.net.timeout");
+    r.run("utils/get_path/field_path", 1000000, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bench::keep(timeout.get<int>());
+    });
+}
+//------------------------------------------------------------------------------
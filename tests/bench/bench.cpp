@@ -0,0 +1,199 @@
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace bench
+{
+
+// Nearest rank percentile of the sorted samples.
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[rank ? rank - 1 : 0];
+}
+//------------------------------------------------------------------------------
+
+static std::string escape(const std::string &str)
+{
+    std::string res;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            res += '\\';
+        res += c;
+    }
+    return res;
+}
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+
+bool Runner::enabled(const std::string &name) const
+{
+    return m_opts.filter.empty() || name.find(m_opts.filter) != std::string::npos;
+}
+//------------------------------------------------------------------------------
+
+void Runner::run(const std::string &name, long iters, Body body,
+                 Prepare prepare)
+{
+    if (!enabled(name))
+        return;
+
+    typedef std::chrono::steady_clock Clock;
+
+    long n = static_cast<long>(iters * m_opts.scale);
+    if (n < 1)
+        n = 1;
+
+    for (int i = 0; i < m_opts.warmup; ++i)
+    {
+        if (prepare)
+            prepare();
+        body(n);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(m_opts.reps);
+    for (int i = 0; i < m_opts.reps; ++i)
+    {
+        if (prepare)
+            prepare();
+        Clock::time_point start = Clock::now();
+        body(n);
+        Clock::time_point end = Clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        samples.push_back(ns / n);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result res;
+    res.name = name;
+    res.iterations = n;
+    res.reps = m_opts.reps;
+
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        sum += samples[i];
+    res.mean = sum / samples.size();
+
+    double var = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        var += (samples[i] - res.mean) * (samples[i] - res.mean);
+    res.stddev = std::sqrt(var / samples.size());
+
+    res.min = samples.front();
+    res.max = samples.back();
+    res.p50 = percentile(samples, 50);
+    res.p90 = percentile(samples, 90);
+    res.p99 = percentile(samples, 99);
+    res.ops_per_sec = res.p50 > 0 ? 1e9 / res.p50 : 0;
+    m_results.push_back(res);
+}
+//------------------------------------------------------------------------------
+
+void Runner::write_json(std::ostream &out) const
+{
+    out << "{\n";
+    out << "  \"lua\": \"" << LUA_RELEASE << "\",\n";
+#ifdef NDEBUG
+    out << "  \"assertions\": false,\n";
+#else
+    out << "  \"assertions\": true,\n";
+#endif
+    out << "  \"warmup\": " << m_opts.warmup << ",\n";
+    out << "  \"reps\": " << m_opts.reps << ",\n";
+    out << "  \"scale\": " << m_opts.scale << ",\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < m_results.size(); ++i)
+    {
+        const Result &r = m_results[i];
+        out << (i ? ",\n" : "\n");
+        out << "    {\"name\": \"" << escape(r.name) << "\""
+            << ", \"iterations\": " << r.iterations
+            << ", \"reps\": " << r.reps
+            << ", \"ns_per_op\": {"
+            << "\"min\": " << r.min
+            << ", \"mean\": " << r.mean
+            << ", \"stddev\": " << r.stddev
+            << ", \"p50\": " << r.p50
+            << ", \"p90\": " << r.p90
+            << ", \"p99\": " << r.p99
+            << ", \"max\": " << r.max
+            << "}, \"ops_per_sec\": " << r.ops_per_sec << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+//------------------------------------------------------------------------------
+
+void Runner::write_table(std::ostream &out) const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-40s %10s %10s %10s %10s %14s\n",
+             "name", "min", "p50", "p90", "p99", "ops/s");
+    out << buf;
+
+    for (size_t i = 0; i < m_results.size(); ++i)
+    {
+        const Result &r = m_results[i];
+        snprintf(buf, sizeof(buf), "%-40s %10.2f %10.2f %10.2f %10.2f %14.0f\n",
+                 r.name.c_str(), r.min, r.p50, r.p90, r.p99, r.ops_per_sec);
+        out << buf;
+    }
+}
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+
+Suite::Suite(const char *name, Func func): name(name), func(func)
+{
+    all().push_back(this);
+}
+//------------------------------------------------------------------------------
+
+std::vector<Suite*>& Suite::all()
+{
+    static std::vector<Suite*> suites;
+    return suites;
+}
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+
+// stack: obj
+Loop::Loop(lua_State *L, const char *script): L(L)
+{
+    m_obj = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (luaL_loadstring(L, script))
+        throw std::runtime_error(lua_tostring(L, -1));
+    m_func = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+//------------------------------------------------------------------------------
+
+Loop::~Loop()
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, m_func);
+    luaL_unref(L, LUA_REGISTRYINDEX, m_obj);
+}
+//------------------------------------------------------------------------------
+
+void Loop::operator()(long n)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_func);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_obj);
+    lua_pushinteger(L, static_cast<lua_Integer>(n));
+    if (lua_pcall(L, 2, 0, 0))
+    {
+        std::string err = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw std::runtime_error(err);
+    }
+}
+//------------------------------------------------------------------------------
+
+} // namespace bench
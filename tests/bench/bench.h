@@ -0,0 +1,181 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+// Microbenchmark harness for luax-bench.
+//
+// Benchmarks are grouped in suites, each suite is a function registered
+// with BENCH_SUITE() which calls Runner::run() for every case:
+//
+//  BENCH_SUITE(push)
+//  {
+//      bench::State L;
+//      ...
+//      r.run("push/hit", 1000000, [&](long n) {
+//          for (long i = 0; i < n; ++i) ...
+//      });
+//  }
+//
+// Each case is repeated with the same iterations count, every repetition
+// gives one ns/op sample; results are reported as percentiles over the
+// samples.
+
+#define BENCH_SUITE(name)                                               \
+    static void bench_suite_##name(bench::Runner &r);                   \
+    static bench::Suite bench_suite_reg_##name(#name, bench_suite_##name);\
+    static void bench_suite_##name(bench::Runner &r)
+
+namespace bench
+{
+
+/** Run options, see usage() in main.cpp. */
+struct Options
+{
+    Options(): warmup(2), reps(20), scale(1.0) {}
+
+    int warmup;             // Untimed repetitions.
+    int reps;               // Timed repetitions (samples).
+    double scale;           // Iterations multiplier.
+    std::string filter;     // Run only cases with the substring in name.
+};
+//------------------------------------------------------------------------------
+
+/** Case result, all times are in ns per operation. */
+struct Result
+{
+    std::string name;
+    long iterations;        // Operations per repetition.
+    int reps;
+    double min;
+    double mean;
+    double stddev;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    double ops_per_sec;     // Based on median.
+};
+//------------------------------------------------------------------------------
+
+class Runner
+{
+public:
+    // Runs n operations.
+    typedef std::function<void(long n)> Body;
+
+    // Called before each repetition, not timed.
+    typedef std::function<void()> Prepare;
+
+    explicit Runner(const Options &opts): m_opts(opts) {}
+
+    /**
+     * Run benchmark case.
+     *
+     * iters is operations count per repetition (scaled by Options::scale),
+     * body must perform exactly n operations.
+     */
+    void run(const std::string &name, long iters, Body body,
+             Prepare prepare = Prepare());
+
+    bool enabled(const std::string &name) const;
+    const std::vector<Result>& results() const { return m_results; }
+
+    void write_json(std::ostream &out) const;
+    void write_table(std::ostream &out) const;
+
+private:
+    Options m_opts;
+    std::vector<Result> m_results;
+};
+//------------------------------------------------------------------------------
+
+/** Suite registration, see BENCH_SUITE(). */
+struct Suite
+{
+    typedef void (*Func)(Runner &r);
+
+    Suite(const char *name, Func func);
+
+    static std::vector<Suite*>& all();
+
+    const char *name;
+    Func func;
+};
+//------------------------------------------------------------------------------
+
+/** Lua state with standard libs, closed on destruction. */
+class State
+{
+public:
+    State(): L(luaL_newstate()) { luaL_openlibs(L); }
+    ~State() { lua_close(L); }
+
+    operator lua_State*() const { return L; }
+
+private:
+    State(const State&);
+    State& operator=(const State&);
+
+    lua_State *L;
+};
+//------------------------------------------------------------------------------
+
+/**
+ * Lua loop to measure lua side operations.
+ *
+ * Script is compiled once and called with (obj, n), where obj is
+ * a value on top of the stack at construction time:
+ *
+ *  Loop loop(L, "local o, n = ...; for i = 1, n do local v = o.x end");
+ *  r.run("prop/get", 1000000, [&](long n) { loop(n); });
+ */
+class Loop
+{
+public:
+    Loop(lua_State *L, const char *script);
+    ~Loop();
+
+    void operator()(long n);
+
+private:
+    Loop(const Loop&);
+    Loop& operator=(const Loop&);
+
+    lua_State *L;
+    int m_func;
+    int m_obj;
+};
+//------------------------------------------------------------------------------
+
+/** Prevent compiler from optimizing out the value. */
+template <typename T>
+inline void keep(const T &v)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(v) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &v;
+#endif
+}
+//------------------------------------------------------------------------------
+
+} // namespace bench
+
+#endif // BENCH_H
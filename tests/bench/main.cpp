@@ -0,0 +1,100 @@
+#include "bench.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+static void usage(const char *prog)
+{
+    std::cerr
+        << "Usage: " << prog << " [options]\n"
+        << "  --filter STR   Run only cases with STR in the name.\n"
+        << "  --reps N       Timed repetitions per case (default 20).\n"
+        << "  --warmup N     Untimed repetitions per case (default 2).\n"
+        << "  --scale F      Iterations multiplier (default 1).\n"
+        << "  --quick        Smoke run: --reps 3 --warmup 1 --scale 0.01.\n"
+        << "  --json FILE    Write JSON results to FILE (default stdout).\n"
+        << "  --list         List suites and exit.\n";
+}
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    bench::Options opts;
+    const char *json_file = 0;
+    bool list = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : 0;
+
+        if (!strcmp(arg, "--quick"))
+        {
+            opts.reps = 3;
+            opts.warmup = 1;
+            opts.scale = 0.01;
+        }
+        else if (!strcmp(arg, "--list"))
+            list = true;
+        else if (!val)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else if (!strcmp(arg, "--filter"))
+            opts.filter = argv[++i];
+        else if (!strcmp(arg, "--reps"))
+            opts.reps = atoi(argv[++i]);
+        else if (!strcmp(arg, "--warmup"))
+            opts.warmup = atoi(argv[++i]);
+        else if (!strcmp(arg, "--scale"))
+            opts.scale = atof(argv[++i]);
+        else if (!strcmp(arg, "--json"))
+            json_file = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.reps < 1 || opts.warmup < 0 || opts.scale <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<bench::Suite*> &suites = bench::Suite::all();
+    if (list)
+    {
+        for (size_t i = 0; i < suites.size(); ++i)
+            std::cout << suites[i]->name << "\n";
+        return 0;
+    }
+
+    bench::Runner runner(opts);
+    try
+    {
+        for (size_t i = 0; i < suites.size(); ++i)
+            suites[i]->func(runner);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    runner.write_table(std::cerr);
+
+    if (json_file)
+    {
+        std::ofstream out(json_file);
+        runner.write_json(out);
+    }
+    else
+        runner.write_json(std::cout);
+    return 0;
+}
+//------------------------------------------------------------------------------